@@ -43,4 +43,62 @@ project "safemap"
    }
    -- binaries
    targetdir(ROOT .. "/lib/%{cfg.buildcfg}")
-   objdir(ROOT .. "/bin/%{cfg.system}_%{cfg.buildcfg}")
\ No newline at end of file
+   objdir(ROOT .. "/bin/%{cfg.system}_%{cfg.buildcfg}")
+-- project bench
+project "bench"
+   -- console application
+   kind "ConsoleApp"
+   -- include directories
+   includedirs {
+      ROOT .. "/include",
+      ROOT .. "/src"
+   }
+   -- files
+   files {
+      ROOT .. "/tests/bench.cpp"
+   }
+   -- links
+   links { "safemap", "pthread" }
+   -- binaries
+   targetdir(ROOT .. "/bin/tests/%{cfg.system}_%{cfg.buildcfg}")
+   objdir(ROOT .. "/bin/tests/%{cfg.system}_%{cfg.buildcfg}/obj/bench")
+-- project lockorder (tests built with the lock order validator, see src/lockorder.hpp)
+project "lockorder"
+   -- console application
+   kind "ConsoleApp"
+   -- include directories
+   includedirs {
+      ROOT .. "/include",
+      ROOT .. "/src"
+   }
+   -- defines
+   defines { "SAFEMAP_LOCK_ORDER" }
+   -- files
+   files {
+      ROOT .. "/tests/test.cpp"
+   }
+   -- links
+   links { "safemap", "pthread" }
+   -- binaries
+   targetdir(ROOT .. "/bin/tests/%{cfg.system}_%{cfg.buildcfg}")
+   objdir(ROOT .. "/bin/tests/%{cfg.system}_%{cfg.buildcfg}/obj/lockorder")
+-- project lockstats (tests built with lock contention statistics, see src/stats.hpp)
+project "lockstats"
+   -- console application
+   kind "ConsoleApp"
+   -- include directories
+   includedirs {
+      ROOT .. "/include",
+      ROOT .. "/src"
+   }
+   -- defines
+   defines { "SAFEMAP_LOCK_STATS" }
+   -- files
+   files {
+      ROOT .. "/tests/test.cpp"
+   }
+   -- links
+   links { "safemap", "pthread" }
+   -- binaries
+   targetdir(ROOT .. "/bin/tests/%{cfg.system}_%{cfg.buildcfg}")
+   objdir(ROOT .. "/bin/tests/%{cfg.system}_%{cfg.buildcfg}/obj/lockstats")
\ No newline at end of file
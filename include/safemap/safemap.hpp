@@ -19,6 +19,31 @@
 #include <mutex>
 #include <shared_mutex>
 #include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <typeinfo>
+#include <chrono>
+#include <utility>
+#include <cstring>
+#include <stdexcept>
+#include <iterator>
+#include <memory_resource>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <bit>
+#include <coroutine>
+#ifdef SAFEMAP_LOCK_ORDER
+#include <sstream>
+#include <algorithm>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 // #include "common.hpp" (HPPMERGE)
@@ -98,6 +123,9 @@ namespace Memory {
     using std::mutex;
     using std::shared_mutex;
     using std::recursive_mutex;
+    // thread
+    using std::thread;
+    using std::condition_variable;
     // atomic
     // :: address
     using atomic_address = std::atomic_size_t;
@@ -113,19 +141,276 @@ namespace Memory {
     using atomic_uint64 = std::atomic_uint64_t;
 }
 
+// #include "lockorder.hpp" (HPPMERGE)
+namespace Memory {
+    // LockOrder
+    // validates the hierarchy rule of product.md when SAFEMAP_LOCK_ORDER is defined, otherwise every call is empty:
+    // entry locks held by a thread are tracked, acquiring B while holding A adds the edge A -> B to a global graph,
+    // an edge that closes a cycle (possible deadlock) or a lock the thread already holds (self re-entry) is reported
+    class LockOrder {
+    public:
+        // acquire (before a blocking acquisition)
+        static void acquire([[maybe_unused]] const void* lock) {
+#ifdef SAFEMAP_LOCK_ORDER
+            state().check(lock);
+            held().emplace_back(lock);
+#endif
+        }
+        // acquired (after a non-blocking acquisition, it can not deadlock but is held from now on)
+        static void acquired([[maybe_unused]] const void* lock) {
+#ifdef SAFEMAP_LOCK_ORDER
+            held().emplace_back(lock);
+#endif
+        }
+        // release
+        static void release([[maybe_unused]] const void* lock) {
+#ifdef SAFEMAP_LOCK_ORDER
+            auto& locks = held();
+            for (auto it = locks.rbegin(); it != locks.rend(); ++it) {
+                if (*it == lock) {
+                    locks.erase(std::next(it).base());
+                    break;
+                }
+            }
+#endif
+        }
+        // name (key and value type shown in reports)
+        template<typename K>
+        static void name([[maybe_unused]] const void* lock, [[maybe_unused]] const K& key, [[maybe_unused]] const std::type_info& type) {
+#ifdef SAFEMAP_LOCK_ORDER
+            std::ostringstream stream;
+            if constexpr (requires(std::ostream& out) { out << key; }) {
+                stream << "key " << key;
+            }
+            else {
+                stream << "entry " << lock;
+            }
+            stream << " (" << type.name() << ")";
+            State& current = state();
+            unique_lock locked(current.guard);
+            current.names[lock] = stream.str();
+#endif
+        }
+        // forget (the lock is destroyed, its address may be reused by an unrelated entry)
+        static void forget([[maybe_unused]] const void* lock) {
+#ifdef SAFEMAP_LOCK_ORDER
+            State& current = state();
+            unique_lock locked(current.guard);
+            current.edges.erase(lock);
+            for (auto& [from, to] : current.edges) {
+                to.erase(lock);
+            }
+            current.names.erase(lock);
+#endif
+        }
+        // onViolation (replaces the default handler, which prints the report and aborts)
+        static void onViolation([[maybe_unused]] function<void(const string&)> handler) {
+#ifdef SAFEMAP_LOCK_ORDER
+            State& current = state();
+            unique_lock locked(current.guard);
+            current.handler = move(handler);
+#endif
+        }
+#ifdef SAFEMAP_LOCK_ORDER
+    private:
+        // State
+        struct State {
+            mutex guard;
+            HashMap<const void*, HashSet<const void*>> edges;
+            HashMap<const void*, string> names;
+            function<void(const string&)> handler = [](const string& report) {
+                std::cerr << report << std::endl;
+                std::abort();
+            };
+
+            // check (the report is built under the mutex, the handler runs outside of it)
+            void check(const void* lock) {
+                string report;
+                {
+                    unique_lock locked(guard);
+                    for (const void* other : held()) {
+                        if (other == lock) {
+                            report = "LockOrder: self re-entry on " + label(lock);
+                            break;
+                        }
+                        if (edges[other].contains(lock)) {
+                            continue;
+                        }
+                        List<const void*> path;
+                        if (find(lock, other, path)) {
+                            report = "LockOrder: cycle " + label(other);
+                            for (const void* step : path) {
+                                report += " -> " + label(step);
+                            }
+                            break;
+                        }
+                        edges[other].emplace(lock);
+                    }
+                }
+                if (!report.empty()) {
+                    handler(report);
+                }
+            }
+            // find (breadth first search for a path from -> to, path receives it including both ends)
+            bool find(const void* from, const void* to, List<const void*>& path) {
+                HashMap<const void*, const void*> parent = { { from, nullptr } };
+                Queue<const void*> pending;
+                pending.push(from);
+                while (!pending.empty()) {
+                    const void* current = pending.front();
+                    pending.pop();
+                    if (current == to) {
+                        for (const void* step = to; step; step = parent[step]) {
+                            path.emplace_back(step);
+                        }
+                        std::reverse(path.begin(), path.end());
+                        return true;
+                    }
+                    auto it = edges.find(current);
+                    if (it != edges.end()) {
+                        for (const void* next : it->second) {
+                            if (parent.emplace(next, current).second) {
+                                pending.push(next);
+                            }
+                        }
+                    }
+                }
+                return false;
+            }
+            // label (requires the mutex)
+            string label(const void* lock) const {
+                auto it = names.find(lock);
+                if (it != names.end()) {
+                    return it->second;
+                }
+                std::ostringstream stream;
+                stream << "entry " << lock;
+                return stream.str();
+            }
+        };
+
+        // state / held (locks held by the calling thread, in acquisition order)
+        static State& state() {
+            static State current;
+            return current;
+        }
+        static List<const void*>& held() {
+            thread_local List<const void*> locks;
+            return locks;
+        }
+#endif
+    };
+}
+
 // #include "lock.hpp" (HPPMERGE)
 namespace Memory {
+    // Interface for write observers (told about a write lock right before it is released, see ChangeLog)
+    class IWriteObserver {
+    public:
+        // constructor / destructor
+        IWriteObserver() = default;
+        virtual ~IWriteObserver() = default;
+
+        // onWrite (key points to the key of the written entry)
+        virtual void onWrite(const void* key) = 0;
+    };
+
+    // UpgradeLock
+    // owns the upgrade mode of a mutex (lock_upgrade / unlock_upgrade, see CompactMutex and UpgradeMutex),
+    // upgrade promotes it to a unique_lock that takes over the ownership
+    template<typename TMutex>
+    class UpgradeLock {
+    public:
+        // types
+        using mutex_type = TMutex;
+
+        // constructor / destructor
+        UpgradeLock() = default;
+        explicit UpgradeLock(TMutex& mutex)
+            : m_mutex(&mutex) {
+            lock();
+        }
+        UpgradeLock(TMutex& mutex, std::defer_lock_t)
+            : m_mutex(&mutex) {}
+        ~UpgradeLock() {
+            if (m_owns) {
+                m_mutex->unlock_upgrade();
+            }
+        }
+        // copy
+        UpgradeLock(const UpgradeLock&) = delete;
+        // copy assign
+        UpgradeLock& operator=(const UpgradeLock&) = delete;
+        // move
+        UpgradeLock(UpgradeLock&& other)
+            : m_mutex(std::exchange(other.m_mutex, nullptr)), m_owns(std::exchange(other.m_owns, false)) {}
+        // move assign
+        UpgradeLock& operator=(UpgradeLock&& other) {
+            if (m_owns) {
+                m_mutex->unlock_upgrade();
+            }
+            m_mutex = std::exchange(other.m_mutex, nullptr);
+            m_owns = std::exchange(other.m_owns, false);
+            return *this;
+        }
+
+        // lock / unlock
+        void lock() {
+            m_mutex->lock_upgrade();
+            m_owns = true;
+        }
+        bool try_lock() {
+            m_owns = m_mutex->try_lock_upgrade();
+            return m_owns;
+        }
+        void unlock() {
+            m_mutex->unlock_upgrade();
+            m_owns = false;
+        }
+        // release (gives up the ownership without unlocking)
+        TMutex* release() {
+            m_owns = false;
+            return std::exchange(m_mutex, nullptr);
+        }
+        // upgrade (waits until the readers are gone)
+        unique_lock<TMutex> upgrade() {
+            m_mutex->upgrade();
+            return unique_lock<TMutex>(*release(), std::adopt_lock);
+        }
+
+        // mutex
+        TMutex* mutex() const {
+            return m_mutex;
+        }
+        // isValid
+        explicit operator bool() const {
+            return m_owns;
+        }
+    private:
+        // member
+        TMutex* m_mutex = nullptr;
+        bool m_owns = false;
+    };
+
     // Locked
     template<typename T, typename TLock>
     class Locked {
     public:
+        // types
+        static constexpr bool IsUpgrade = requires(TLock& lock) { lock.upgrade(); };
+
         // constructor
         Locked()
             : m_ptr(nullptr) {}
-        Locked(T* ptr, shared_mutex& mutex)
+        Locked(T* ptr, typename TLock::mutex_type& mutex)
             : m_ptr(ptr), m_lock(mutex) {}
+        Locked(T* ptr, TLock&& lock)
+            : m_ptr(ptr), m_lock(move(lock)) {}
         // destructor
-        ~Locked() = default;
+        ~Locked() {
+            notify();
+            untrack();
+        }
         // copy
         Locked(const Locked<T, TLock>&) = delete;
         // copy assign
@@ -133,12 +418,19 @@ namespace Memory {
         // move
         template<typename U>
         Locked(Locked<U, TLock>&& other)
-            : m_ptr((T*)other.m_ptr), m_lock(move(other.m_lock)) {}
+            : m_ptr((T*)other.m_ptr), m_lock(move(other.m_lock)), m_observer(other.m_observer), m_key(other.m_key) {
+            other.m_observer = nullptr;
+        }
         // move assign
         template<typename U>
         Locked<T, TLock>& operator=(Locked<U, TLock>&& other) {
+            notify();
+            untrack();
             m_ptr = (T*)other.m_ptr;
             m_lock = move(other.m_lock);
+            m_observer = other.m_observer;
+            m_key = other.m_key;
+            other.m_observer = nullptr;
             return *this;
         }
 
@@ -146,14 +438,42 @@ namespace Memory {
         T* operator->() {
             return m_ptr;
         }
+        // operator*
+        T& operator*() {
+            return *m_ptr;
+        }
         // release
         void release() {
+            notify();
+            untrack();
             if (m_lock) {
                 m_lock.unlock();
                 m_lock.release();
             }
         }
 
+        // upgrade
+        // (upgrade locks only) continues as write lock on the same value, this handle is empty afterwards,
+        // no writer can come in between, so what was read under the upgrade lock still holds
+        Locked<std::remove_const_t<T>, unique_lock<typename TLock::mutex_type>> upgrade() requires(IsUpgrade) {
+            using Mutable = std::remove_const_t<T>;
+            if (!m_lock) {
+                return {};
+            }
+            // the entry stays held, so LockOrder keeps tracking it until the write lock is released
+            Locked<Mutable, unique_lock<typename TLock::mutex_type>> locked(const_cast<Mutable*>(m_ptr), m_lock.upgrade());
+            locked.observe(m_observer, m_key);
+            m_ptr = nullptr;
+            m_observer = nullptr;
+            return locked;
+        }
+
+        // observe (the observer is notified once, while the lock is still held, upgrade locks pass it on to upgrade)
+        void observe(IWriteObserver* observer, const void* key) {
+            m_observer = observer;
+            m_key = key;
+        }
+
         // isValid
         operator bool() const {
             return m_ptr != nullptr;
@@ -163,220 +483,3930 @@ namespace Memory {
         template<typename U, typename ULock>
         friend class Locked;
     private:
+        // notify
+        void notify() {
+            if (!IsUpgrade && m_observer && m_lock) {
+                m_observer->onWrite(m_key);
+            }
+            m_observer = nullptr;
+        }
+        // untrack (the held lock is about to be released, see LockOrder)
+        void untrack() {
+            if (m_lock) {
+                LockOrder::release(m_lock.mutex());
+            }
+        }
+
         // pointer
         T* m_ptr;
         TLock m_lock;
+        // observer
+        IWriteObserver* m_observer = nullptr;
+        const void* m_key = nullptr;
     };
     // ReadLocked / WriteLocked
+    template<typename T, typename TMutex = shared_mutex>
+    using ReadLocked = Locked<const T, shared_lock<TMutex>>;
+    template<typename T, typename TMutex = shared_mutex>
+    using WriteLocked = Locked<T, unique_lock<TMutex>>;
+    template<typename T, typename TMutex>
+    using UpgradeLocked = Locked<const T, UpgradeLock<TMutex>>;
+
+    // LockStatus / LockAttempt (result of a non-blocking or deadline-bounded lock)
+    enum class LockStatus {
+        Acquired, Missing, Contended
+    };
+    template<typename TLocked>
+    struct LockAttempt {
+        TLocked locked;
+        LockStatus status = LockStatus::Missing;
+
+        // isValid
+        operator bool() const {
+            return status == LockStatus::Acquired;
+        }
+    };
+
+    // tryLockUntil
+    // works with every mutex of the policies: tries, then yields and finally sleeps in short steps until the deadline
+    template<typename TLock>
+    bool tryLockUntil(TLock& lock, std::chrono::steady_clock::time_point deadline) {
+        for (address attempt = 0;; ++attempt) {
+            if (lock.try_lock()) {
+                return true;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                return false;
+            }
+            if (attempt < 64) {
+                std::this_thread::yield();
+            }
+            else {
+                std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(deadline - now, std::chrono::microseconds(50)));
+            }
+        }
+    }
+}
+
+// #include "storage.hpp" (HPPMERGE)
+namespace Memory {
+    // Storage
+    // the state byte holds the valid bit and the pending bit (see SecureMap::insert), it is only written by the holder of
+    // the entry write lock, but the pending bit is read without the lock, so every access goes through atomic_ref
     template<typename T>
-    using ReadLocked = Locked<const T, shared_lock<shared_mutex>>;
-    template<typename T>
-    using WriteLocked = Locked<T, unique_lock<shared_mutex>>;
+    class Storage {
+    public:
+        // construct
+        template<typename... Args>
+        void construct(Args&&... args) {
+            if (isValid()) {
+                destroy();
+            }
+            std::construct_at(std::bit_cast<T*>(&m_storage), forward<Args>(args)...);
+            store(load() | Valid, std::memory_order_relaxed);
+        }
+        // destroy
+        void destroy() {
+            if (isValid()) {
+                store(load() & ~Valid, std::memory_order_relaxed);
+                std::destroy_at(std::bit_cast<T*>(&m_storage));
+            }
+        }
+        // isValid
+        bool isValid() const {
+            return load() & Valid;
+        }
+        // pending (a value is being constructed by the holder of the write lock, readable without the lock)
+        bool isPending() const {
+            return load(std::memory_order_acquire) & Pending;
+        }
+        void setPending(bool pending) {
+            store(pending ? load() | Pending : load() & ~Pending, std::memory_order_release);
+        }
+
+        // get
+        T& get() {
+            return *std::bit_cast<T*>(&m_storage);
+        }
+        const T& get() const {
+            return *std::bit_cast<const T*>(&m_storage);
+        }
+    private:
+        // state
+        static constexpr uint8 Valid = 1;
+        static constexpr uint8 Pending = 2;
+
+        // load / store (state)
+        uint8 load(std::memory_order order = std::memory_order_relaxed) const {
+            return std::atomic_ref(const_cast<uint8&>(m_state)).load(order);
+        }
+        void store(uint8 state, std::memory_order order) {
+            std::atomic_ref(m_state).store(state, order);
+        }
+
+        // storage
+        std::aligned_storage_t<sizeof(T), alignof(T)> m_storage;
+        uint8 m_state = 0;
+    };
+}
+
+// #include "stats.hpp" (HPPMERGE)
+namespace Memory {
+    // LockStats (snapshot of one lock kind)
+    struct LockStats {
+        uint64 acquisitions = 0;
+        uint64 contended = 0;
+        uint64 waitNanos = 0;
+        uint64 maxWaitNanos = 0;
+
+        // operator+=
+        LockStats& operator+=(const LockStats& other) {
+            acquisitions += other.acquisitions;
+            contended += other.contended;
+            waitNanos += other.waitNanos;
+            maxWaitNanos = std::max(maxWaitNanos, other.maxWaitNanos);
+            return *this;
+        }
+    };
+    // MapStats (snapshot of a map, the map mutex and the entry mutexes are kept apart)
+    struct MapStats {
+        LockStats map;
+        LockStats entries;
+
+        // operator+=
+        MapStats& operator+=(const MapStats& other) {
+            map += other.map;
+            entries += other.entries;
+            return *this;
+        }
+    };
+
+    // LockCounter
+    // only counts when SAFEMAP_LOCK_STATS is defined, otherwise acquire() is a plain lock()
+    class LockCounter {
+    public:
+        // acquire (uncontended acquisitions are not timed)
+        template<typename TLock>
+        void acquire(TLock& lock) {
+#ifdef SAFEMAP_LOCK_STATS
+            m_acquisitions.fetch_add(1, std::memory_order_relaxed);
+            if (lock.try_lock()) {
+                return;
+            }
+            auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            uint64 nanos = static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            m_contended.fetch_add(1, std::memory_order_relaxed);
+            m_waitNanos.fetch_add(nanos, std::memory_order_relaxed);
+            uint64 max = m_maxWaitNanos.load(std::memory_order_relaxed);
+            while (nanos > max && !m_maxWaitNanos.compare_exchange_weak(max, nanos, std::memory_order_relaxed));
+#else
+            lock.lock();
+#endif
+        }
+        // acquire until (gives up at the deadline, waits are timed as in acquire)
+        template<typename TLock>
+        bool acquireUntil(TLock& lock, std::chrono::steady_clock::time_point deadline) {
+#ifdef SAFEMAP_LOCK_STATS
+            m_acquisitions.fetch_add(1, std::memory_order_relaxed);
+            if (lock.try_lock()) {
+                return true;
+            }
+            auto start = std::chrono::steady_clock::now();
+            bool acquired = tryLockUntil(lock, deadline);
+            uint64 nanos = static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            m_contended.fetch_add(1, std::memory_order_relaxed);
+            m_waitNanos.fetch_add(nanos, std::memory_order_relaxed);
+            uint64 max = m_maxWaitNanos.load(std::memory_order_relaxed);
+            while (nanos > max && !m_maxWaitNanos.compare_exchange_weak(max, nanos, std::memory_order_relaxed));
+            return acquired;
+#else
+            return tryLockUntil(lock, deadline);
+#endif
+        }
+        // snapshot
+        LockStats snapshot() const {
+#ifdef SAFEMAP_LOCK_STATS
+            return {
+                m_acquisitions.load(std::memory_order_relaxed),
+                m_contended.load(std::memory_order_relaxed),
+                m_waitNanos.load(std::memory_order_relaxed),
+                m_maxWaitNanos.load(std::memory_order_relaxed)
+            };
+#else
+            return {};
+#endif
+        }
+    private:
+#ifdef SAFEMAP_LOCK_STATS
+        // counter
+        atomic_uint64 m_acquisitions = 0;
+        atomic_uint64 m_contended = 0;
+        atomic_uint64 m_waitNanos = 0;
+        atomic_uint64 m_maxWaitNanos = 0;
+#endif
+    };
+
+    // CountedMutex (shared mutex that reports to its own LockCounter)
+    template<typename TMutex>
+    class CountedMutex {
+    public:
+        // lock / unlock
+        void lock() {
+            unique_lock lock(m_mutex, std::defer_lock);
+            m_counter.acquire(lock);
+            lock.release();
+        }
+        bool try_lock() {
+            return m_mutex.try_lock();
+        }
+        void unlock() {
+            m_mutex.unlock();
+        }
+        // lock / unlock shared
+        void lock_shared() {
+            shared_lock lock(m_mutex, std::defer_lock);
+            m_counter.acquire(lock);
+            lock.release();
+        }
+        bool try_lock_shared() {
+            return m_mutex.try_lock_shared();
+        }
+        void unlock_shared() {
+            m_mutex.unlock_shared();
+        }
+
+        // stats
+        LockStats stats() const {
+            return m_counter.snapshot();
+        }
+    private:
+        // member
+        TMutex m_mutex;
+        LockCounter m_counter;
+    };
+
+    // MapMutex (the map-wide mutex, only wrapped while counting)
+#ifdef SAFEMAP_LOCK_STATS
+    using MapMutex = CountedMutex<shared_mutex>;
+#else
+    using MapMutex = shared_mutex;
+#endif
+}
+
+// #include "seqlock.hpp" (HPPMERGE)
+namespace Memory {
+    // SeqMutex
+    // shared mutex with a version counter that is odd while a writer holds it,
+    // readers of trivially copyable values can copy optimistically and validate the version
+    template<typename TMutex = shared_mutex>
+    class SeqMutex {
+    public:
+        // lock / unlock
+        void lock() {
+            m_mutex.lock();
+            begin();
+        }
+        bool try_lock() {
+            if (m_mutex.try_lock()) {
+                begin();
+                return true;
+            }
+            return false;
+        }
+        void unlock() {
+            m_version.store(m_version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            m_mutex.unlock();
+        }
+        // lock / unlock shared
+        void lock_shared() {
+            m_mutex.lock_shared();
+        }
+        bool try_lock_shared() {
+            return m_mutex.try_lock_shared();
+        }
+        void unlock_shared() {
+            m_mutex.unlock_shared();
+        }
+
+        // version
+        uint32 version(std::memory_order order = std::memory_order_acquire) const {
+            return m_version.load(order);
+        }
+    private:
+        // begin (version becomes odd before any write to the value)
+        void begin() {
+            m_version.store(m_version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        // member
+        TMutex m_mutex;
+        atomic_uint32 m_version = 0;
+    };
+
+    // readOptimistic
+    // copies the value without taking the mutex, falls back to a shared lock while writers keep it busy
+    template<typename T, typename TMutex>
+    T readOptimistic(const T& value, TMutex& mutex) {
+        static_assert(std::is_trivially_copyable_v<T>, "optimistic reads require a trivially copyable value");
+        for (address attempt = 0; attempt < 64; ++attempt) {
+            uint32 before = mutex.version();
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            T copy;
+            std::memcpy(static_cast<void*>(&copy), static_cast<const void*>(&value), sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (mutex.version(std::memory_order_relaxed) == before) {
+                return copy;
+            }
+        }
+        shared_lock lock(mutex);
+        return value;
+    }
+}
+
+// #include "rwlock.hpp" (HPPMERGE)
+namespace Memory {
+    // CompactMutex
+    // 4 byte reader-writer lock (writer bit, sleeper bit, upgrader bit, 29 bit reader count),
+    // threads spin briefly and then sleep on the state word (futex on linux)
+    class CompactMutex {
+    public:
+        // constructor
+        CompactMutex() = default;
+        // copy
+        CompactMutex(const CompactMutex&) = delete;
+        // copy assign
+        CompactMutex& operator=(const CompactMutex&) = delete;
+
+        // lock / unlock
+        void lock() {
+            for (address spin = 0;; ++spin) {
+                uint32 state = m_state.load(std::memory_order_relaxed);
+                if ((state & (Writer | Upgrader | Readers)) == 0) {
+                    if (m_state.compare_exchange_weak(state, state | Writer, std::memory_order_acquire, std::memory_order_relaxed)) {
+                        return;
+                    }
+                    continue;
+                }
+                wait(state, spin);
+            }
+        }
+        bool try_lock() {
+            uint32 state = m_state.load(std::memory_order_relaxed);
+            return (state & (Writer | Upgrader | Readers)) == 0
+                && m_state.compare_exchange_strong(state, state | Writer, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+        void unlock() {
+            uint32 state = m_state.fetch_and(~(Writer | Sleepers), std::memory_order_release);
+            if (state & Sleepers) {
+                m_state.notify_all();
+            }
+        }
+        // lock / unlock shared
+        void lock_shared() {
+            for (address spin = 0;; ++spin) {
+                uint32 state = m_state.load(std::memory_order_relaxed);
+                if ((state & Writer) == 0) {
+                    if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                        return;
+                    }
+                    continue;
+                }
+                wait(state, spin);
+            }
+        }
+        bool try_lock_shared() {
+            uint32 state = m_state.load(std::memory_order_relaxed);
+            while ((state & Writer) == 0) {
+                if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        void unlock_shared() {
+            uint32 state = m_state.fetch_sub(1, std::memory_order_release);
+            if ((state & Readers) == 1 && (state & Sleepers)) {
+                m_state.fetch_and(~Sleepers, std::memory_order_relaxed);
+                m_state.notify_all();
+            }
+        }
+        // lock / unlock upgrade (shared with readers, exclusive among upgraders and writers)
+        void lock_upgrade() {
+            for (address spin = 0;; ++spin) {
+                uint32 state = m_state.load(std::memory_order_relaxed);
+                if ((state & (Writer | Upgrader)) == 0) {
+                    if (m_state.compare_exchange_weak(state, state | Upgrader, std::memory_order_acquire, std::memory_order_relaxed)) {
+                        return;
+                    }
+                    continue;
+                }
+                wait(state, spin);
+            }
+        }
+        bool try_lock_upgrade() {
+            uint32 state = m_state.load(std::memory_order_relaxed);
+            while ((state & (Writer | Upgrader)) == 0) {
+                if (m_state.compare_exchange_weak(state, state | Upgrader, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        void unlock_upgrade() {
+            uint32 state = m_state.fetch_and(~(Upgrader | Sleepers), std::memory_order_release);
+            if (state & Sleepers) {
+                m_state.notify_all();
+            }
+        }
+        // upgrade (the held upgrade lock becomes the write lock once the readers are gone, release it with unlock)
+        void upgrade() {
+            for (address spin = 0;; ++spin) {
+                uint32 state = m_state.load(std::memory_order_relaxed);
+                if ((state & Readers) == 0) {
+                    if (m_state.compare_exchange_weak(state, (state & ~Upgrader) | Writer, std::memory_order_acquire, std::memory_order_relaxed)) {
+                        return;
+                    }
+                    continue;
+                }
+                wait(state, spin);
+            }
+        }
+    private:
+        // state
+        static constexpr uint32 Writer = 1u << 31;
+        static constexpr uint32 Sleepers = 1u << 30;
+        static constexpr uint32 Upgrader = 1u << 29;
+        static constexpr uint32 Readers = Upgrader - 1;
+
+        // wait (spin first, then announce ourselves and sleep until the state changes)
+        void wait(uint32 state, address spin) {
+            if (spin < 64) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+                __builtin_ia32_pause();
+#endif
+                return;
+            }
+            if ((state & Sleepers) == 0) {
+                if (!m_state.compare_exchange_weak(state, state | Sleepers, std::memory_order_relaxed)) {
+                    return;
+                }
+                state |= Sleepers;
+            }
+            m_state.wait(state, std::memory_order_relaxed);
+        }
+
+        // member
+        atomic_uint32 m_state = 0;
+    };
+
+    // UpgradeMutex
+    // adds the upgrade mode to a shared mutex: writers and the upgrader serialize on a plain mutex first,
+    // so the upgrader already excludes every writer and upgrade only has to wait for the readers
+    template<typename TMutex = shared_mutex>
+    class UpgradeMutex {
+    public:
+        // lock / unlock
+        void lock() {
+            m_upgrade.lock();
+            m_mutex.lock();
+        }
+        bool try_lock() {
+            if (!m_upgrade.try_lock()) {
+                return false;
+            }
+            if (!m_mutex.try_lock()) {
+                m_upgrade.unlock();
+                return false;
+            }
+            return true;
+        }
+        void unlock() {
+            m_mutex.unlock();
+            m_upgrade.unlock();
+        }
+        // lock / unlock shared
+        void lock_shared() {
+            m_mutex.lock_shared();
+        }
+        bool try_lock_shared() {
+            return m_mutex.try_lock_shared();
+        }
+        void unlock_shared() {
+            m_mutex.unlock_shared();
+        }
+        // lock / unlock upgrade
+        void lock_upgrade() {
+            m_upgrade.lock();
+        }
+        bool try_lock_upgrade() {
+            return m_upgrade.try_lock();
+        }
+        void unlock_upgrade() {
+            m_upgrade.unlock();
+        }
+        // upgrade (see CompactMutex::upgrade)
+        void upgrade() {
+            m_mutex.lock();
+        }
+    private:
+        // member
+        mutex m_upgrade;
+        TMutex m_mutex;
+    };
 }
 
-// #include "value.hpp" (HPPMERGE)
-namespace Memory {
-    // SecureValue
-    template<typename T>
-    class SecureValue {
-    public:
-        // constructor
-        template<typename... Args>
-        SecureValue(Args&&... args)
-            : m_value(forward<Args>(args)...) {}
-        // read / write lock
-        ReadLocked<T> readLock() const {
-            return { &m_value, m_mutex };
+// #include "asyncmutex.hpp" (HPPMERGE)
+namespace Memory {
+    // AsyncWaiter
+    // queue node of a pending AsyncMutex acquisition, grant is called once the lock was handed over
+    struct AsyncWaiter {
+        AsyncWaiter* next = nullptr;
+        bool exclusive = false;
+        // blocking waiters are granted under the internal guard, coroutine waiters after it was released
+        bool blocking = false;
+        void (*grant)(AsyncWaiter*) = nullptr;
+    };
+
+    // AsyncMutex
+    // reader-writer lock with a FIFO wait queue, a release hands the lock directly to the next waiters,
+    // so coroutines can wait for an entry without occupying a thread (see SecureMap::writeLockAsync)
+    class AsyncMutex {
+    public:
+        // constructor
+        AsyncMutex() = default;
+        // copy
+        AsyncMutex(const AsyncMutex&) = delete;
+        // copy assign
+        AsyncMutex& operator=(const AsyncMutex&) = delete;
+
+        // lock / unlock
+        void lock() {
+            wait(true);
+        }
+        bool try_lock() {
+            unique_lock guard(m_guard);
+            if (m_head || m_writer || m_readers) {
+                return false;
+            }
+            m_writer = true;
+            return true;
+        }
+        void unlock() {
+            release(true);
+        }
+        // lock / unlock shared
+        void lock_shared() {
+            wait(false);
+        }
+        bool try_lock_shared() {
+            unique_lock guard(m_guard);
+            if (m_head || m_writer) {
+                return false;
+            }
+            ++m_readers;
+            return true;
+        }
+        void unlock_shared() {
+            release(false);
+        }
+
+        // lock async (true if the lock was free, otherwise the waiter is queued and granted later)
+        bool lockAsync(AsyncWaiter& waiter) {
+            unique_lock guard(m_guard);
+            return acquire(waiter);
+        }
+    private:
+        // BlockingWaiter
+        struct BlockingWaiter {
+            AsyncWaiter node;
+            std::atomic_bool granted = false;
+        };
+
+        // acquire (requires the guard, waiters queue up behind earlier ones even if the lock is free for them)
+        bool acquire(AsyncWaiter& waiter) {
+            if (!m_head && !m_writer && (!waiter.exclusive || m_readers == 0)) {
+                if (waiter.exclusive) {
+                    m_writer = true;
+                }
+                else {
+                    ++m_readers;
+                }
+                return true;
+            }
+            waiter.next = nullptr;
+            (m_tail ? m_tail->next : m_head) = &waiter;
+            m_tail = &waiter;
+            return false;
+        }
+        // wait (blocks the calling thread until the lock is handed over)
+        void wait(bool exclusive) {
+            BlockingWaiter waiter;
+            waiter.node.exclusive = exclusive;
+            waiter.node.blocking = true;
+            waiter.node.grant = [](AsyncWaiter* node) {
+                auto* self = reinterpret_cast<BlockingWaiter*>(node);
+                self->granted.store(true, std::memory_order_release);
+                self->granted.notify_one();
+            };
+            {
+                unique_lock guard(m_guard);
+                if (acquire(waiter.node)) {
+                    return;
+                }
+            }
+            waiter.granted.wait(false, std::memory_order_acquire);
+            // the grant ran under the guard, once we get it the notify is done and the waiter may go away
+            unique_lock guard(m_guard);
+        }
+        // release (hands the lock to the waiters at the front: one writer or a run of readers)
+        void release(bool exclusive) {
+            AsyncWaiter* granted = nullptr;
+            {
+                unique_lock guard(m_guard);
+                if (exclusive) {
+                    m_writer = false;
+                }
+                else {
+                    --m_readers;
+                }
+                while (m_head && !m_writer && (!m_head->exclusive || m_readers == 0)) {
+                    AsyncWaiter* waiter = m_head;
+                    m_head = waiter->next;
+                    if (!m_head) {
+                        m_tail = nullptr;
+                    }
+                    if (waiter->exclusive) {
+                        m_writer = true;
+                    }
+                    else {
+                        ++m_readers;
+                    }
+                    if (waiter->blocking) {
+                        waiter->grant(waiter);
+                    }
+                    else {
+                        waiter->next = granted;
+                        granted = waiter;
+                    }
+                }
+            }
+            // coroutine waiters may resume inline and lock this mutex again
+            while (granted) {
+                AsyncWaiter* next = granted->next;
+                granted->grant(granted);
+                granted = next;
+            }
+        }
+
+        // member
+        mutex m_guard;
+        uint32 m_readers = 0;
+        bool m_writer = false;
+        AsyncWaiter* m_head = nullptr;
+        AsyncWaiter* m_tail = nullptr;
+    };
+}
+
+// #include "value.hpp" (HPPMERGE)
+namespace Memory {
+    // SecureValue
+    template<typename T, typename TMutex = shared_mutex>
+    class SecureValue {
+    public:
+        // constructor
+        template<typename... Args>
+        SecureValue(Args&&... args)
+            : m_value(forward<Args>(args)...) {}
+        // destructor
+        ~SecureValue() {
+            LockOrder::forget(&m_mutex);
+        }
+
+        // name (how the entry appears in lock order reports)
+        template<typename K>
+        void name(const K& key, const std::type_info& type) const {
+            LockOrder::name(&m_mutex, key, type);
+        }
+        // read / write lock
+        ReadLocked<T, TMutex> readLock() const {
+            LockOrder::acquire(&m_mutex);
+            return { &m_value, m_mutex };
+        }
+        WriteLocked<T, TMutex> writeLock() {
+            LockOrder::acquire(&m_mutex);
+            return { &m_value, m_mutex };
+        }
+        // read / write lock (counted)
+        ReadLocked<T, TMutex> readLock(LockCounter& counter) const {
+            shared_lock lock(m_mutex, std::defer_lock);
+            LockOrder::acquire(&m_mutex);
+            counter.acquire(lock);
+            return { &m_value, move(lock) };
+        }
+        WriteLocked<T, TMutex> writeLock(LockCounter& counter) {
+            unique_lock lock(m_mutex, std::defer_lock);
+            LockOrder::acquire(&m_mutex);
+            counter.acquire(lock);
+            return { &m_value, move(lock) };
+        }
+        // upgrade lock (counted, requires a mutex with an upgrade mode, see UpgradeLock)
+        UpgradeLocked<T, TMutex> upgradeLock(LockCounter& counter) const requires requires(TMutex& mutex) { mutex.lock_upgrade(); } {
+            UpgradeLock<TMutex> lock(m_mutex, std::defer_lock);
+            LockOrder::acquire(&m_mutex);
+            counter.acquire(lock);
+            return { &m_value, move(lock) };
+        }
+        // try read / write lock (empty while the mutex is busy)
+        ReadLocked<T, TMutex> tryReadLock() const {
+            return readLockUntil(std::chrono::steady_clock::time_point());
+        }
+        WriteLocked<T, TMutex> tryWriteLock() {
+            return writeLockUntil(std::chrono::steady_clock::time_point());
+        }
+        // read / write lock for (empty if the mutex stayed busy until the deadline)
+        template<typename Rep, typename Period>
+        ReadLocked<T, TMutex> readLockFor(const std::chrono::duration<Rep, Period>& timeout) const {
+            return readLockUntil(std::chrono::steady_clock::now() + timeout);
+        }
+        template<typename Rep, typename Period>
+        WriteLocked<T, TMutex> writeLockFor(const std::chrono::duration<Rep, Period>& timeout) {
+            return writeLockUntil(std::chrono::steady_clock::now() + timeout);
+        }
+        ReadLocked<T, TMutex> readLockUntil(std::chrono::steady_clock::time_point deadline) const {
+            shared_lock lock(m_mutex, std::defer_lock);
+            if (!tryLockUntil(lock, deadline)) {
+                return {};
+            }
+            LockOrder::acquired(&m_mutex);
+            return { &m_value, move(lock) };
+        }
+        WriteLocked<T, TMutex> writeLockUntil(std::chrono::steady_clock::time_point deadline) {
+            unique_lock lock(m_mutex, std::defer_lock);
+            if (!tryLockUntil(lock, deadline)) {
+                return {};
+            }
+            LockOrder::acquired(&m_mutex);
+            return { &m_value, move(lock) };
+        }
+        // read / write lock until (counted)
+        ReadLocked<T, TMutex> readLockUntil(std::chrono::steady_clock::time_point deadline, LockCounter& counter) const {
+            shared_lock lock(m_mutex, std::defer_lock);
+            if (!counter.acquireUntil(lock, deadline)) {
+                return {};
+            }
+            LockOrder::acquired(&m_mutex);
+            return { &m_value, move(lock) };
+        }
+        WriteLocked<T, TMutex> writeLockUntil(std::chrono::steady_clock::time_point deadline, LockCounter& counter) {
+            unique_lock lock(m_mutex, std::defer_lock);
+            if (!counter.acquireUntil(lock, deadline)) {
+                return {};
+            }
+            LockOrder::acquired(&m_mutex);
+            return { &m_value, move(lock) };
+        }
+        // read / write lock (deferred, the caller acquires the returned lock, see LockSet)
+        std::pair<const T*, shared_lock<TMutex>> readLock(std::defer_lock_t) const {
+            return { &m_value, shared_lock(m_mutex, std::defer_lock) };
+        }
+        std::pair<T*, unique_lock<TMutex>> writeLock(std::defer_lock_t) {
+            return { &m_value, unique_lock(m_mutex, std::defer_lock) };
+        }
+        // lock async (queues waiter unless the mutex is free right away, see AsyncMutex)
+        bool lockAsync(AsyncWaiter& waiter) const requires requires(TMutex& mutex) { mutex.lockAsync(waiter); } {
+            return m_mutex.lockAsync(waiter);
+        }
+        // read / write lock (adopts a lock that was granted through lockAsync,
+        // not tracked by LockOrder since the coroutine may resume on another thread)
+        ReadLocked<T, TMutex> readLock(std::adopt_lock_t) const {
+            return { &m_value, shared_lock(m_mutex, std::adopt_lock) };
+        }
+        WriteLocked<T, TMutex> writeLock(std::adopt_lock_t) {
+            return { &m_value, unique_lock(m_mutex, std::adopt_lock) };
+        }
+        // readCopy (optimistic, without taking the mutex, see SeqMutex)
+        T readCopy() const requires requires(const TMutex& mutex) { mutex.version(); } {
+            return readOptimistic(m_value, m_mutex);
+        }
+        // pending (read without the mutex: set while the holder of the write lock constructs a new value,
+        // so others can treat the entry as missing instead of waiting for the constructor, see SecureMap::insert)
+        bool isPending() const requires requires(const T& value) { value.isPending(); } {
+            return m_value.isPending();
+        }
+        void setPending(bool pending) requires requires(T& value) { value.setPending(pending); } {
+            m_value.setPending(pending);
+        }
+    private:
+        // value
+        T m_value;
+        mutable TMutex m_mutex;
+    };
+
+    // the pending bit shares the state byte of Storage, a CompactPolicy entry keeps its 12 bytes
+    static_assert(sizeof(SecureValue<Storage<int>, CompactMutex>) == 12);
+}
+
+// #include "key.hpp" (HPPMERGE)
+namespace Memory {
+    // KeyLookup
+    // parameter type of the lookups of a key type, string keys are looked up through a string_view,
+    // so callers holding a view or a literal do not construct a string per lookup
+    // (specialize together with KeyHash for other keys that have a cheap borrowed form)
+    template<typename K>
+    struct KeyLookup {
+        using Type = const K&;
+    };
+    template<>
+    struct KeyLookup<string> {
+        using Type = string_view;
+    };
+    template<typename K>
+    using LookupKey = typename KeyLookup<K>::Type;
+
+    // KeyHash (hashes a key and its lookup form alike)
+    template<typename K>
+    struct KeyHash {
+        address operator()(const K& key) const {
+            return std::hash<K>{}(key);
+        }
+    };
+    template<>
+    struct KeyHash<string> {
+        using is_transparent = void;
+        // std::hash of a string equals the one of its string_view
+        address operator()(string_view key) const {
+            return std::hash<string_view>{}(key);
+        }
+    };
+}
+
+// #include "flatmap.hpp" (HPPMERGE)
+namespace Memory {
+    // FlatHashMap
+    // open-addressing hash map (linear probing, backward-shift deletion)
+    // the probe table only stores 8 byte slots (entry index + hash fragment),
+    // entries live in a deque and never move, so references and iterators stay valid on rehash,
+    // an iterator keeps a pointer to its entry, dereferencing it does not read the deque that grows on insert,
+    // a transparent THash (e.g. KeyHash<string>) also allows lookups by other key types such as string_view
+    template<typename K, typename T, template<typename> typename TAllocator = std::allocator, typename THash = KeyHash<K>>
+    class FlatHashMap {
+    public:
+        // types
+        using key_type = K;
+        using mapped_type = T;
+        using value_type = std::pair<const K, T>;
+        template<typename Q>
+        static constexpr bool IsLookup = std::is_same_v<Q, K> || requires { typename THash::is_transparent; };
+
+        // Iterator
+        template<bool IsConst>
+        class Iterator {
+        public:
+            // types
+            using Owner = std::conditional_t<IsConst, const FlatHashMap, FlatHashMap>;
+            using value_type = std::pair<const K, T>;
+            using Value = std::conditional_t<IsConst, const value_type, value_type>;
+            using iterator_category = std::forward_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using pointer = Value*;
+            using reference = Value&;
+
+            // constructor
+            Iterator() = default;
+            Iterator(Owner* map, address index)
+                : m_map(map), m_index(index) {
+                skip();
+            }
+            template<bool OtherConst> requires(IsConst && !OtherConst)
+            Iterator(const Iterator<OtherConst>& other)
+                : m_map(other.m_map), m_index(other.m_index), m_value(other.m_value) {}
+
+            // access
+            Value& operator*() const {
+                return *m_value;
+            }
+            Value* operator->() const {
+                return m_value;
+            }
+            // increment
+            Iterator& operator++() {
+                ++m_index;
+                skip();
+                return *this;
+            }
+            // compare
+            bool operator==(const Iterator& other) const {
+                return m_index == other.m_index;
+            }
+            // index
+            address index() const {
+                return m_index;
+            }
+
+            // friend
+            template<bool OtherConst>
+            friend class Iterator;
+        private:
+            // skip (empty entries)
+            void skip() {
+                while (m_index < m_map->m_entries.size() && !m_map->m_entries[m_index]) {
+                    ++m_index;
+                }
+                m_value = m_index < m_map->m_entries.size() ? &*m_map->m_entries[m_index] : nullptr;
+            }
+
+            // member
+            Owner* m_map = nullptr;
+            address m_index = 0;
+            Value* m_value = nullptr;
+        };
+        using iterator = Iterator<false>;
+        using const_iterator = Iterator<true>;
+
+        // constructor / destructor
+        FlatHashMap() = default;
+        explicit FlatHashMap(const TAllocator<value_type>& allocator)
+            : m_entries(allocator), m_free(allocator), m_slots(allocator) {}
+        ~FlatHashMap() = default;
+        // copy
+        FlatHashMap(const FlatHashMap&) = delete;
+        // copy assign
+        FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+        // size
+        address size() const {
+            return m_size;
+        }
+        bool empty() const {
+            return m_size == 0;
+        }
+
+        // find
+        iterator find(const K& key) {
+            return find<K>(key);
+        }
+        const_iterator find(const K& key) const {
+            return find<K>(key);
+        }
+        template<typename Q> requires(IsLookup<Q>)
+        iterator find(const Q& key) {
+            address slot = findSlot(key);
+            return slot == npos ? end() : iterator(this, m_slots[slot].entry - 1);
+        }
+        template<typename Q> requires(IsLookup<Q>)
+        const_iterator find(const Q& key) const {
+            address slot = findSlot(key);
+            return slot == npos ? end() : const_iterator(this, m_slots[slot].entry - 1);
+        }
+        // contains
+        bool contains(const K& key) const {
+            return contains<K>(key);
+        }
+        template<typename Q> requires(IsLookup<Q>)
+        bool contains(const Q& key) const {
+            return findSlot(key) != npos;
+        }
+        // at
+        T& at(const K& key) {
+            return at<K>(key);
+        }
+        const T& at(const K& key) const {
+            return at<K>(key);
+        }
+        template<typename Q> requires(IsLookup<Q>)
+        T& at(const Q& key) {
+            address slot = findSlot(key);
+            if (slot == npos) {
+                throw std::out_of_range("FlatHashMap::at");
+            }
+            return m_entries[m_slots[slot].entry - 1]->second;
+        }
+        template<typename Q> requires(IsLookup<Q>)
+        const T& at(const Q& key) const {
+            address slot = findSlot(key);
+            if (slot == npos) {
+                throw std::out_of_range("FlatHashMap::at");
+            }
+            return m_entries[m_slots[slot].entry - 1]->second;
+        }
+        // operator[]
+        T& operator[](const K& key) {
+            return try_emplace(key).first->second;
+        }
+
+        // try_emplace
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+            uint32 hash = hashOf(key);
+            address slot = findSlot(key, hash);
+            if (slot != npos) {
+                return { iterator(this, m_slots[slot].entry - 1), false };
+            }
+            if (m_free.empty() && m_entries.size() == MaxEntries) {
+                throw std::length_error("FlatHashMap: too many entries");
+            }
+            if ((m_size + 1) * 4 > m_slots.size() * 3) {
+                rehash(m_slots.empty() ? 16 : m_slots.size() * 2);
+            }
+            // entry
+            address index;
+            if (m_free.empty()) {
+                index = m_entries.size();
+                m_entries.emplace_back();
+            }
+            else {
+                index = m_free.back();
+                m_free.pop_back();
+            }
+            m_entries[index].emplace(
+                std::piecewise_construct,
+                std::forward_as_tuple(key),
+                std::forward_as_tuple(forward<Args>(args)...)
+            );
+            // slot
+            insertSlot({ static_cast<uint32>(index + 1), hash });
+            ++m_size;
+            return { iterator(this, index), true };
+        }
+
+        // erase
+        address erase(const K& key) {
+            return erase<K>(key);
+        }
+        template<typename Q> requires(IsLookup<Q>)
+        address erase(const Q& key) {
+            address slot = findSlot(key);
+            if (slot == npos) {
+                return 0;
+            }
+            eraseSlot(slot);
+            return 1;
+        }
+        iterator erase(iterator it) {
+            address index = it.index();
+            eraseSlot(findSlot(m_entries[index]->first));
+            return iterator(this, index + 1);
+        }
+        // clear
+        void clear() {
+            m_entries.clear();
+            m_free.clear();
+            m_slots.clear();
+            m_size = 0;
+        }
+        // reserve
+        void reserve(address count) {
+            address capacity = m_slots.empty() ? 16 : m_slots.size();
+            while (count * 4 > capacity * 3) {
+                capacity *= 2;
+            }
+            if (capacity != m_slots.size()) {
+                rehash(capacity);
+            }
+        }
+
+        // iterate
+        // :: begin
+        iterator begin() {
+            return iterator(this, 0);
+        }
+        const_iterator begin() const {
+            return const_iterator(this, 0);
+        }
+        // :: end
+        iterator end() {
+            return iterator(this, m_entries.size());
+        }
+        const_iterator end() const {
+            return const_iterator(this, m_entries.size());
+        }
+        // :: seek (first entry at or after the given position)
+        iterator seek(address index) {
+            return iterator(this, std::min(index, m_entries.size()));
+        }
+        const_iterator seek(address index) const {
+            return const_iterator(this, std::min(index, m_entries.size()));
+        }
+    private:
+        // Slot (entry is index + 1, 0 marks an empty slot)
+        struct Slot {
+            uint32 entry = 0;
+            uint32 hash = 0;
+        };
+        static constexpr address npos = ~address(0);
+        // entry indices are stored + 1 in 32 bits
+        static constexpr address MaxEntries = ~uint32(0);
+
+        // hashOf
+        template<typename Q>
+        static uint32 hashOf(const Q& key) {
+            uint64 hash = static_cast<uint64>(THash{}(key));
+            return static_cast<uint32>((hash * 0x9E3779B97F4A7C15ull) >> 32);
+        }
+        // findSlot
+        template<typename Q>
+        address findSlot(const Q& key) const {
+            return findSlot(key, hashOf(key));
+        }
+        template<typename Q>
+        address findSlot(const Q& key, uint32 hash) const {
+            if (m_slots.empty()) {
+                return npos;
+            }
+            address mask = m_slots.size() - 1;
+            for (address slot = hash & mask;; slot = (slot + 1) & mask) {
+                const Slot& current = m_slots[slot];
+                if (current.entry == 0) {
+                    return npos;
+                }
+                if (current.hash == hash && m_entries[current.entry - 1]->first == key) {
+                    return slot;
+                }
+            }
+        }
+        // insertSlot
+        void insertSlot(Slot slot) {
+            address mask = m_slots.size() - 1;
+            address index = slot.hash & mask;
+            while (m_slots[index].entry != 0) {
+                index = (index + 1) & mask;
+            }
+            m_slots[index] = slot;
+        }
+        // eraseSlot (backward-shift, keeps probe sequences tombstone free)
+        void eraseSlot(address slot) {
+            address index = m_slots[slot].entry - 1;
+            m_entries[index].reset();
+            m_free.push_back(index);
+            --m_size;
+            address mask = m_slots.size() - 1;
+            address next = slot;
+            while (true) {
+                next = (next + 1) & mask;
+                if (m_slots[next].entry == 0) {
+                    break;
+                }
+                address home = m_slots[next].hash & mask;
+                bool movable = slot <= next ? (home <= slot || home > next) : (home <= slot && home > next);
+                if (movable) {
+                    m_slots[slot] = m_slots[next];
+                    slot = next;
+                }
+            }
+            m_slots[slot] = {};
+        }
+        // rehash
+        void rehash(address capacity) {
+            m_slots.assign(capacity, {});
+            for (address index = 0; index < m_entries.size(); ++index) {
+                if (m_entries[index]) {
+                    insertSlot({ static_cast<uint32>(index + 1), hashOf(m_entries[index]->first) });
+                }
+            }
+        }
+
+        // entries
+        std::deque<Opt<value_type>, TAllocator<Opt<value_type>>> m_entries;
+        std::vector<address, TAllocator<address>> m_free;
+        // slots
+        std::vector<Slot, TAllocator<Slot>> m_slots;
+        address m_size = 0;
+    };
+}
+
+// #include "policy.hpp" (HPPMERGE)
+namespace Memory {
+    // NoResource (policies without a node pool)
+    struct NoResource {};
+
+    // MapPolicy (ordered std::map, required for ordered iteration)
+    // the comparator is transparent, so keys are found through their lookup form (see KeyLookup)
+    struct MapPolicy {
+        template<typename K, typename T>
+        using Container = std::map<K, T, std::less<>>;
+        using Mutex = shared_mutex;
+        using Resource = NoResource;
+    };
+    // HashPolicy (open-addressing FlatHashMap, for point-lookup heavy workloads)
+    struct HashPolicy {
+        template<typename K, typename T>
+        using Container = FlatHashMap<K, T>;
+        using Mutex = shared_mutex;
+        using Resource = NoResource;
+    };
+    // SeqPolicy (ordered, entries carry a version for optimistic readCopy of small values)
+    struct SeqPolicy : MapPolicy {
+        using Mutex = SeqMutex<>;
+    };
+    // CompactPolicy (ordered, 4 byte entry locks instead of std::shared_mutex)
+    struct CompactPolicy : MapPolicy {
+        using Mutex = CompactMutex;
+    };
+    // UpgradePolicy (ordered, entry locks have an upgrade mode, see SecureMap::upgradeLock, CompactPolicy has one too)
+    struct UpgradePolicy : MapPolicy {
+        using Mutex = UpgradeMutex<>;
+    };
+    // AsyncPolicy (ordered, entry locks can be awaited by coroutines, see SecureMap::writeLockAsync)
+    struct AsyncPolicy : MapPolicy {
+        using Mutex = AsyncMutex;
+    };
+    // PoolPolicy / PoolHashPolicy (nodes come from a per-map pool, released in bulk on clear)
+    // the pool is unsynchronized, nodes are only (de)allocated under the exclusive map lock
+    struct PoolPolicy : MapPolicy {
+        template<typename K, typename T>
+        using Container = std::pmr::map<K, T, std::less<>>;
+        using Resource = std::pmr::unsynchronized_pool_resource;
+    };
+    struct PoolHashPolicy : HashPolicy {
+        template<typename K, typename T>
+        using Container = FlatHashMap<K, T, std::pmr::polymorphic_allocator>;
+        using Resource = std::pmr::unsynchronized_pool_resource;
+    };
+}
+
+// #include "pool.hpp" (HPPMERGE)
+namespace Memory {
+    // ThreadPool
+    // work-stealing pool: every worker pops its own deque from the back
+    // and steals from the front of the other deques when it runs dry
+    class ThreadPool {
+    public:
+        // constructor / destructor
+        ThreadPool(address threadCount = std::max(1u, thread::hardware_concurrency())) {
+            for (address i = 0; i < threadCount; ++i) {
+                m_workers.emplace_back(make_unique<Worker>());
+            }
+            for (address i = 0; i < threadCount; ++i) {
+                m_threads.emplace_back([this, i]() { work(i); });
+            }
+        }
+        ~ThreadPool() {
+            {
+                unique_lock lock(m_sleepMutex);
+                m_stop = true;
+            }
+            m_sleep.notify_all();
+            for (auto& worker : m_threads) {
+                worker.join();
+            }
+        }
+        // copy
+        ThreadPool(const ThreadPool&) = delete;
+        // copy assign
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // submit
+        void submit(function<void()> task) {
+            address index = s_pool == this ? s_index : m_next++ % m_workers.size();
+            // counted before it is published, a worker that takes it right away must not decrement first (m_pending is unsigned)
+            ++m_pending;
+            {
+                unique_lock lock(m_workers[index]->queueMutex);
+                m_workers[index]->tasks.emplace_back(move(task));
+            }
+            {
+                unique_lock lock(m_sleepMutex);
+            }
+            m_sleep.notify_one();
+        }
+        // run (blocks until all tasks finished, the calling thread helps out meanwhile)
+        void run(List<function<void()>> tasks) {
+            atomic_address remaining = tasks.size();
+            mutex doneMutex;
+            condition_variable done;
+            for (auto& task : tasks) {
+                submit([&remaining, &doneMutex, &done, task = move(task)]() {
+                    task();
+                    unique_lock lock(doneMutex);
+                    if (--remaining == 0) {
+                        done.notify_all();
+                    }
+                });
+            }
+            function<void()> task;
+            while (remaining > 0 && acquire(s_pool == this ? s_index : 0, task)) {
+                task();
+                task = nullptr;
+            }
+            // nothing left to steal, the remaining tasks are being executed
+            unique_lock lock(doneMutex);
+            done.wait(lock, [&]() { return remaining == 0; });
+        }
+
+        // size
+        address size() const {
+            return m_workers.size();
+        }
+    private:
+        // Worker
+        struct alignas(64) Worker {
+            mutex queueMutex;
+            Deque<function<void()>> tasks;
+        };
+
+        // acquire (own queue first, then steal)
+        bool acquire(address index, function<void()>& task) {
+            for (address offset = 0; offset < m_workers.size(); ++offset) {
+                Worker& worker = *m_workers[(index + offset) % m_workers.size()];
+                unique_lock lock(worker.queueMutex);
+                if (!worker.tasks.empty()) {
+                    if (offset == 0) {
+                        task = move(worker.tasks.back());
+                        worker.tasks.pop_back();
+                    }
+                    else {
+                        task = move(worker.tasks.front());
+                        worker.tasks.pop_front();
+                    }
+                    --m_pending;
+                    return true;
+                }
+            }
+            return false;
+        }
+        // work
+        void work(address index) {
+            s_pool = this;
+            s_index = index;
+            while (true) {
+                function<void()> task;
+                if (acquire(index, task)) {
+                    task();
+                    continue;
+                }
+                unique_lock lock(m_sleepMutex);
+                m_sleep.wait(lock, [&]() { return m_stop || m_pending > 0; });
+                if (m_stop && m_pending == 0) {
+                    return;
+                }
+            }
+        }
+
+        // workers
+        List<unique_ptr<Worker>> m_workers;
+        List<thread> m_threads;
+        atomic_address m_next = 0;
+        atomic_address m_pending = 0;
+        // sleep
+        mutex m_sleepMutex;
+        condition_variable m_sleep;
+        bool m_stop = false;
+        // current worker
+        inline static thread_local ThreadPool* s_pool = nullptr;
+        inline static thread_local address s_index = 0;
+    };
+}
+
+// #include "lockset.hpp" (HPPMERGE)
+namespace Memory {
+    // LockSet
+    // entry locks of several keys (and value types) that are acquired in canonical order,
+    // i.e. by key and then by type, and released together when the set is destroyed
+    template<typename K, typename TLock>
+    class LockSet {
+    public:
+        // types
+        static constexpr bool IsShared = std::is_same_v<TLock, shared_lock<typename TLock::mutex_type>>;
+        template<typename V>
+        using Value = std::conditional_t<IsShared, const V, V>;
+        using Pointer = std::conditional_t<IsShared, const void*, void*>;
+
+        // constructor / destructor
+        LockSet() = default;
+        ~LockSet() {
+            release();
+        }
+        // copy
+        LockSet(const LockSet&) = delete;
+        // copy assign
+        LockSet& operator=(const LockSet&) = delete;
+        // move
+        LockSet(LockSet&&) = default;
+        // move assign
+        LockSet& operator=(LockSet&& other) {
+            release();
+            m_entries = move(other.m_entries);
+            return *this;
+        }
+
+        // find (nullptr if the key was missing or its value is destroyed)
+        template<typename V>
+        Value<V>* find(LookupKey<K> key) {
+            address type = typeid(V).hash_code();
+            auto it = std::lower_bound(m_entries.begin(), m_entries.end(), key, [type](const Entry& entry, LookupKey<K> key) {
+                return entry.key < key || (!(key < entry.key) && entry.type < type);
+            });
+            if (it == m_entries.end() || key < it->key || it->type != type) {
+                return nullptr;
+            }
+            auto storage = static_cast<Value<Storage<V>>*>(it->value);
+            return storage->isValid() ? &storage->get() : nullptr;
+        }
+        // at
+        template<typename V>
+        Value<V>& at(LookupKey<K> key) {
+            Value<V>* value = find<V>(key);
+            if (!value) {
+                throw std::out_of_range("LockSet::at");
+            }
+            return *value;
+        }
+        // size (number of held entry locks)
+        address size() const {
+            return m_entries.size();
+        }
+        // release
+        void release() {
+            for (auto& entry : m_entries) {
+                if (entry.observer && entry.lock) {
+                    entry.observer->onWrite(&entry.key);
+                }
+                if (entry.lock) {
+                    LockOrder::release(entry.lock.mutex());
+                }
+            }
+            m_entries.clear();
+        }
+
+        // add (unlocked entry, used by the maps while they hold their map lock, the observer is told on release)
+        void add(const K& key, address type, Pointer value, TLock&& lock, LockCounter& counter, IWriteObserver* observer = nullptr) {
+            m_entries.push_back({ key, type, value, move(lock), &counter, observer });
+        }
+        // acquire (sorts, drops duplicates and locks every entry in canonical order)
+        void acquire() {
+            std::sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) {
+                return a.key < b.key || (!(b.key < a.key) && a.type < b.type);
+            });
+            auto last = std::unique(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) {
+                return a.type == b.type && !(a.key < b.key) && !(b.key < a.key);
+            });
+            m_entries.erase(last, m_entries.end());
+            for (auto& entry : m_entries) {
+                LockOrder::acquire(entry.lock.mutex());
+                entry.counter->acquire(entry.lock);
+            }
+        }
+    private:
+        // Entry
+        struct Entry {
+            K key;
+            address type;
+            Pointer value;
+            TLock lock;
+            LockCounter* counter;
+            IWriteObserver* observer;
+        };
+
+        // member
+        List<Entry> m_entries;
+    };
+}
+
+// #include "cursor.hpp" (HPPMERGE)
+namespace Memory {
+    // Cursor
+    // resumable position of an ordered scan over the keys in [from, to), see SecureMap::advance
+    template<typename K>
+    class Cursor {
+    public:
+        // constructor
+        Cursor() = default;
+        Cursor(const K& from)
+            : m_next(from) {}
+        Cursor(const K& from, const K& to)
+            : m_next(from), m_to(to) {}
+
+        // done
+        bool done() const {
+            return m_done;
+        }
+
+        // friend
+        template<typename K2, typename V2, typename TPolicy2>
+        friend class SecureMap;
+    private:
+        // member
+        Opt<K> m_next;
+        Opt<K> m_to;
+        bool m_inclusive = true;
+        bool m_done = false;
+    };
+}
+
+// #include "snapshot.hpp" (HPPMERGE)
+namespace Memory {
+    // SnapshotReader (bounds checked view of a snapshot file)
+    class SnapshotReader {
+    public:
+        // constructor
+        SnapshotReader(const char* data, address size)
+            : m_pos(data), m_end(data + size) {}
+
+        // take (the next count bytes)
+        const char* take(address count) {
+            if (static_cast<address>(m_end - m_pos) < count) {
+                throw std::runtime_error("Snapshot: truncated file");
+            }
+            const char* pos = m_pos;
+            m_pos += count;
+            return pos;
+        }
+        // remaining (bytes not taken yet)
+        address remaining() const {
+            return static_cast<address>(m_end - m_pos);
+        }
+        // read (trivially copyable, the file gives no alignment guarantee)
+        template<typename T>
+        T read() {
+            T value;
+            std::memcpy(&value, take(sizeof(T)), sizeof(T));
+            return value;
+        }
+    private:
+        // member
+        const char* m_pos;
+        const char* m_end;
+    };
+
+    // Serializer
+    // specialize for own key / value types: write appends to the buffer, read returns the next value,
+    // an optional static tag() names the encoding in the snapshot header (the type name otherwise, see SnapshotHeader)
+    template<typename T>
+    struct Serializer;
+    // :: trivially copyable (raw bytes)
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    struct Serializer<T> {
+        static void write(const T& value, List<char>& out) {
+            const char* bytes = reinterpret_cast<const char*>(&value);
+            out.insert(out.end(), bytes, bytes + sizeof(T));
+        }
+        static T read(SnapshotReader& in) {
+            return in.read<T>();
+        }
+    };
+    // :: string (length prefixed)
+    template<>
+    struct Serializer<string> {
+        static string tag() {
+            return "string";
+        }
+        static void write(const string& value, List<char>& out) {
+            Serializer<uint64>::write(value.size(), out);
+            out.insert(out.end(), value.begin(), value.end());
+        }
+        static string read(SnapshotReader& in) {
+            address size = in.read<uint64>();
+            return string(in.take(size), size);
+        }
+    };
+    // Serializable
+    template<typename T>
+    concept Serializable = requires(const T& value, List<char>& out, SnapshotReader& in) {
+        Serializer<T>::write(value, out);
+        { Serializer<T>::read(in) } -> std::convertible_to<T>;
+    };
+
+    // SnapshotHeader
+    // layout is the record size for trivially copyable keys and values (0 otherwise), fingerprint hashes the serializer tags
+    // of both types (for every layout), so a snapshot is not silently read back with different types
+    struct SnapshotHeader {
+        Array<char, 4> magic = { 'S', 'M', 'A', 'P' };
+        uint32 version = 2;
+        uint64 layout = 0;
+        uint64 fingerprint = 0;
+        uint64 count = 0;
+
+        // layoutOf
+        template<typename K, typename V>
+        static constexpr uint64 layoutOf() {
+            if constexpr (std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>) {
+                return (uint64(sizeof(K)) << 32) | sizeof(V);
+            }
+            else {
+                return 0;
+            }
+        }
+        // fingerprintOf (FNV-1a of both tags)
+        template<typename K, typename V>
+        static uint64 fingerprintOf() {
+            uint64 hash = 0xCBF29CE484222325ull;
+            for (const string& tag : { tagOf<K>(), tagOf<V>() }) {
+                for (char c : tag) {
+                    hash = (hash ^ static_cast<uint8>(c)) * 0x100000001B3ull;
+                }
+                hash = (hash ^ 0xFF) * 0x100000001B3ull;
+            }
+            return hash;
+        }
+        // tagOf
+        template<typename T>
+        static string tagOf() {
+            if constexpr (requires { { Serializer<T>::tag() } -> std::convertible_to<string>; }) {
+                return Serializer<T>::tag();
+            }
+            else {
+                return typeid(T).name();
+            }
+        }
+    };
+
+    // SnapshotWriter
+    // streams records into a temporary file that replaces path on commit, the header (with the final count) is written last,
+    // the file is synced before the rename and the directory after it, so a crash leaves either the old or the complete new snapshot
+    // (only flushed where fsync is not available), an uncommitted writer removes the temporary file
+    template<typename K, typename V>
+    class SnapshotWriter {
+    public:
+        // constructor / destructor
+        SnapshotWriter(const string& path)
+            : m_path(path), m_temporary(path + ".tmp") {
+#if defined(__unix__) || defined(__APPLE__)
+            m_handle = ::open(m_temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (m_handle < 0) {
+                throw std::runtime_error("Snapshot: can not write " + m_temporary);
+            }
+#else
+            m_file.open(m_temporary, std::ios::binary | std::ios::trunc);
+            if (!m_file) {
+                throw std::runtime_error("Snapshot: can not write " + m_temporary);
+            }
+#endif
+            // placeholder, the count is only known on commit
+            SnapshotHeader header;
+            put(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+        ~SnapshotWriter() {
+            if (!m_committed) {
+                close();
+                std::remove(m_temporary.c_str());
+            }
+        }
+        // copy
+        SnapshotWriter(const SnapshotWriter&) = delete;
+        // copy assign
+        SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+        // write (appends count serialized records)
+        void write(const List<char>& records, uint64 count) {
+            put(records.data(), records.size());
+            m_count += count;
+        }
+        // commit
+        void commit() {
+            SnapshotHeader header;
+            header.layout = SnapshotHeader::layoutOf<K, V>();
+            header.fingerprint = SnapshotHeader::fingerprintOf<K, V>();
+            header.count = m_count;
+#if defined(__unix__) || defined(__APPLE__)
+            bool written = ::pwrite(m_handle, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) && ::fsync(m_handle) == 0;
+#else
+            m_file.seekp(0);
+            m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            bool written = static_cast<bool>(m_file.flush());
+#endif
+            written = close() && written;
+            if (!written) {
+                throw std::runtime_error("Snapshot: can not write " + m_temporary);
+            }
+            if (std::rename(m_temporary.c_str(), m_path.c_str()) != 0) {
+                throw std::runtime_error("Snapshot: can not replace " + m_path);
+            }
+            m_committed = true;
+#if defined(__unix__) || defined(__APPLE__)
+            address separator = m_path.rfind('/');
+            string directory = separator == string::npos ? string(".") : m_path.substr(0, std::max<address>(separator, 1));
+            int handle = ::open(directory.c_str(), O_RDONLY);
+            if (handle >= 0) {
+                ::fsync(handle);
+                ::close(handle);
+            }
+#endif
+        }
+    private:
+        // put
+        void put(const char* data, address size) {
+#if defined(__unix__) || defined(__APPLE__)
+            while (size > 0) {
+                ssize_t written = ::write(m_handle, data, size);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::runtime_error("Snapshot: can not write " + m_temporary);
+                }
+                data += written;
+                size -= static_cast<address>(written);
+            }
+#else
+            if (!m_file.write(data, size)) {
+                throw std::runtime_error("Snapshot: can not write " + m_temporary);
+            }
+#endif
+        }
+        // close (returns false if pending data could not be written)
+        bool close() {
+#if defined(__unix__) || defined(__APPLE__)
+            if (m_handle < 0) {
+                return true;
+            }
+            bool closed = ::close(m_handle) == 0;
+            m_handle = -1;
+            return closed;
+#else
+            if (!m_file.is_open()) {
+                return true;
+            }
+            m_file.close();
+            return !m_file.fail();
+#endif
+        }
+
+        // member
+        string m_path;
+        string m_temporary;
+        uint64 m_count = 0;
+        bool m_committed = false;
+#if defined(__unix__) || defined(__APPLE__)
+        int m_handle = -1;
+#else
+        std::ofstream m_file;
+#endif
+    };
+
+    // MappedFile
+    // read-only memory mapping of a whole file (plain read where mmap is not available)
+    class MappedFile {
+    public:
+        // constructor / destructor
+        MappedFile(const string& path) {
+#if defined(__unix__) || defined(__APPLE__)
+            int handle = ::open(path.c_str(), O_RDONLY);
+            struct stat info;
+            if (handle < 0 || ::fstat(handle, &info) != 0) {
+                if (handle >= 0) {
+                    ::close(handle);
+                }
+                throw std::runtime_error("Snapshot: can not open " + path);
+            }
+            m_size = static_cast<address>(info.st_size);
+            if (m_size > 0) {
+                void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, handle, 0);
+                ::close(handle);
+                if (data == MAP_FAILED) {
+                    throw std::runtime_error("Snapshot: can not map " + path);
+                }
+                ::madvise(data, m_size, MADV_SEQUENTIAL);
+                m_data = static_cast<const char*>(data);
+            }
+            else {
+                ::close(handle);
+            }
+#else
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if (!file) {
+                throw std::runtime_error("Snapshot: can not open " + path);
+            }
+            m_buffer.resize(static_cast<address>(file.tellg()));
+            file.seekg(0);
+            file.read(m_buffer.data(), m_buffer.size());
+            m_data = m_buffer.data();
+            m_size = m_buffer.size();
+#endif
+        }
+        ~MappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+            if (m_data) {
+                ::munmap(const_cast<char*>(m_data), m_size);
+            }
+#endif
+        }
+        // copy
+        MappedFile(const MappedFile&) = delete;
+        // copy assign
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // data / size
+        const char* data() const {
+            return m_data;
+        }
+        address size() const {
+            return m_size;
+        }
+    private:
+        // member
+        const char* m_data = nullptr;
+        address m_size = 0;
+#if !defined(__unix__) && !defined(__APPLE__)
+        List<char> m_buffer;
+#endif
+    };
+
+    // SnapshotRecords
+    // the records of a mapped snapshot as an input range, each record is decoded when it is reached (no copy of the whole file),
+    // the header is checked when it is opened (and the size for fixed layouts), the records while they are decoded,
+    // so a snapshot with variable sized records that is cut short or has bytes left over throws on the first bad record
+    template<typename K, typename V>
+    class SnapshotRecords {
+    public:
+        // Iterator (moves the current record out)
+        class Iterator {
+        public:
+            // types
+            using value_type = std::pair<K, V>;
+            using difference_type = std::ptrdiff_t;
+
+            // constructor
+            Iterator() = default;
+            Iterator(SnapshotRecords* records)
+                : m_records(records) {}
+
+            // access
+            value_type&& operator*() const {
+                return move(*m_records->m_current);
+            }
+            // increment
+            Iterator& operator++() {
+                m_records->next();
+                return *this;
+            }
+            void operator++(int) {
+                ++*this;
+            }
+            // compare
+            bool operator==(std::default_sentinel_t) const {
+                return !m_records->m_current;
+            }
+        private:
+            // member
+            SnapshotRecords* m_records = nullptr;
+        };
+
+        // constructor
+        SnapshotRecords(const string& path)
+            : m_file(path), m_in(m_file.data(), m_file.size()) {
+            SnapshotHeader expected;
+            SnapshotHeader header = m_in.read<SnapshotHeader>();
+            if (header.magic != expected.magic || header.version != expected.version) {
+                throw std::runtime_error("Snapshot: " + path + " is no snapshot");
+            }
+            if (header.layout != SnapshotHeader::layoutOf<K, V>() || header.fingerprint != SnapshotHeader::fingerprintOf<K, V>()) {
+                throw std::runtime_error("Snapshot: " + path + " was saved with other types");
+            }
+            if constexpr (SnapshotHeader::layoutOf<K, V>() != 0) {
+                constexpr address record = sizeof(K) + sizeof(V);
+                if (m_in.remaining() % record != 0 || m_in.remaining() / record != header.count) {
+                    throw std::runtime_error("Snapshot: truncated file");
+                }
+            }
+            m_count = header.count;
+        }
+        // copy
+        SnapshotRecords(const SnapshotRecords&) = delete;
+        // copy assign
+        SnapshotRecords& operator=(const SnapshotRecords&) = delete;
+
+        // iterate (once)
+        Iterator begin() {
+            next();
+            return Iterator(this);
+        }
+        std::default_sentinel_t end() const {
+            return {};
+        }
+        // size
+        address size() const {
+            return m_count;
+        }
+    private:
+        // next
+        void next() {
+            if (m_read == m_count) {
+                if (m_in.remaining() != 0) {
+                    throw std::runtime_error("Snapshot: corrupt file");
+                }
+                m_current.reset();
+                return;
+            }
+            ++m_read;
+            K key = Serializer<K>::read(m_in);
+            m_current.emplace(move(key), Serializer<V>::read(m_in));
+        }
+
+        // member
+        MappedFile m_file;
+        SnapshotReader m_in;
+        address m_count = 0;
+        address m_read = 0;
+        Opt<std::pair<K, V>> m_current;
+    };
+}
+
+// #include "changelog.hpp" (HPPMERGE)
+namespace Memory {
+    // ChangeKind
+    enum class ChangeKind : uint8 {
+        Insert, Erase, Destroy, Write
+    };
+    // Change
+    template<typename K>
+    struct Change {
+        uint64 sequence = 0;
+        ChangeKind kind = ChangeKind::Insert;
+        K key = K();
+    };
+
+    // ChangeLog
+    // bounded ring of the latest changes of a map, writers claim a sequence number and never wait for subscribers,
+    // every subscriber reads at its own position and learns when it fell behind by more than the capacity,
+    // slots are stamped with the sequence they hold: a writer claims its slot with a compare exchange and never
+    // replaces a newer sequence (it only waits for a writer one lap older that is still copying into the same slot),
+    // trivially copyable keys are stored as atomic words and validated by the stamp, other keys are copied under a slot mutex
+    template<typename K>
+    class ChangeLog : public IWriteObserver {
+    public:
+        // Subscriber (read position in the log)
+        class Subscriber {
+        public:
+            // sequence (of the next change to read)
+            uint64 sequence() const {
+                return m_next;
+            }
+
+            // friend
+            friend class ChangeLog;
+        private:
+            // constructor
+            Subscriber(uint64 next)
+                : m_next(next) {}
+
+            // member
+            uint64 m_next;
+        };
+
+        // constructor (capacity is rounded up to a power of two)
+        explicit ChangeLog(address capacity)
+            : m_slots(std::bit_ceil(std::max<address>(capacity, 2))), m_mask(m_slots.size() - 1) {
+            // slots start out written by the lap before the first one, so they read as not yet written
+            for (address i = 0; i < m_slots.size(); ++i) {
+                m_slots[i].stamp.store(2 * i, std::memory_order_relaxed);
+            }
+        }
+        // copy
+        ChangeLog(const ChangeLog&) = delete;
+        // copy assign
+        ChangeLog& operator=(const ChangeLog&) = delete;
+
+        // record
+        void record(ChangeKind kind, const K& key) {
+            uint64 sequence = m_head.fetch_add(1, std::memory_order_relaxed);
+            Slot& slot = m_slots[sequence & m_mask];
+            uint64 stamp = stampOf(sequence);
+            uint64 current = slot.stamp.load(std::memory_order_relaxed);
+            while (true) {
+                if (current >= stamp) {
+                    // a writer one lap ahead already took the slot, subscribers see this change as overwritten
+                    return;
+                }
+                if (current & 1) {
+                    std::this_thread::yield();
+                    current = slot.stamp.load(std::memory_order_relaxed);
+                    continue;
+                }
+                if (slot.stamp.compare_exchange_weak(current, stamp | 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            // the odd stamp must be visible before any payload write (see SeqMutex::begin)
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.kind.store(kind, std::memory_order_relaxed);
+            if constexpr (IsAtomicKey) {
+                Array<uint64, KeyWords> words = {};
+                std::memcpy(words.data(), &key, sizeof(K));
+                for (address i = 0; i < KeyWords; ++i) {
+                    slot.key[i].store(words[i], std::memory_order_relaxed);
+                }
+            }
+            else {
+                unique_lock lock(slot.mutex);
+                slot.key = key;
+            }
+            slot.stamp.store(stamp, std::memory_order_release);
+        }
+        // onWrite (see Locked::observe)
+        void onWrite(const void* key) override {
+            record(ChangeKind::Write, *static_cast<const K*>(key));
+        }
+
+        // subscribe (the subscriber sees the changes recorded from now on)
+        Subscriber subscribe() const {
+            return Subscriber(m_head.load(std::memory_order_acquire));
+        }
+        // poll
+        // appends up to count changes in sequence order, returns false if changes were overwritten before
+        // the subscriber read them (it then continues with the oldest change still held, a full scan resyncs)
+        bool poll(Subscriber& subscriber, List<Change<K>>& out, address count = ~address(0)) const {
+            bool complete = true;
+            uint64 head = m_head.load(std::memory_order_acquire);
+            if (head - subscriber.m_next > m_slots.size()) {
+                subscriber.m_next = head - m_slots.size();
+                complete = false;
+            }
+            for (address taken = 0; taken < count && subscriber.m_next < head;) {
+                Change<K> change;
+                change.sequence = subscriber.m_next;
+                int64 lap = read(m_slots[subscriber.m_next & m_mask], change);
+                if (lap < 0) {
+                    // claimed, but not written yet
+                    break;
+                }
+                if (lap > 0) {
+                    subscriber.m_next = std::max(subscriber.m_next + 1, m_head.load(std::memory_order_acquire) - m_slots.size());
+                    complete = false;
+                    continue;
+                }
+                out.emplace_back(move(change));
+                ++subscriber.m_next;
+                ++taken;
+            }
+            return complete;
+        }
+
+        // capacity
+        address capacity() const {
+            return m_slots.size();
+        }
+    private:
+        // types
+        static constexpr bool IsAtomicKey = std::is_trivially_copyable_v<K>;
+        static constexpr address KeyWords = (sizeof(K) + sizeof(uint64) - 1) / sizeof(uint64);
+        struct Unguarded {};
+
+        // Slot (stamp is 2 * (sequence + capacity) once written, odd while being written)
+        struct alignas(64) Slot {
+            atomic_uint64 stamp;
+            std::atomic<ChangeKind> kind;
+            std::conditional_t<IsAtomicKey, Array<atomic_uint64, KeyWords>, K> key;
+            [[no_unique_address]] mutable std::conditional_t<IsAtomicKey, Unguarded, CompactMutex> mutex;
+        };
+
+        // stampOf (sequences are shifted by one lap, so the initial stamps are older than every real one)
+        uint64 stampOf(uint64 sequence) const {
+            return 2 * (sequence + m_slots.size());
+        }
+        // read
+        // compares the slot with the sequence of change (0 and change filled, < 0 not written yet, > 0 overwritten),
+        // the copy only counts if the stamp did not move while it was taken
+        int64 read(const Slot& slot, Change<K>& change) const {
+            uint64 expected = stampOf(change.sequence);
+            while (true) {
+                uint64 before = slot.stamp.load(std::memory_order_acquire);
+                if ((before | 1) == (expected | 1)) {
+                    if (before & 1) {
+                        return -1;
+                    }
+                }
+                else {
+                    return before < expected ? -1 : 1;
+                }
+                change.kind = slot.kind.load(std::memory_order_relaxed);
+                if constexpr (IsAtomicKey) {
+                    Array<uint64, KeyWords> words;
+                    for (address i = 0; i < KeyWords; ++i) {
+                        words[i] = slot.key[i].load(std::memory_order_relaxed);
+                    }
+                    std::memcpy(static_cast<void*>(&change.key), words.data(), sizeof(K));
+                }
+                else {
+                    shared_lock lock(slot.mutex);
+                    change.key = slot.key;
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.stamp.load(std::memory_order_relaxed) == before) {
+                    return 0;
+                }
+            }
+        }
+
+        // member
+        List<Slot> m_slots;
+        address m_mask;
+        atomic_uint64 m_head = 0;
+    };
+}
+
+// #include "map.hpp" (HPPMERGE)
+namespace Memory {
+    // Interface for SecureMap
+    class ISecureMap {
+    public:
+        // constructor / destructor
+        ISecureMap() = default;
+        virtual ~ISecureMap() = default;
+
+        // stats
+        virtual MapStats stats() const = 0;
+    };
+
+    // EntryHandle (entry cached by a view, only valid while no entry of its stripe was freed since, see SecureMap::resolve)
+    template<typename K, typename TEntry>
+    struct EntryHandle {
+        TEntry* entry = nullptr;
+        const K* key = nullptr;
+        uint64 generation = 0;
+    };
+
+    // SecureMap
+    template<typename K, typename V, typename TPolicy = MapPolicy>
+    class SecureMap : public ISecureMap {
+    public:
+        // types
+        using Mutex = typename TPolicy::Mutex;
+        using Lookup = LookupKey<K>;
+        using Entry = SecureValue<Storage<V>, Mutex>;
+        using Container = typename TPolicy::template Container<K, Entry>;
+        using ReadHandle = EntryHandle<K, const Entry>;
+        using WriteHandle = EntryHandle<K, Entry>;
+        using Resource = typename TPolicy::Resource;
+        static constexpr bool IsPooled = !std::is_same_v<Resource, NoResource>;
+        static constexpr bool IsOrdered = requires(Container& map, const K& key) { map.lower_bound(key); };
+        static constexpr bool IsAsync = requires(Mutex& mutex, AsyncWaiter& waiter) { mutex.lockAsync(waiter); };
+        static constexpr bool IsUpgradeable = requires(Mutex& mutex) { mutex.lock_upgrade(); mutex.upgrade(); };
+
+        // LockAwaiter
+        // result of readLockAsync / writeLockAsync, co_await yields the locked value (empty if the key is missing or destroyed),
+        // the executor only needs submit(function<void()>), e.g. ThreadPool
+        template<bool IsShared, typename TExecutor>
+        class LockAwaiter : private AsyncWaiter {
+        public:
+            // types
+            using Owner = std::conditional_t<IsShared, const SecureMap, SecureMap>;
+            using EntryLocked = std::conditional_t<IsShared, ReadLocked<Storage<V>, Mutex>, WriteLocked<Storage<V>, Mutex>>;
+            using ValueLocked = std::conditional_t<IsShared, ReadLocked<V, Mutex>, WriteLocked<V, Mutex>>;
+
+            // constructor
+            // (the key is copied, the awaiter may outlive the caller's buffer)
+            LockAwaiter(Owner& map, Lookup key, TExecutor& executor)
+                : m_map(&map), m_key(key), m_executor(&executor) {
+                exclusive = !IsShared;
+                grant = &LockAwaiter::resume;
+            }
+            // copy (the awaiter is linked into the wait queue of the entry)
+            LockAwaiter(const LockAwaiter&) = delete;
+            // copy assign
+            LockAwaiter& operator=(const LockAwaiter&) = delete;
+
+            // await
+            // the entry is looked up and queued for under the shared map lock, so it can not be erased while awaited
+            bool await_ready() {
+                shared_lock lock(m_map->m_mapMutex);
+                auto it = m_map->m_map.find(m_key);
+                if (it == m_map->m_map.end() || it->second.isPending()) {
+                    return true;
+                }
+                m_entry = &it->second;
+                m_entryKey = &it->first;
+                return m_entry->lockAsync(*this);
+            }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                m_handle = handle;
+                // granted in the meantime, go on without suspending
+                return m_state.exchange(Suspended, std::memory_order_acq_rel) != Granted;
+            }
+            ValueLocked await_resume() {
+                if (!m_entry) {
+                    return {};
+                }
+                EntryLocked locked = [&]() {
+                    if constexpr (IsShared) {
+                        return m_entry->readLock(std::adopt_lock);
+                    }
+                    else {
+                        return m_map->observe(m_entry->writeLock(std::adopt_lock), *m_entryKey);
+                    }
+                }();
+                if (!locked->isValid()) {
+                    return {};
+                }
+                return locked;
+            }
+        private:
+            // state
+            static constexpr uint8 Waiting = 0;
+            static constexpr uint8 Suspended = 1;
+            static constexpr uint8 Granted = 2;
+
+            // resume (called by the releasing thread once the entry lock was handed over)
+            static void resume(AsyncWaiter* waiter) {
+                auto* self = static_cast<LockAwaiter*>(waiter);
+                if (self->m_state.exchange(Granted, std::memory_order_acq_rel) == Suspended) {
+                    std::coroutine_handle<> handle = self->m_handle;
+                    self->m_executor->submit([handle]() {
+                        handle.resume();
+                    });
+                }
+            }
+
+            // member
+            Owner* m_map;
+            K m_key;
+            TExecutor* m_executor;
+            std::conditional_t<IsShared, const Entry, Entry>* m_entry = nullptr;
+            const K* m_entryKey = nullptr;
+            std::coroutine_handle<> m_handle;
+            atomic_uint8 m_state = Waiting;
+        };
+
+        // constructor / destructor
+        SecureMap() requires(!IsPooled) = default;
+        SecureMap() requires(IsPooled)
+            : m_map(&m_resource) {}
+        ~SecureMap() {
+            delete m_changeLog.load(std::memory_order_relaxed);
+        }
+
+        // emplace
+        // the node is inserted under a short exclusive map lock, the value is constructed under its entry lock only,
+        // so an expensive constructor stalls nobody: the key reads as missing until the value exists (see insert)
+        template<typename... Args>
+        void emplace(const K& key, Args&&... args) {
+            // ASSERT(!m_map.contains(key));
+            auto [locked, entry, stored] = insert(key);
+            construct(locked, *entry, key, [&](Storage<V>& storage) {
+                storage.construct(forward<Args>(args)...);
+            });
+            record(ChangeKind::Insert, *stored);
+        }
+        // erase
+        void erase(Lookup key) {
+            {
+                shared_lock lock(m_mapMutex);
+                auto it = locate(key);
+                discard(it->first, it->second);
+            }
+            unique_lock lock(m_mapMutex);
+            // ASSERT(m_map.contains(key));
+            auto it = m_map.find(key);
+            if (it == m_map.end()) {
+                return;
+            }
+            if (removable(it->first, it->second)) {
+                freed(it->second);
+                m_map.erase(it);
+            }
+        }
+        // emplace many (the whole batch under one exclusive map lock, ascending keys are inserted with a hint, see batch for busy entries)
+        template<typename TRange>
+        void emplaceMany(TRange&& items) {
+            batch(forward<TRange>(items), [this](const K& key, Storage<V>& storage, auto&& value) {
+                storage.construct(forward<decltype(value)>(value));
+                record(ChangeKind::Insert, key);
+            });
+        }
+        // assign many (assigns existing values, constructs missing ones)
+        template<typename TRange>
+        void assignMany(TRange&& items) {
+            batch(forward<TRange>(items), [this](const K& key, Storage<V>& storage, auto&& value) {
+                if (storage.isValid()) {
+                    storage.get() = forward<decltype(value)>(value);
+                    record(ChangeKind::Write, key);
+                }
+                else {
+                    storage.construct(forward<decltype(value)>(value));
+                    record(ChangeKind::Insert, key);
+                }
+            });
+        }
+        // erase many (destroys under the shared map lock, then removes all keys under one exclusive lock)
+        template<typename TRange>
+        void eraseMany(const TRange& keys) {
+            {
+                shared_lock lock(m_mapMutex);
+                for (const auto& key : keys) {
+                    auto it = m_map.find(key);
+                    if (it != m_map.end()) {
+                        discard(it->first, it->second);
+                    }
+                }
+            }
+            unique_lock lock(m_mapMutex);
+            for (const auto& key : keys) {
+                auto it = m_map.find(key);
+                // entries re-emplaced in the meantime stay
+                if (it != m_map.end() && removable(it->first, it->second)) {
+                    freed(it->second);
+                    m_map.erase(it);
+                }
+            }
+        }
+        // clear
+        // a pooled map whose entries are all free is cleared in one exclusive section without erasing node by node (see rebuild),
+        // otherwise the values are destroyed under the entry locks first and entries still held stay behind as tombstones
+        void clear() {
+            if constexpr (IsPooled) {
+                unique_lock lock(m_mapMutex);
+                auto free = [this](auto& item) {
+                    return bool(item.second.writeLockUntil(std::chrono::steady_clock::time_point(), m_entryCounter));
+                };
+                if (std::all_of(m_map.begin(), m_map.end(), free)) {
+                    rebuild();
+                    return;
+                }
+            }
+            {
+                shared_lock lock(m_mapMutex);
+                for (auto it = m_map.begin(); it != m_map.end(); ++it) {
+                    discard(it->first, it->second);
+                }
+            }
+            unique_lock lock(m_mapMutex);
+            freed();
+            auto idle = [this](auto& item) {
+                return removable(item.first, item.second);
+            };
+            if (std::all_of(m_map.begin(), m_map.end(), idle)) {
+                if constexpr (IsPooled) {
+                    rebuild();
+                }
+                else {
+                    m_tombstones.clear();
+                    m_map.clear();
+                }
+                return;
+            }
+            // entries still held (or awaited) by someone stay behind as tombstones
+            m_tombstones.clear();
+            auto it = m_map.begin();
+            while (it != m_map.end()) {
+                it = idle(*it) ? m_map.erase(it) : std::next(it);
+            }
+        }
+
+        // read-modify-write (one lookup, the exclusive map lock is only taken if a node has to be created)
+        // :: update (func modifies the value in place, returns false if the key is missing or destroyed)
+        template<typename Func>
+        bool update(Lookup key, Func func) {
+            auto [locked, entry, stored] = obtain(key, false);
+            if (!locked || !locked->isValid()) {
+                return false;
+            }
+            func(locked->get());
+            record(ChangeKind::Write, *stored);
+            return true;
+        }
+        // :: upsert (func modifies a present value, otherwise the value is constructed from args, returns whether it was inserted)
+        template<typename Func, typename... Args>
+        bool upsert(Lookup key, Func func, Args&&... args) {
+            auto [locked, entry, stored] = obtain(key, true);
+            if (locked->isValid()) {
+                func(locked->get());
+                record(ChangeKind::Write, *stored);
+                return false;
+            }
+            construct(locked, *entry, key, [&](Storage<V>& storage) {
+                storage.construct(forward<Args>(args)...);
+            });
+            record(ChangeKind::Insert, *stored);
+            return true;
+        }
+        // :: compute if absent (a missing or destroyed value is constructed from factory(), returns the write locked value)
+        template<typename Factory>
+        WriteLocked<V, Mutex> computeIfAbsent(Lookup key, Factory factory) {
+            WriteLocked<Storage<V>, Mutex> locked;
+            Entry* entry;
+            const K* stored;
+            std::tie(locked, entry, stored) = obtain(key, true);
+            if (locked->isValid()) {
+                return observe(move(locked), *stored);
+            }
+            construct(locked, *entry, key, [&](Storage<V>& storage) {
+                storage.construct(factory());
+            });
+            record(ChangeKind::Insert, *stored);
+            return locked;
+        }
+        // :: erase if
+        // destroys the value if pred(value) holds, the node is reclaimed later as after destroy,
+        // pred runs under the shared map lock and must not call into the map
+        template<typename Pred>
+        bool eraseIf(Lookup key, Pred pred) {
+            shared_lock lock(m_mapMutex);
+            auto it = m_map.find(key);
+            if (it == m_map.end() || it->second.isPending()) {
+                return false;
+            }
+            auto locked = it->second.writeLock(m_entryCounter);
+            if (!locked->isValid() || !pred(std::as_const(locked->get()))) {
+                return false;
+            }
+            locked->destroy();
+            record(ChangeKind::Erase, it->first);
+            unique_lock tombstoneLock(m_tombstoneMutex);
+            m_tombstones.emplace_back(it->first);
+            return true;
+        }
+
+        // destroy
+        // destroy (the entry stays behind as a tombstone until clean, cleanStep or a later emplace reclaims it,
+        // an entry that is already destroyed is neither recorded nor remembered again)
+        void destroy(Lookup key) {
+            shared_lock lock(m_mapMutex);
+            // ASSERT(m_map.contains(key));
+            auto it = locate(key);
+            auto locked = it->second.writeLock(m_entryCounter);
+            if (!locked->isValid()) {
+                return;
+            }
+            locked->destroy();
+            record(ChangeKind::Destroy, it->first);
+            unique_lock tombstoneLock(m_tombstoneMutex);
+            m_tombstones.emplace_back(it->first);
+        }
+        // clean
+        void clean() {
+            unique_lock lock(m_mapMutex);
+            m_tombstones.clear();
+            auto it = m_map.begin();
+            while (it != m_map.end()) {
+                if (removable(it->first, it->second)) {
+                    freed(it->second);
+                    it = m_map.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        } 
+        // clean step (reclaims at most count tombstones under a short exclusive map lock, returns how many are left)
+        address cleanStep(address count) {
+            unique_lock lock(m_mapMutex);
+            reclaim(count);
+            return m_tombstones.size();
+        }
+        // tombstones (destroyed entries not yet reclaimed)
+        address tombstones() const {
+            shared_lock lock(m_mapMutex);
+            unique_lock tombstoneLock(m_tombstoneMutex);
+            return m_tombstones.size();
+        }
+
+        // read / write lock
+        ReadLocked<V, Mutex> readLock(Lookup key) const {
+            shared_lock lock(m_mapMutex);
+            auto it = m_map.find(key);
+            if (it != m_map.end() && !it->second.isPending()) {
+                return it->second.readLock(m_entryCounter);
+            }
+            return {};
+        }
+        WriteLocked<V, Mutex> writeLock(Lookup key) {
+            shared_lock lock(m_mapMutex);
+            auto it = m_map.find(key);
+            if (it != m_map.end() && !it->second.isPending()) {
+                return observe(it->second.writeLock(m_entryCounter), it->first);
+            }
+            return {};
+        }
+        // upgrade lock
+        // shared with readers, but exclusive among upgraders and writers: reads that turn out to need a write
+        // promote with upgrade() on the handle, without a second lookup and without another writer in between
+        // (empty if the key is missing or destroyed, requires the UpgradePolicy or the CompactPolicy)
+        UpgradeLocked<V, Mutex> upgradeLock(Lookup key) requires(IsUpgradeable) {
+            shared_lock lock(m_mapMutex);
+            auto it = m_map.find(key);
+            if (it == m_map.end() || it->second.isPending()) {
+                return {};
+            }
+            auto locked = it->second.upgradeLock(m_entryCounter);
+            if (!locked->isValid()) {
+                return {};
+            }
+            if (ChangeLog<K>* log = changeLog()) {
+                locked.observe(log, &it->first);
+            }
+            return locked;
+        }
+        // try read / write lock (never waits, the status tells a missing key from a busy entry)
+        LockAttempt<ReadLocked<V, Mutex>> tryReadLock(Lookup key) const {
+            return attempt(*this, key, std::chrono::steady_clock::time_point());
+        }
+        LockAttempt<WriteLocked<V, Mutex>> tryWriteLock(Lookup key) {
+            return attempt(*this, key, std::chrono::steady_clock::time_point());
+        }
+        // read / write lock for (the map lock and the entry lock are awaited until the deadline at most)
+        template<typename Rep, typename Period>
+        LockAttempt<ReadLocked<V, Mutex>> readLockFor(Lookup key, const std::chrono::duration<Rep, Period>& timeout) const {
+            return attempt(*this, key, std::chrono::steady_clock::now() + timeout);
+        }
+        template<typename Rep, typename Period>
+        LockAttempt<WriteLocked<V, Mutex>> writeLockFor(Lookup key, const std::chrono::duration<Rep, Period>& timeout) {
+            return attempt(*this, key, std::chrono::steady_clock::now() + timeout);
+        }
+        // read / write lock (through a handle, the lookup is only repeated after a node of the handle's stripe was freed,
+        // the shared map lock stays since nodes are freed under the exclusive one, a destroyed value counts as missing)
+        ReadLocked<V, Mutex> readLock(Lookup key, ReadHandle& handle) const {
+            shared_lock lock(m_mapMutex);
+            const Entry* entry = resolve(*this, key, handle);
+            if (entry && !entry->isPending()) {
+                auto locked = entry->readLock(m_entryCounter);
+                if (locked->isValid()) {
+                    return locked;
+                }
+            }
+            return {};
+        }
+        WriteLocked<V, Mutex> writeLock(Lookup key, WriteHandle& handle) {
+            shared_lock lock(m_mapMutex);
+            Entry* entry = resolve(*this, key, handle);
+            if (entry && !entry->isPending()) {
+                auto locked = entry->writeLock(m_entryCounter);
+                if (locked->isValid()) {
+                    return observe(move(locked), *handle.key);
+                }
+            }
+            return {};
+        }
+        // read / write lock async
+        // co_await suspends the coroutine while the entry is busy instead of blocking the thread,
+        // it is resumed on executor once the lock was handed over (requires the AsyncPolicy)
+        template<typename TExecutor>
+        LockAwaiter<true, TExecutor> readLockAsync(Lookup key, TExecutor& executor) const requires(IsAsync) {
+            return { *this, key, executor };
+        }
+        template<typename TExecutor>
+        LockAwaiter<false, TExecutor> writeLockAsync(Lookup key, TExecutor& executor) requires(IsAsync) {
+            return { *this, key, executor };
+        }
+        // read / write lock many
+        // one lookup pass under the shared map lock, then the entries are locked in key order,
+        // so lock sets that overlap can not deadlock each other
+        template<typename TRange>
+        LockSet<K, shared_lock<Mutex>> readLockMany(const TRange& keys) const {
+            LockSet<K, shared_lock<Mutex>> set;
+            shared_lock lock(m_mapMutex);
+            collect(*this, set, keys);
+            set.acquire();
+            return set;
+        }
+        template<typename TRange>
+        LockSet<K, unique_lock<Mutex>> writeLockMany(const TRange& keys) {
+            LockSet<K, unique_lock<Mutex>> set;
+            shared_lock lock(m_mapMutex);
+            collect(*this, set, keys);
+            set.acquire();
+            return set;
+        }
+        // lock many (write locks)
+        template<typename... Keys>
+        LockSet<K, unique_lock<Mutex>> lockMany(const Keys&... keys) {
+            return writeLockMany(Array<K, sizeof...(Keys)>{ K(keys)... });
+        }
+
+        // readCopy (copies small values without the entry lock, requires a SeqMutex entry policy)
+        // the lookup itself still takes the shared map lock, ReadMostlySecureMap::readCopy takes no lock at all
+        Opt<V> readCopy(Lookup key) const requires std::is_trivially_copyable_v<V> && requires(const Mutex& mutex) { mutex.version(); } {
+            shared_lock lock(m_mapMutex);
+            auto it = m_map.find(key);
+            if (it != m_map.end() && !it->second.isPending()) {
+                Storage<V> storage = it->second.readCopy();
+                if (storage.isValid()) {
+                    return storage.get();
+                }
+            }
+            return {};
+        }
+
+        // stats (zero unless compiled with SAFEMAP_LOCK_STATS)
+        MapStats stats() const override {
+#ifdef SAFEMAP_LOCK_STATS
+            return { m_mapMutex.stats(), m_entryCounter.snapshot() };
+#else
+            return {};
+#endif
+        }
+
+        // iterate
+        // :: foreach
+        // func takes (key, WriteLocked) or (key, ReadLocked) and may return false to stop early,
+        // returns whether all entries were visited, with the change log enabled every entry visited through a WriteLocked
+        // is recorded as Write (whether it was modified is not known), visit with a ReadLocked to log nothing
+        template<typename Func>
+        bool forEach(Func&& func) {
+            return scan(*this, [this]() { return m_map.begin(); }, [this](const auto& it) { return it == m_map.end(); }, func);
+        }
+        template<typename Func>
+        bool forEach(Func&& func) const {
+            return scan(*this, [this]() { return m_map.begin(); }, [this](const auto& it) { return it == m_map.end(); }, func);
+        }
+        // :: foreach read (read locks, also on a mutable map)
+        template<typename Func>
+        bool forEachRead(Func&& func) const {
+            return forEach(func);
+        }
+        // :: foreach available (as forEach, but entries locked by someone else are skipped)
+        template<typename Func>
+        bool forEachAvailable(Func&& func) {
+            return scan<true>(*this, [this]() { return m_map.begin(); }, [this](const auto& it) { return it == m_map.end(); }, func);
+        }
+        template<typename Func>
+        bool forEachAvailable(Func&& func) const {
+            return scan<true>(*this, [this]() { return m_map.begin(); }, [this](const auto& it) { return it == m_map.end(); }, func);
+        }
+        // :: foreach range (keys in [from, to), ordered containers only)
+        template<typename Func>
+        bool forEachRange(Lookup from, Lookup to, Func&& func) requires(IsOrdered) {
+            return scan(*this, [&]() { return m_map.lower_bound(from); }, [&](const auto& it) { return it == m_map.end() || !(it->first < to); }, func);
+        }
+        template<typename Func>
+        bool forEachRange(Lookup from, Lookup to, Func&& func) const requires(IsOrdered) {
+            return scan(*this, [&]() { return m_map.lower_bound(from); }, [&](const auto& it) { return it == m_map.end() || !(it->first < to); }, func);
+        }
+        // :: foreach prefix (keys starting with prefix, e.g. string keys)
+        template<typename Func>
+        bool forEachPrefix(Lookup prefix, Func&& func) requires(IsOrdered && requires(const K& key) { key.starts_with(prefix); }) {
+            return scan(*this, [&]() { return m_map.lower_bound(prefix); }, [&](const auto& it) { return it == m_map.end() || !it->first.starts_with(prefix); }, func);
+        }
+        template<typename Func>
+        bool forEachPrefix(Lookup prefix, Func&& func) const requires(IsOrdered && requires(const K& key) { key.starts_with(prefix); }) {
+            return scan(*this, [&]() { return m_map.lower_bound(prefix); }, [&](const auto& it) { return it == m_map.end() || !it->first.starts_with(prefix); }, func);
+        }
+        // :: advance (visits up to count entries from the cursor on, returns whether entries are left)
+        template<typename Func>
+        bool advance(Cursor<K>& cursor, address count, Func&& func) requires(IsOrdered) {
+            return step(*this, cursor, count, func);
+        }
+        template<typename Func>
+        bool advance(Cursor<K>& cursor, address count, Func&& func) const requires(IsOrdered) {
+            return step(*this, cursor, count, func);
+        }
+        // :: parallel foreach (chunks of the key space run on the pool, entries are locked as in forEach)
+        void parallelForEach(function<void(const K&, WriteLocked<V, Mutex>&)> func, ThreadPool& pool) {
+            parallelTraverse(*this, func, pool);
+        }
+        void parallelForEach(function<void(const K&, ReadLocked<V, Mutex>&)> func, ThreadPool& pool) const {
+            parallelTraverse(*this, func, pool);
+        }
+        // save
+        // streams a snapshot of all values to disk, the map lock is only held while advancing between entries (see traverse)
+        // and every value is copied under its read lock, so entries inserted or erased meanwhile may or may not be part of it,
+        // the parallel form serializes chunks of SaveChunk entries on the pool and writes them in order, a round at a time
+        void save(const string& path, ThreadPool& pool) const requires(Serializable<K> && Serializable<V>) {
+            SnapshotWriter<K, V> writer(path);
+            auto bounds = partition(*this, SaveChunk);
+            address round = pool.size() + 1;
+            List<List<char>> chunks(round);
+            List<uint64> counts(round);
+            for (address first = 0; first < bounds.size(); first += round) {
+                address last = std::min(first + round, bounds.size());
+                List<function<void()>> tasks;
+                for (address chunk = first; chunk < last; ++chunk) {
+                    tasks.emplace_back([this, &bounds, &chunks, &counts, first, chunk]() {
+                        List<char>& out = chunks[chunk - first];
+                        uint64& count = counts[chunk - first];
+                        out.clear();
+                        count = 0;
+                        auto func = [&](const K& key, ReadLocked<V, Mutex>& locked) {
+                            Serializer<K>::write(key, out);
+                            Serializer<V>::write(*locked, out);
+                            ++count;
+                        };
+                        range(*this, bounds, chunk, func);
+                    });
+                }
+                pool.run(move(tasks));
+                for (address chunk = first; chunk < last; ++chunk) {
+                    writer.write(chunks[chunk - first], counts[chunk - first]);
+                }
+            }
+            writer.commit();
+        }
+        void save(const string& path) const requires(Serializable<K> && Serializable<V>) {
+            SnapshotWriter<K, V> writer(path);
+            List<char> out;
+            uint64 count = 0;
+            auto func = [&](const K& key, ReadLocked<V, Mutex>& locked) {
+                Serializer<K>::write(key, out);
+                Serializer<V>::write(*locked, out);
+                ++count;
+                if (count == SaveChunk) {
+                    locked.release();
+                    writer.write(out, count);
+                    out.clear();
+                    count = 0;
+                }
+            };
+            forEach(func);
+            writer.write(out, count);
+            writer.commit();
+        }
+        // load
+        // the file is mapped and its records are decoded in chunks of SaveChunk without any map lock, each chunk is then
+        // moved in as one batch (see batch), present keys are replaced, a record found to be corrupt throws once it is reached
+        void load(const string& path) requires(Serializable<K> && Serializable<V>) {
+            SnapshotRecords<K, V> records(path);
+            List<std::pair<K, V>> chunk;
+            chunk.reserve(std::min<address>(records.size(), SaveChunk));
+            auto flush = [&]() {
+                emplaceMany(stdr::subrange(std::make_move_iterator(chunk.begin()), std::make_move_iterator(chunk.end())));
+                chunk.clear();
+            };
+            for (auto&& record : records) {
+                chunk.emplace_back(move(record));
+                if (chunk.size() == SaveChunk) {
+                    flush();
+                }
+            }
+            flush();
+        }
+
+        // change log
+        // opt-in record of inserts, erases, destroys and released write locks (see ChangeLog),
+        // replicas poll it instead of rescanning the map
+        ChangeLog<K>& enableChangeLog(address capacity = 1 << 16) {
+            unique_lock lock(m_mapMutex);
+            if (!m_changeLog.load(std::memory_order_relaxed)) {
+                m_changeLog.store(new ChangeLog<K>(capacity), std::memory_order_release);
+            }
+            return *m_changeLog.load(std::memory_order_relaxed);
+        }
+        ChangeLog<K>* changeLog() const {
+            return m_changeLog.load(std::memory_order_acquire);
+        }
+
+        // friend
+        template<typename TDerived2, typename K2, typename TPolicy2>
+        friend class CollectionBase;
+        template<typename K2, typename V2, address Shards2, typename TPolicy2>
+        friend class ShardedSecureMap;
+    private:
+        // types
+        using Obtained = std::tuple<WriteLocked<Storage<V>, Mutex>, Entry*, const K*>;
+
+        // collect (adds the unlocked entries of all present keys, requires the map lock, pending ones count as missing)
+        template<typename TSelf, typename TSet, typename TRange>
+        static void collect(TSelf& self, TSet& set, const TRange& keys) {
+            for (const auto& key : keys) {
+                auto it = self.m_map.find(key);
+                if (it != self.m_map.end() && !it->second.isPending()) {
+                    auto [value, lock] = [&]() {
+                        if constexpr (TSet::IsShared) {
+                            return it->second.readLock(std::defer_lock);
+                        }
+                        else {
+                            return it->second.writeLock(std::defer_lock);
+                        }
+                    }();
+                    if constexpr (TSet::IsShared) {
+                        set.add(it->first, typeid(V).hash_code(), value, move(lock), self.m_entryCounter);
+                    }
+                    else {
+                        set.add(it->first, typeid(V).hash_code(), value, move(lock), self.m_entryCounter, self.changeLog());
+                    }
+                }
+            }
+        }
+        // locate (throws out_of_range for a missing key, a pending one is not there yet)
+        auto locate(Lookup key) {
+            auto it = m_map.find(key);
+            if (it == m_map.end() || it->second.isPending()) {
+                throw std::out_of_range("SecureMap: missing key");
+            }
+            return it;
+        }
+        // obtain
+        // write locked entry of key (possibly destroyed, then it is pending, see construct) and the key stored in the map,
+        // the entry lock keeps both in place once the map lock is gone, with create a missing node is inserted (see insert),
+        // without it a pending entry counts as missing
+        Obtained obtain(Lookup key, bool create) {
+            {
+                shared_lock lock(m_mapMutex);
+                auto it = m_map.find(key);
+                if (it != m_map.end() && !it->second.isPending()) {
+                    auto locked = it->second.writeLock(m_entryCounter);
+                    if (!create || locked->isValid()) {
+                        return { move(locked), &it->second, &it->first };
+                    }
+                }
+                else if (!create) {
+                    return { WriteLocked<Storage<V>, Mutex>(), nullptr, nullptr };
+                }
+            }
+            // missing, destroyed or pending, a value to construct is only marked pending under the exclusive map lock
+            return insert(K(key));
+        }
+        // insert
+        // write locked entry of key (inserted if missing) and the key stored in the map, the entry is only try-locked
+        // under the exclusive map lock (a busy one is awaited under the shared lock, a pending one by retrying),
+        // a destroyed value is marked pending before the exclusive map lock is released, so readers that find the node
+        // treat it as missing instead of waiting under the map lock until the caller constructed it
+        Obtained insert(const K& key) {
+            while (true) {
+                {
+                    unique_lock lock(m_mapMutex);
+                    reclaim(ReclaimPerWrite);
+                    auto [it, inserted] = m_map.try_emplace(key);
+                    if (inserted) {
+                        it->second.name(it->first, typeid(V));
+                    }
+                    if (!it->second.isPending()) {
+                        if (auto locked = it->second.writeLockUntil(std::chrono::steady_clock::time_point(), m_entryCounter)) {
+                            if (!locked->isValid()) {
+                                it->second.setPending(true);
+                            }
+                            return { move(locked), &it->second, &it->first };
+                        }
+                    }
+                }
+                {
+                    shared_lock lock(m_mapMutex);
+                    auto it = m_map.find(key);
+                    if (it != m_map.end() && !it->second.isPending()) {
+                        auto locked = it->second.writeLock(m_entryCounter);
+                        if (locked->isValid()) {
+                            return { move(locked), &it->second, &it->first };
+                        }
+                        // destroyed meanwhile, marked pending on the next attempt
+                        continue;
+                    }
+                }
+                std::this_thread::yield();
+            }
+        }
+        // construct
+        // constructs the value of an entry returned by obtain or insert through make(storage) and clears its pending flag,
+        // if make throws, the node is erased again (left for reclaim while someone else holds it) and the exception passed on
+        template<typename Make>
+        void construct(WriteLocked<Storage<V>, Mutex>& locked, Entry& entry, Lookup key, Make make) {
+            try {
+                make(*locked);
+            }
+            catch (...) {
+                entry.setPending(false);
+                locked.release();
+                abandon(key);
+                throw;
+            }
+            entry.setPending(false);
+        }
+        // abandon (erases the node of a value that was never constructed, see construct)
+        void abandon(Lookup key) {
+            unique_lock lock(m_mapMutex);
+            auto it = m_map.find(key);
+            if (it != m_map.end() && removable(it->first, it->second)) {
+                freed(it->second);
+                m_map.erase(it);
+            }
+        }
+        // discard
+        // destroys the value of an entry (requires the map lock) and records the erase while the entry is still locked,
+        // so it is logged before a re-emplace of the key, erase, eraseMany and clear only log values they actually destroyed
+        void discard(const K& key, Entry& entry) {
+            if (entry.isPending()) {
+                return;
+            }
+            auto locked = entry.writeLock(m_entryCounter);
+            if (locked->isValid()) {
+                locked->destroy();
+                record(ChangeKind::Erase, key);
+            }
+        }
+        // rebuild
+        // requires the exclusive map lock and entries nobody holds or awaits (nobody can lock one while the exclusive lock is held):
+        // values and elements are destroyed in place, the container itself is abandoned and its nodes go back with the whole pool
+        void rebuild() requires(IsPooled) {
+            freed();
+            m_tombstones.clear();
+            for (auto& item : m_map) {
+                if (auto locked = item.second.writeLockUntil(std::chrono::steady_clock::time_point(), m_entryCounter)) {
+                    if (locked->isValid()) {
+                        locked->destroy();
+                        record(ChangeKind::Erase, item.first);
+                    }
+                }
+                std::destroy_at(&item);
+            }
+            m_resource.release();
+            std::construct_at(&m_map, &m_resource);
+        }
+        // record (no-op unless the change log is enabled)
+        void record(ChangeKind kind, const K& key) {
+            if (ChangeLog<K>* log = changeLog()) {
+                log->record(kind, key);
+            }
+        }
+        // observe (a write lock on a valid entry reports its release, key must be the key stored in the map)
+        WriteLocked<Storage<V>, Mutex> observe(WriteLocked<Storage<V>, Mutex>&& locked, const K& key) {
+            ChangeLog<K>* log = changeLog();
+            if (log && locked && locked->isValid()) {
+                locked.observe(log, &key);
+            }
+            return locked;
+        }
+        // removable
+        // requires the exclusive map lock: a destroyed entry that nobody holds or awaits (see AsyncMutex),
+        // a busy entry is remembered as tombstone and reclaimed later
+        bool removable(const K& key, Entry& entry) {
+            auto locked = entry.writeLockUntil(std::chrono::steady_clock::time_point(), m_entryCounter);
+            if (!locked) {
+                m_tombstones.emplace_back(key);
+                return false;
+            }
+            return !locked->isValid();
+        }
+        // reclaim
+        // requires the exclusive map lock (destroy only adds tombstones under the shared one),
+        // tombstones whose entry is locked right now are kept for later
+        void reclaim(address count) {
+            if (m_tombstones.empty()) {
+                return;
+            }
+            address kept = 0;
+            for (address i = 0; i < count && kept < m_tombstones.size(); ++i) {
+                K key = move(m_tombstones.back());
+                m_tombstones.pop_back();
+                auto it = m_map.find(key);
+                if (it == m_map.end()) {
+                    continue;
+                }
+                auto locked = it->second.writeLockUntil(std::chrono::steady_clock::time_point(), m_entryCounter);
+                if (!locked) {
+                    m_tombstones.push_front(move(key));
+                    ++kept;
+                }
+                else if (!locked->isValid()) {
+                    locked.release();
+                    freed(it->second);
+                    m_map.erase(it);
+                }
+            }
+        }
+        // attempt (a destroyed or pending value counts as missing)
+        template<typename TSelf>
+        static auto attempt(TSelf& self, Lookup key, std::chrono::steady_clock::time_point deadline) {
+            using ValueLocked = std::conditional_t<std::is_const_v<TSelf>, ReadLocked<V, Mutex>, WriteLocked<V, Mutex>>;
+            using Attempt = LockAttempt<ValueLocked>;
+            shared_lock lock(self.m_mapMutex, std::defer_lock);
+            if (!tryLockUntil(lock, deadline)) {
+                return Attempt{ {}, LockStatus::Contended };
+            }
+            auto it = self.m_map.find(key);
+            if (it == self.m_map.end() || it->second.isPending()) {
+                return Attempt{ {}, LockStatus::Missing };
+            }
+            auto locked = [&]() {
+                if constexpr (std::is_const_v<TSelf>) {
+                    return it->second.readLockUntil(deadline, self.m_entryCounter);
+                }
+                else {
+                    return it->second.writeLockUntil(deadline, self.m_entryCounter);
+                }
+            }();
+            if (!locked) {
+                return Attempt{ {}, LockStatus::Contended };
+            }
+            if (!locked->isValid()) {
+                return Attempt{ {}, LockStatus::Missing };
+            }
+            if constexpr (!std::is_const_v<TSelf>) {
+                locked = self.observe(move(locked), it->first);
+            }
+            return Attempt{ move(locked), LockStatus::Acquired };
+        }
+        // resolve (requires the map lock, entries stay put until they are erased)
+        template<typename TSelf, typename THandle>
+        static auto resolve(TSelf& self, Lookup key, THandle& handle) {
+            if (!handle.entry || handle.generation != self.m_freed[stripe(handle.entry)]) {
+                auto it = self.m_map.find(key);
+                if (it != self.m_map.end()) {
+                    handle = { &it->second, &it->first, self.m_freed[stripe(&it->second)] };
+                }
+                else {
+                    handle = {};
+                }
+            }
+            return handle.entry;
+        }
+        // stripe (of the freed generations, by node address, so a node reused at the same address is noticed)
+        static address stripe(const Entry* entry) {
+            return (reinterpret_cast<std::uintptr_t>(entry) >> 4) % FreedStripes;
+        }
+        // freed (requires the exclusive map lock, call when the node of entry is erased, or without entry when all are)
+        void freed(const Entry& entry) {
+            ++m_generation;
+            ++m_freed[stripe(&entry)];
+        }
+        void freed() {
+            ++m_generation;
+            for (uint64& generation : m_freed) {
+                ++generation;
+            }
+        }
+        // batch (func receives the key, the locked storage and the value of every (key, value) item)
+        // the exclusive map lock only inserts the nodes: missing or destroyed entries are try-locked and marked pending there
+        // and constructed once it is released (see insert), present, busy and repeated keys are applied afterwards in item order
+        // through obtain, so neither value construction nor a holder waiting for the map lock can stall the exclusive section
+        template<typename TRange, typename Func>
+        void batch(TRange&& items, Func func) {
+            using Value = std::remove_cvref_t<std::tuple_element_t<1, std::remove_cvref_t<stdr::range_reference_t<TRange>>>>;
+            struct Placeholder {
+                const K* key;
+                Entry* entry;
+                WriteLocked<Storage<V>, Mutex> locked;
+                Value value;
+            };
+            List<Placeholder> placeholders;
+            List<std::pair<K, Value>> deferred;
+            {
+                unique_lock lock(m_mapMutex);
+                reclaim(ReclaimPerWrite);
+                if constexpr (!IsOrdered && stdr::sized_range<TRange>) {
+                    m_map.reserve(m_map.size() + stdr::size(items));
+                }
+                // entries can not be erased while the exclusive lock is held, so their address identifies them
+                HashSet<const Entry*> seen;
+                auto hint = m_map.end();
+                for (auto&& item : items) {
+                    auto it = hint;
+                    if constexpr (IsOrdered) {
+                        it = m_map.try_emplace(hint, std::get<0>(item));
+                        hint = std::next(it);
+                    }
+                    else {
+                        it = m_map.try_emplace(std::get<0>(item)).first;
+                    }
+                    it->second.name(it->first, typeid(V));
+                    WriteLocked<Storage<V>, Mutex> locked;
+                    if (seen.emplace(&it->second).second && !it->second.isPending()) {
+                        locked = it->second.writeLockUntil(std::chrono::steady_clock::time_point(), m_entryCounter);
+                    }
+                    if (locked && !locked->isValid()) {
+                        it->second.setPending(true);
+                        placeholders.push_back({ &it->first, &it->second, move(locked), std::get<1>(forward<decltype(item)>(item)) });
+                        continue;
+                    }
+                    locked.release();
+                    deferred.emplace_back(it->first, std::get<1>(forward<decltype(item)>(item)));
+                }
+            }
+            // the placeholders are held by this thread only, a throwing func abandons the ones not constructed yet
+            address constructed = 0;
+            try {
+                for (; constructed < placeholders.size(); ++constructed) {
+                    auto& [key, entry, locked, value] = placeholders[constructed];
+                    func(*key, *locked, move(value));
+                    entry->setPending(false);
+                    locked.release();
+                }
+            }
+            catch (...) {
+                for (address i = constructed; i < placeholders.size(); ++i) {
+                    // the node may be erased as soon as its entry is released
+                    K key = *placeholders[i].key;
+                    placeholders[i].entry->setPending(false);
+                    placeholders[i].locked.release();
+                    abandon(key);
+                }
+                throw;
+            }
+            for (auto& [key, value] : deferred) {
+                auto [locked, entry, stored] = obtain(key, true);
+                if (locked->isValid()) {
+                    func(*stored, *locked, move(value));
+                    continue;
+                }
+                construct(locked, *entry, key, [&](Storage<V>& storage) {
+                    func(*stored, storage, move(value));
+                });
+            }
+        }
+        // scan (read locks on a mutable map too, unless func takes a WriteLocked)
+        template<bool SkipContended = false, typename TSelf, typename Start, typename Stop, typename Func>
+        static bool scan(TSelf& self, Start start, Stop stop, Func& func) {
+            if constexpr (!std::is_const_v<TSelf> && !std::is_invocable_v<Func&, const K&, WriteLocked<V, Mutex>&>) {
+                return traverse<SkipContended>(std::as_const(self), start, stop, func);
+            }
+            else {
+                return traverse<SkipContended>(self, start, stop, func);
+            }
+        }
+        // step (one chunk of a cursor scan, the cursor is moved past the visited entries)
+        template<typename TSelf, typename Func>
+        static bool step(TSelf& self, Cursor<K>& cursor, address count, Func& func) {
+            if constexpr (!std::is_const_v<TSelf> && !std::is_invocable_v<Func&, const K&, WriteLocked<V, Mutex>&>) {
+                return step(std::as_const(self), cursor, count, func);
+            }
+            else {
+                if (cursor.m_done) {
+                    return false;
+                }
+                address visited = 0;
+                auto start = [&]() {
+                    if (!cursor.m_next) {
+                        return self.m_map.begin();
+                    }
+                    return cursor.m_inclusive ? self.m_map.lower_bound(*cursor.m_next) : self.m_map.upper_bound(*cursor.m_next);
+                };
+                auto stop = [&](const auto& it) {
+                    if (it == self.m_map.end() || (cursor.m_to && !(it->first < *cursor.m_to))) {
+                        cursor.m_done = true;
+                        return true;
+                    }
+                    if (visited++ == count) {
+                        cursor.m_next = it->first;
+                        cursor.m_inclusive = true;
+                        return true;
+                    }
+                    return false;
+                };
+                auto visit = [&](const K& key, auto& locked) {
+                    if constexpr (std::is_same_v<std::invoke_result_t<Func&, const K&, decltype(locked)>, bool>) {
+                        if (!func(key, locked)) {
+                            cursor.m_next = key;
+                            cursor.m_inclusive = false;
+                            return false;
+                        }
+                    }
+                    else {
+                        func(key, locked);
+                    }
+                    return true;
+                };
+                traverse(self, start, stop, visit);
+                return !cursor.m_done;
+            }
+        }
+        // traverse
+        // visits the entries from start() until stop(it), the map lock is only held while advancing and is never taken
+        // while an entry is held (see LockOrder): the position of the current entry is kept, so once the generation shows
+        // that entries were erased meanwhile the iterator is sought again instead of advanced, returns false if func returned false
+        template<bool SkipContended = false, typename TSelf, typename Start, typename Stop, typename Func>
+        static bool traverse(TSelf& self, Start start, Stop stop, Func& func) {
+            constexpr bool IsConst = std::is_const_v<TSelf>;
+            using EntryLocked = std::conditional_t<IsConst, ReadLocked<Storage<V>, Mutex>, WriteLocked<Storage<V>, Mutex>>;
+            using ValueLocked = std::conditional_t<IsConst, ReadLocked<V, Mutex>, WriteLocked<V, Mutex>>;
+            using Position = std::conditional_t<IsOrdered, K, address>;
+            decltype(self.m_map.begin()) it;
+            EntryLocked locked;
+            // position of the current entry and the generation it was reached in, taken under the map lock
+            Opt<Position> position;
+            uint64 generation = 0;
+            // key of the locked entry, taken under the map lock (the container is only touched while it is held)
+            const K* key = nullptr;
+            auto lockEntry = [&]() {
+                key = &it->first;
+                if constexpr (IsOrdered) {
+                    // assigned, so a key buffer is reused from entry to entry
+                    if (position) {
+                        *position = it->first;
+                    }
+                    else {
+                        position.emplace(it->first);
+                    }
+                }
+                else {
+                    position = it.index();
+                }
+                generation = self.m_generation;
+                if (it->second.isPending()) {
+                    // under construction, skipped like a destroyed entry
+                    locked.release();
+                }
+                else if constexpr (SkipContended && IsConst) {
+                    locked = it->second.readLockUntil(std::chrono::steady_clock::time_point(), self.m_entryCounter);
+                }
+                else if constexpr (SkipContended) {
+                    locked = it->second.writeLockUntil(std::chrono::steady_clock::time_point(), self.m_entryCounter);
+                }
+                else if constexpr (IsConst) {
+                    locked = it->second.readLock(self.m_entryCounter);
+                }
+                else {
+                    locked = it->second.writeLock(self.m_entryCounter);
+                }
+                if constexpr (!IsConst) {
+                    locked = self.observe(move(locked), it->first);
+                }
+                if (locked && !locked->isValid()) {
+                    locked.release();
+                }
+            };
+            {
+                shared_lock lock(self.m_mapMutex);
+                it = start();
+                if (stop(it)) {
+                    return true;
+                }
+                lockEntry();
+            }
+            while (true) {
+                if (locked) {
+                    ValueLocked locked_value = move(locked);
+                    if constexpr (std::is_same_v<std::invoke_result_t<Func&, const K&, ValueLocked&>, bool>) {
+                        if (!func(*key, locked_value)) {
+                            return false;
+                        }
+                    }
+                    else {
+                        func(*key, locked_value);
+                    }
+                }
+                shared_lock lock(self.m_mapMutex);
+                if (generation != self.m_generation) {
+                    if constexpr (IsOrdered) {
+                        it = self.m_map.upper_bound(*position);
+                    }
+                    else {
+                        it = self.m_map.seek(*position + 1);
+                    }
+                }
+                else {
+                    ++it;
+                }
+                if (stop(it)) {
+                    return true;
+                }
+                lockEntry();
+            }
+        }
+        // parallelTraverse
+        template<typename TSelf, typename Func>
+        static void parallelTraverse(TSelf& self, Func& func, ThreadPool& pool) {
+            List<function<void()>> tasks;
+            schedule(self, func, (pool.size() + 1) * 4, tasks);
+            pool.run(move(tasks));
+        }
+        // schedule (appends the tasks of a parallel traversal in about chunkCount chunks, func must outlive them)
+        template<typename TSelf, typename Func>
+        static void schedule(TSelf& self, Func& func, address chunkCount, List<function<void()>>& tasks) {
+            address size = 0;
+            {
+                shared_lock lock(self.m_mapMutex);
+                size = self.m_map.size();
+            }
+            auto bounds = make_shared<const List<std::conditional_t<IsOrdered, K, address>>>(
+                partition(self, std::max<address>(1, (size + chunkCount - 1) / chunkCount))
+            );
+            for (address chunk = 0; chunk < bounds->size(); ++chunk) {
+                tasks.emplace_back([&self, &func, bounds, chunk]() {
+                    range(self, *bounds, chunk, func);
+                });
+            }
+        }
+        // partition (first position of every chunk of chunkSize entries)
+        // ordered containers are split by key, unordered ones by position (FlatHashMap entries never move),
+        // so bounds stay meaningful when their entry is erased in the meantime
+        static List<std::conditional_t<IsOrdered, K, address>> partition(const SecureMap& self, address chunkSize) {
+            List<std::conditional_t<IsOrdered, K, address>> bounds;
+            shared_lock lock(self.m_mapMutex);
+            address index = 0;
+            for (auto it = self.m_map.begin(); it != self.m_map.end(); ++it, ++index) {
+                if (index % chunkSize == 0) {
+                    if constexpr (IsOrdered) {
+                        bounds.emplace_back(it->first);
+                    }
+                    else {
+                        bounds.emplace_back(it.index());
+                    }
+                }
+            }
+            return bounds;
+        }
+        // range (traverses one chunk of a partition)
+        template<typename TSelf, typename TBounds, typename Func>
+        static void range(TSelf& self, const TBounds& bounds, address chunk, Func& func) {
+            auto start = [&]() {
+                if constexpr (IsOrdered) {
+                    return self.m_map.lower_bound(bounds[chunk]);
+                }
+                else {
+                    return self.m_map.seek(bounds[chunk]);
+                }
+            };
+            auto stop = [&](const auto& it) {
+                if (it == self.m_map.end()) {
+                    return true;
+                }
+                if (chunk + 1 == bounds.size()) {
+                    return false;
+                }
+                if constexpr (IsOrdered) {
+                    return !(it->first < bounds[chunk + 1]);
+                }
+                else {
+                    return !(it.index() < bounds[chunk + 1]);
+                }
+            };
+            traverse(self, start, stop, func);
+        }
+
+        // resource (declared first, it outlives the map nodes)
+        [[no_unique_address]] Resource m_resource;
+        // map
+        Container m_map;
+        mutable MapMutex m_mapMutex;
+        // tombstones (keys of destroyed entries, appended under the shared map lock)
+        Deque<K> m_tombstones;
+        mutable mutex m_tombstoneMutex;
+        static constexpr address ReclaimPerWrite = 2;
+        // entries per snapshot chunk (see save)
+        static constexpr address SaveChunk = 1 << 12;
+        // generation (bumped under the exclusive map lock whenever entries are erased)
+        uint64 m_generation = 0;
+        // freed generations (striped by node address, bumped with m_generation, see resolve)
+        static constexpr address FreedStripes = 64;
+        Array<uint64, FreedStripes> m_freed = {};
+        // change log (only set once enabled, published atomically since record and observe read it without the map lock)
+        std::atomic<ChangeLog<K>*> m_changeLog = nullptr;
+        // stats
+        [[no_unique_address]] mutable LockCounter m_entryCounter;
+    };
+}
+
+// #include "sharded.hpp" (HPPMERGE)
+namespace Memory {
+    // ShardedSecureMap
+    // keys are hashed onto independent SecureMaps (each with its own map mutex),
+    // so structural operations on different shards never contend
+    template<typename K, typename V, address Shards = 16, typename TPolicy = MapPolicy>
+    class ShardedSecureMap : public ISecureMap {
+    public:
+        static_assert(Shards > 0, "ShardedSecureMap requires at least one shard");
+        // types
+        using Mutex = typename TPolicy::Mutex;
+
+        // constructor / destructor
+        ShardedSecureMap() = default;
+        ~ShardedSecureMap() = default;
+
+        // emplace
+        template<typename... Args>
+        void emplace(const K& key, Args&&... args) {
+            shard(key).emplace(key, forward<Args>(args)...);
+        }
+        // erase
+        void erase(LookupKey<K> key) {
+            shard(key).erase(key);
+        }
+        // clear
+        void clear() {
+            for (auto& shard : m_shards) {
+                shard.map.clear();
+            }
+        }
+
+        // destroy
+        void destroy(LookupKey<K> key) {
+            shard(key).destroy(key);
+        }
+        // clean
+        void clean() {
+            for (auto& shard : m_shards) {
+                shard.map.clean();
+            }
+        }
+
+        // clean step (count is spread over the shards, returns the tombstones left in all of them)
+        address cleanStep(address count) {
+            address left = 0;
+            for (auto& shard : m_shards) {
+                left += shard.map.cleanStep(count / Shards + 1);
+            }
+            return left;
+        }
+        // tombstones
+        address tombstones() const {
+            address count = 0;
+            for (const auto& shard : m_shards) {
+                count += shard.map.tombstones();
+            }
+            return count;
+        }
+
+        // read / write lock
+        ReadLocked<V, Mutex> readLock(LookupKey<K> key) const {
+            return shard(key).readLock(key);
+        }
+        WriteLocked<V, Mutex> writeLock(LookupKey<K> key) {
+            return shard(key).writeLock(key);
+        }
+        // upgrade lock (see SecureMap::upgradeLock)
+        UpgradeLocked<V, Mutex> upgradeLock(LookupKey<K> key) {
+            return shard(key).upgradeLock(key);
+        }
+        // try read / write lock
+        LockAttempt<ReadLocked<V, Mutex>> tryReadLock(LookupKey<K> key) const {
+            return shard(key).tryReadLock(key);
+        }
+        LockAttempt<WriteLocked<V, Mutex>> tryWriteLock(LookupKey<K> key) {
+            return shard(key).tryWriteLock(key);
+        }
+        // read / write lock for
+        template<typename Rep, typename Period>
+        LockAttempt<ReadLocked<V, Mutex>> readLockFor(LookupKey<K> key, const std::chrono::duration<Rep, Period>& timeout) const {
+            return shard(key).readLockFor(key, timeout);
+        }
+        template<typename Rep, typename Period>
+        LockAttempt<WriteLocked<V, Mutex>> writeLockFor(LookupKey<K> key, const std::chrono::duration<Rep, Period>& timeout) {
+            return shard(key).writeLockFor(key, timeout);
+        }
+        // readCopy
+        Opt<V> readCopy(LookupKey<K> key) const {
+            return shard(key).readCopy(key);
+        }
+
+        // stats (summed over all shards)
+        MapStats stats() const override {
+            MapStats stats;
+            for (const auto& shard : m_shards) {
+                stats += shard.map.stats();
+            }
+            return stats;
+        }
+
+        // iterate
+        // :: foreach (shard by shard, keys are only ordered within a shard)
+        template<typename Func>
+        bool forEach(Func&& func) {
+            for (auto& shard : m_shards) {
+                if (!shard.map.forEach(func)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        template<typename Func>
+        bool forEach(Func&& func) const {
+            for (const auto& shard : m_shards) {
+                if (!shard.map.forEach(func)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        // :: foreach read
+        template<typename Func>
+        bool forEachRead(Func&& func) const {
+            return forEach(func);
+        }
+        // :: parallel foreach (the chunks of all shards are handed to the pool at once, so shards are traversed concurrently)
+        void parallelForEach(function<void(const K&, WriteLocked<V, Mutex>&)> func, ThreadPool& pool) {
+            List<function<void()>> tasks;
+            for (auto& shard : m_shards) {
+                SecureMap<K, V, TPolicy>::schedule(shard.map, func, chunksPerShard(pool), tasks);
+            }
+            pool.run(move(tasks));
+        }
+        void parallelForEach(function<void(const K&, ReadLocked<V, Mutex>&)> func, ThreadPool& pool) const {
+            List<function<void()>> tasks;
+            for (const auto& shard : m_shards) {
+                SecureMap<K, V, TPolicy>::schedule(shard.map, func, chunksPerShard(pool), tasks);
+            }
+            pool.run(move(tasks));
+        }
+
+        // shard
+        SecureMap<K, V, TPolicy>& shard(LookupKey<K> key) {
+            return m_shards[shardIndex(key)].map;
         }
-        WriteLocked<T> writeLock() {
-            return { &m_value, m_mutex };
+        const SecureMap<K, V, TPolicy>& shard(LookupKey<K> key) const {
+            return m_shards[shardIndex(key)].map;
+        }
+        // shardIndex
+        static address shardIndex(LookupKey<K> key) {
+            // fibonacci hashing, spreads identity hashes (e.g. of ints) over all shards
+            uint64 hash = static_cast<uint64>(KeyHash<K>{}(key));
+            return static_cast<address>((hash * 0x9E3779B97F4A7C15ull) >> 32) % Shards;
         }
     private:
-        // value
-        T m_value;
-        mutable shared_mutex m_mutex;
+        // chunksPerShard (about 4 chunks per thread over all shards, see SecureMap::parallelForEach)
+        static address chunksPerShard(const ThreadPool& pool) {
+            return std::max<address>(1, ((pool.size() + 1) * 4 + Shards - 1) / Shards);
+        }
+
+        // Shard (padded to its own cache line, so shard mutexes do not share one)
+        struct alignas(64) Shard {
+            SecureMap<K, V, TPolicy> map;
+        };
+        // shards
+        Array<Shard, Shards> m_shards;
     };
 }
 
-// #include "storage.hpp" (HPPMERGE)
+// #include "epoch.hpp" (HPPMERGE)
 namespace Memory {
-    // Storage
-    template<typename T>
-    class Storage {
+    // EpochDomain
+    // epoch based reclamation: readers pin the current epoch while they dereference shared pointers,
+    // retired objects are reclaimed once every pinned reader has entered a later epoch
+    class EpochDomain {
+    private:
+        // Record (one per thread, reused after the thread exits)
+        struct alignas(64) Record {
+            atomic_uint64 epoch = 0; // 0 while not pinned
+            std::atomic_bool used = true;
+            address depth = 0;
+            Record* next = nullptr;
+        };
     public:
-        // construct
-        template<typename... Args>
-        void construct(Args&&... args) {
-            if (m_isValid) {
-                destroy();
+        // Guard
+        class Guard {
+        public:
+            // constructor / destructor
+            Guard(Record& record)
+                : m_record(&record) {}
+            ~Guard() {
+                if (m_record && --m_record->depth == 0) {
+                    m_record->epoch.store(0, std::memory_order_release);
+                }
+            }
+            // copy
+            Guard(const Guard&) = delete;
+            // copy assign
+            Guard& operator=(const Guard&) = delete;
+        private:
+            // member
+            Record* m_record;
+        };
+
+        // destructor
+        ~EpochDomain() {
+            for (auto& [epoch, reclaim] : m_retired) {
+                reclaim();
+            }
+            while (Record* record = m_records.load()) {
+                m_records = record->next;
+                delete record;
             }
-            std::construct_at(std::bit_cast<T*>(&m_storage), forward<Args>(args)...);
-            m_isValid = true;
         }
-        // destroy
-        void destroy() {
-            if (m_isValid) {
-                m_isValid = false;
-                std::destroy_at(std::bit_cast<T*>(&m_storage));
+        // copy
+        EpochDomain(const EpochDomain&) = delete;
+        // copy assign
+        EpochDomain& operator=(const EpochDomain&) = delete;
+
+        // pin (nested pins of one thread share the outermost epoch)
+        [[nodiscard]] Guard pin() {
+            Record& record = local();
+            if (record.depth++ == 0) {
+                record.epoch.store(m_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                // the pin must be visible before the reader loads any shared pointer
+                std::atomic_thread_fence(std::memory_order_seq_cst);
             }
+            return Guard(record);
         }
-        // isValid
-        bool isValid() const {
-            return m_isValid;
+        // retire (call after unlinking, reclaim returns false while the object is still in use and is retried)
+        void retire(function<bool()> reclaim) {
+            unique_lock lock(m_retiredMutex);
+            m_retired.emplace_back(m_epoch.fetch_add(1, std::memory_order_seq_cst), move(reclaim));
+            collect();
         }
-        
-        // get
-        T& get() {
-            return *std::bit_cast<T*>(&m_storage);
+        // flush (reclaims whatever is no longer reachable)
+        void flush() {
+            unique_lock lock(m_retiredMutex);
+            collect();
         }
-        const T& get() const {
-            return *std::bit_cast<const T*>(&m_storage);
+
+        // instance (shared by all read-mostly maps)
+        static EpochDomain& instance() {
+            static EpochDomain domain;
+            return domain;
         }
     private:
-        // storage
-        std::aligned_storage_t<sizeof(T), alignof(T)> m_storage;
-        bool m_isValid = false;
+        // constructor (thread records are per domain, so there is only the one instance)
+        EpochDomain() = default;
+
+        // local (record of the calling thread)
+        Record& local() {
+            // Owner (hands the record back when the thread exits)
+            struct Owner {
+                Record* record = nullptr;
+                ~Owner() {
+                    if (record) {
+                        record->used.store(false, std::memory_order_release);
+                    }
+                }
+            };
+            thread_local Owner owner;
+            if (!owner.record) {
+                owner.record = acquire();
+            }
+            return *owner.record;
+        }
+        // acquire (reuses a free record or publishes a new one)
+        Record* acquire() {
+            for (Record* record = m_records.load(std::memory_order_acquire); record; record = record->next) {
+                bool used = false;
+                if (!record->used.load(std::memory_order_relaxed) && record->used.compare_exchange_strong(used, true, std::memory_order_acquire)) {
+                    return record;
+                }
+            }
+            Record* record = new Record();
+            record->next = m_records.load(std::memory_order_relaxed);
+            while (!m_records.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed));
+            return record;
+        }
+        // collect (requires the retired mutex)
+        void collect() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint64 oldest = UINT64_MAX;
+            for (Record* record = m_records.load(std::memory_order_acquire); record; record = record->next) {
+                uint64 epoch = record->epoch.load(std::memory_order_acquire);
+                if (epoch != 0) {
+                    oldest = std::min(oldest, epoch);
+                }
+            }
+            // objects retired at epoch e may still be seen by readers pinned at e or earlier
+            auto it = std::remove_if(m_retired.begin(), m_retired.end(), [oldest](auto& retired) {
+                return retired.first < oldest && retired.second();
+            });
+            m_retired.erase(it, m_retired.end());
+        }
+
+        // epoch
+        atomic_uint64 m_epoch = 1;
+        std::atomic<Record*> m_records = nullptr;
+        // retired
+        mutex m_retiredMutex;
+        List<std::pair<uint64, function<bool()>>> m_retired;
     };
 }
 
-// #include "map.hpp" (HPPMERGE)
+// #include "readmostly.hpp" (HPPMERGE)
 namespace Memory {
-    // Interface for SecureMap
-    class ISecureMap {
+    // ReadMostlySecureMap
+    // lookups and traversal take no map lock: the keys live in an immutable sorted snapshot,
+    // writers publish a modified copy and retire the old snapshot (and erased entries) to the EpochDomain,
+    // values are locked per entry as in SecureMap
+    template<typename K, typename V, typename TPolicy = MapPolicy>
+    class ReadMostlySecureMap : public ISecureMap {
     public:
-        // constructor / destructor
-        ISecureMap() = default;
-        virtual ~ISecureMap() = default;
-    };
+        // types
+        using Mutex = typename TPolicy::Mutex;
 
-    // SecureMap
-    template<typename K, typename V>
-    class SecureMap : public ISecureMap {
-    public:
         // constructor / destructor
-        SecureMap() = default;
-        ~SecureMap() = default;
+        ReadMostlySecureMap()
+            : m_snapshot(new Snapshot()) {}
+        ~ReadMostlySecureMap() {
+            Snapshot* snapshot = m_snapshot.load();
+            for (auto& [key, entry] : *snapshot) {
+                delete entry;
+            }
+            delete snapshot;
+        }
+        // copy
+        ReadMostlySecureMap(const ReadMostlySecureMap&) = delete;
+        // copy assign
+        ReadMostlySecureMap& operator=(const ReadMostlySecureMap&) = delete;
 
         // emplace
         template<typename... Args>
         void emplace(const K& key, Args&&... args) {
-            unique_lock lock(m_mapMutex);
-            // ASSERT(!m_map.contains(key));
-            m_map[key].writeLock()->construct(forward<Args>(args)...);
+            unique_lock lock(m_writeMutex);
+            const Snapshot& current = *m_snapshot.load(std::memory_order_relaxed);
+            auto it = lowerBound(current, key);
+            if (it != current.end() && !(key < it->first)) {
+                it->second->writeLock(m_entryCounter)->construct(forward<Args>(args)...);
+                return;
+            }
+            // not yet published, nobody else can lock it
+            Entry* entry = new Entry();
+            entry->writeLock()->construct(forward<Args>(args)...);
+            Snapshot* next = new Snapshot();
+            next->reserve(current.size() + 1);
+            next->insert(next->end(), current.begin(), it);
+            next->emplace_back(key, entry);
+            next->insert(next->end(), it, current.end());
+            publish(next);
+        }
+        // emplace many (publishes one snapshot for the whole batch)
+        template<typename TRange>
+        void emplaceMany(TRange&& items) {
+            unique_lock lock(m_writeMutex);
+            const Snapshot& current = *m_snapshot.load(std::memory_order_relaxed);
+            Map<K, Entry*> added;
+            for (auto&& item : items) {
+                const K& key = std::get<0>(item);
+                auto it = lowerBound(current, key);
+                if (it != current.end() && !(key < it->first)) {
+                    it->second->writeLock(m_entryCounter)->construct(std::get<1>(forward<decltype(item)>(item)));
+                    continue;
+                }
+                Entry*& entry = added[key];
+                if (!entry) {
+                    entry = new Entry();
+                }
+                entry->writeLock()->construct(std::get<1>(forward<decltype(item)>(item)));
+            }
+            if (added.empty()) {
+                return;
+            }
+            Snapshot* next = new Snapshot();
+            next->reserve(current.size() + added.size());
+            std::merge(current.begin(), current.end(), added.begin(), added.end(), std::back_inserter(*next), [](const auto& a, const auto& b) {
+                return a.first < b.first;
+            });
+            publish(next);
         }
         // erase
-        void erase(const K& key) {
+        void erase(LookupKey<K> key) {
             destroy(key);
-            unique_lock lock(m_mapMutex);
-            // ASSERT(m_map.contains(key));
-            m_map.erase(key);
+            unique_lock lock(m_writeMutex);
+            const Snapshot& current = *m_snapshot.load(std::memory_order_relaxed);
+            auto it = lowerBound(current, key);
+            // entries re-emplaced in the meantime stay
+            if (it == current.end() || key < it->first || it->second->readLock(m_entryCounter)->isValid()) {
+                return;
+            }
+            Entry* entry = it->second;
+            Snapshot* next = new Snapshot();
+            next->reserve(current.size() - 1);
+            next->insert(next->end(), current.begin(), it);
+            next->insert(next->end(), it + 1, current.end());
+            publish(next);
+            retire(entry);
         }
         // clear
         void clear() {
-            {
-                shared_lock lock(m_mapMutex);
-                for (auto it = m_map.begin(); it != m_map.end(); ++it) {
-                    it->second.writeLock()->destroy();
-                }
-            }
-            unique_lock lock(m_mapMutex);
-            m_map.clear();
+            traverse(*this, [](const K&, WriteLocked<Storage<V>, Mutex>& locked) {
+                locked->destroy();
+                return true;
+            });
+            clean();
         }
 
         // destroy
-        void destroy(const K& key) {
-            shared_lock lock(m_mapMutex);
-            // ASSERT(m_map.contains(key));
-            m_map.at(key).writeLock()->destroy();
+        void destroy(LookupKey<K> key) {
+            auto guard = EpochDomain::instance().pin();
+            const Snapshot& current = *m_snapshot.load(std::memory_order_acquire);
+            auto it = lowerBound(current, key);
+            if (it != current.end() && !(key < it->first)) {
+                it->second->writeLock(m_entryCounter)->destroy();
+            }
         }
         // clean
         void clean() {
-            unique_lock lock(m_mapMutex);
-            auto it = m_map.begin();
-            while (it != m_map.end()) {
-                if (!it->second.readLock()->isValid()) {
-                    it = m_map.erase(it);
+            unique_lock lock(m_writeMutex);
+            const Snapshot& current = *m_snapshot.load(std::memory_order_relaxed);
+            Snapshot* next = new Snapshot();
+            List<Entry*> erased;
+            for (const auto& [key, entry] : current) {
+                if (entry->readLock(m_entryCounter)->isValid()) {
+                    next->emplace_back(key, entry);
                 }
                 else {
-                    ++it;
+                    erased.emplace_back(entry);
                 }
             }
-        } 
+            publish(next);
+            for (Entry* entry : erased) {
+                retire(entry);
+            }
+        }
 
-        // read / write lock
-        ReadLocked<V> readLock(const K& key) const {
-            shared_lock lock(m_mapMutex);
-            if (m_map.contains(key)) {
-                return m_map.at(key).readLock();
+        // read / write lock (the snapshot is only pinned until the entry is locked)
+        ReadLocked<V, Mutex> readLock(LookupKey<K> key) const {
+            auto guard = EpochDomain::instance().pin();
+            const Snapshot& current = *m_snapshot.load(std::memory_order_acquire);
+            auto it = lowerBound(current, key);
+            if (it != current.end() && !(key < it->first)) {
+                return static_cast<const Entry*>(it->second)->readLock(m_entryCounter);
             }
             return {};
         }
-        WriteLocked<V> writeLock(const K& key) {
-            shared_lock lock(m_mapMutex);
-            if (m_map.contains(key)) {
-                return m_map.at(key).writeLock();
+        WriteLocked<V, Mutex> writeLock(LookupKey<K> key) {
+            auto guard = EpochDomain::instance().pin();
+            const Snapshot& current = *m_snapshot.load(std::memory_order_acquire);
+            auto it = lowerBound(current, key);
+            if (it != current.end() && !(key < it->first)) {
+                return it->second->writeLock(m_entryCounter);
+            }
+            return {};
+        }
+        // readCopy (no lock at all: the snapshot is pinned by the epoch and the value copied optimistically, see SecureMap::readCopy)
+        Opt<V> readCopy(LookupKey<K> key) const requires std::is_trivially_copyable_v<V> && requires(const Mutex& mutex) { mutex.version(); } {
+            auto guard = EpochDomain::instance().pin();
+            const Snapshot& current = *m_snapshot.load(std::memory_order_acquire);
+            auto it = lowerBound(current, key);
+            if (it != current.end() && !(key < it->first)) {
+                Storage<V> storage = static_cast<const Entry*>(it->second)->readCopy();
+                if (storage.isValid()) {
+                    return storage.get();
+                }
             }
             return {};
         }
-        
+
+        // stats (only entry locks, lookups take no map lock)
+        MapStats stats() const override {
+#ifdef SAFEMAP_LOCK_STATS
+            return { {}, m_entryCounter.snapshot() };
+#else
+            return {};
+#endif
+        }
+
         // iterate
         // :: foreach
-        void forEach(function<void(const K&, WriteLocked<V>&)> func) {
-            typename Map<K, SecureValue<Storage<V>>>::iterator it;
-            WriteLocked<Storage<V>> locked;
-            {
-                shared_lock lock(m_mapMutex);
-                if (m_map.empty()) {
-                    return;
-                }
-                it = m_map.begin();
-                locked = it->second.writeLock();
+        // visits the snapshot current at the start, it stays pinned for the whole traversal,
+        // func may return false to stop early (see SecureMap::forEach)
+        template<typename Func>
+        bool forEach(Func&& func) {
+            if constexpr (std::is_invocable_v<Func&, const K&, WriteLocked<V, Mutex>&>) {
+                return traverse(*this, [&func](const K& key, WriteLocked<Storage<V>, Mutex>& locked) {
+                    return visit<WriteLocked<V, Mutex>>(func, key, locked);
+                });
             }
-            while (true) {
-                WriteLocked<V> locked_value;
-                if (locked->isValid()) {
-                    locked_value = move(locked);
-                    func(it->first, locked_value);
+            else {
+                return forEachRead(func);
+            }
+        }
+        template<typename Func>
+        bool forEach(Func&& func) const {
+            return traverse(*this, [&func](const K& key, ReadLocked<Storage<V>, Mutex>& locked) {
+                return visit<ReadLocked<V, Mutex>>(func, key, locked);
+            });
+        }
+        // :: foreach read
+        template<typename Func>
+        bool forEachRead(Func&& func) const {
+            return forEach(func);
+        }
+    private:
+        // types
+        using Entry = SecureValue<Storage<V>, Mutex>;
+        using Snapshot = List<std::pair<K, Entry*>>;
+
+        // lowerBound
+        static typename Snapshot::const_iterator lowerBound(const Snapshot& snapshot, LookupKey<K> key) {
+            return std::lower_bound(snapshot.begin(), snapshot.end(), key, [](const auto& entry, LookupKey<K> key) {
+                return entry.first < key;
+            });
+        }
+        // publish (requires the write mutex)
+        void publish(Snapshot* next) {
+            Snapshot* previous = m_snapshot.exchange(next, std::memory_order_acq_rel);
+            EpochDomain::instance().retire([previous]() {
+                delete previous;
+                return true;
+            });
+        }
+        // retire (an entry is only freed once nobody holds its lock anymore)
+        static void retire(Entry* entry) {
+            EpochDomain::instance().retire([entry]() {
+                auto [value, lock] = entry->writeLock(std::defer_lock);
+                if (!lock.try_lock()) {
+                    return false;
                 }
-                shared_lock lock(m_mapMutex);
-                if (++it == m_map.end()) {
-                    return;
+                lock.unlock();
+                delete entry;
+                return true;
+            });
+        }
+        // traverse (returns false if func returned false)
+        template<typename TSelf, typename Func>
+        static bool traverse(TSelf& self, Func func) {
+            auto guard = EpochDomain::instance().pin();
+            const Snapshot& current = *self.m_snapshot.load(std::memory_order_acquire);
+            for (const auto& [key, entry] : current) {
+                if constexpr (std::is_const_v<TSelf>) {
+                    ReadLocked<Storage<V>, Mutex> locked = static_cast<const Entry*>(entry)->readLock(self.m_entryCounter);
+                    if (!func(key, locked)) {
+                        return false;
+                    }
                 }
                 else {
-                    locked = it->second.writeLock();
+                    WriteLocked<Storage<V>, Mutex> locked = entry->writeLock(self.m_entryCounter);
+                    if (!func(key, locked)) {
+                        return false;
+                    }
                 }
             }
+            return true;
         }
-        void forEach(function<void(const K&, ReadLocked<V>&)> func) const {
-            typename Map<K, SecureValue<Storage<V>>>::const_iterator it;
-            ReadLocked<Storage<V>> locked;
-            {
-                shared_lock lock(m_mapMutex);
-                if (m_map.empty()) {
-                    return;
-                }
-                it = m_map.begin();
-                locked = it->second.readLock();
+        // visit (valid entries only, returns false if func returned false)
+        template<typename ValueLocked, typename Func, typename EntryLocked>
+        static bool visit(Func& func, const K& key, EntryLocked& locked) {
+            if (!locked->isValid()) {
+                return true;
             }
-            while (true) {
-                ReadLocked<V> locked_value;
-                if (locked->isValid()) {
-                    locked_value = move(locked);
-                    func(it->first, locked_value);
-                }
-                shared_lock lock(m_mapMutex);
-                if (++it == m_map.end()) {
-                    return;
-                }
-                else {
-                    locked = it->second.readLock();
-                }
+            ValueLocked value = move(locked);
+            if constexpr (std::is_same_v<std::invoke_result_t<Func&, const K&, ValueLocked&>, bool>) {
+                return func(key, value);
+            }
+            else {
+                func(key, value);
+                return true;
             }
         }
-    private:
-        // map
-        Map<K, SecureValue<Storage<V>>> m_map;
-        mutable shared_mutex m_mapMutex;
+
+        // snapshot
+        std::atomic<Snapshot*> m_snapshot;
+        mutex m_writeMutex;
+        // stats
+        [[no_unique_address]] mutable LockCounter m_entryCounter;
     };
 }
 
@@ -388,8 +4418,8 @@ namespace Memory {
     public:
         // constructor
         GenericView() = default;
-        template<typename V>
-        GenericView(const K& key, SecureMap<K, V>& map)
+        template<typename V, typename TPolicy>
+        GenericView(const K& key, SecureMap<K, V, TPolicy>& map)
             : m_key(key), m_map(static_cast<void*>(&map)) {}
         // key
         const K& key() const {
@@ -407,9 +4437,9 @@ namespace Memory {
         }
     
         // friend
-        template<typename K2, typename V2>
+        template<typename K2, typename V2, typename TPolicy2>
         friend class ReadView;
-        template<typename K2, typename V2>
+        template<typename K2, typename V2, typename TPolicy2>
         friend class WriteView;
     private:
         // member
@@ -418,141 +4448,345 @@ namespace Memory {
     };
 
     // WriteView
-    template<typename K, typename V>
+    template<typename K, typename V, typename TPolicy = MapPolicy>
     class WriteView {
     public:
         // constructor
         WriteView() = default;
         WriteView(const GenericView<K>& view)
-            : m_key(view.m_key), m_map(reinterpret_cast<SecureMap<K, V>*>(view.m_map)) {}
-        WriteView(const K& key, SecureMap<K, V>& map)
+            : m_key(view.m_key), m_map(reinterpret_cast<SecureMap<K, V, TPolicy>*>(view.m_map)) {}
+        WriteView(const K& key, SecureMap<K, V, TPolicy>& map)
             : m_key(key), m_map(&map) {}
 
         // key
         const K& key() const {
             return m_key;
         }
-        // operator->
+        // operator-> (resolves the key once, later dereferences only lock the entry under the shared map lock, empty once destroyed)
         auto operator->() {
-            return m_map->writeLock(m_key); 
+            return m_map->writeLock(m_key, m_handle);
+        }
+        // try lock / lock for
+        auto tryLock() {
+            return m_map->tryWriteLock(m_key);
+        }
+        template<typename Rep, typename Period>
+        auto lockFor(const std::chrono::duration<Rep, Period>& timeout) {
+            return m_map->writeLockFor(m_key, timeout);
         }
         // compare
-        bool operator==(const WriteView<K, V>& other) const {
+        bool operator==(const WriteView<K, V, TPolicy>& other) const {
             return m_key == other.m_key;
         }
-        bool operator<(const WriteView<K, V>& other) const {
+        bool operator<(const WriteView<K, V, TPolicy>& other) const {
             return m_key < other.m_key;
         }
-        bool operator>(const WriteView<K, V>& other) const {
+        bool operator>(const WriteView<K, V, TPolicy>& other) const {
             return m_key > other.m_key;
         }
 
         // friend
-        template<typename K2, typename V2>
+        template<typename K2, typename V2, typename TPolicy2>
         friend class ReadView;
     private:
         // member
         K m_key;
-        SecureMap<K, V>* m_map = nullptr;
+        SecureMap<K, V, TPolicy>* m_map = nullptr;
+        typename SecureMap<K, V, TPolicy>::WriteHandle m_handle;
     };
     // ReadView
-    template<typename K, typename V>
+    template<typename K, typename V, typename TPolicy = MapPolicy>
     class ReadView {
     public:
         // constructor
         ReadView() = default;
         ReadView(const GenericView<K>& view)
-            : m_key(view.m_key), m_map(reinterpret_cast<const SecureMap<K, V>*>(view.m_map)) {}
-        ReadView(const WriteView<K, V>& view)
-            : m_key(view.m_key), m_map(view.m_map) {}
-        ReadView(const K& key, const SecureMap<K, V>& map)
+            : m_key(view.m_key), m_map(reinterpret_cast<const SecureMap<K, V, TPolicy>*>(view.m_map)) {}
+        ReadView(const WriteView<K, V, TPolicy>& view)
+            : m_key(view.m_key), m_map(view.m_map), m_handle{ view.m_handle.entry, view.m_handle.key, view.m_handle.generation } {}
+        ReadView(const K& key, const SecureMap<K, V, TPolicy>& map)
             : m_key(key), m_map(&map) {}
 
         // key
         const K& key() const {
             return m_key;
         }
-        // operator->
+        // operator-> (resolves the key once, later dereferences only lock the entry under the shared map lock, empty once destroyed)
         auto operator->() {
-            return m_map->readLock(m_key); 
+            return m_map->readLock(m_key, m_handle);
+        }
+        // try lock / lock for
+        auto tryLock() {
+            return m_map->tryReadLock(m_key);
+        }
+        template<typename Rep, typename Period>
+        auto lockFor(const std::chrono::duration<Rep, Period>& timeout) {
+            return m_map->readLockFor(m_key, timeout);
         }
         // compare
-        bool operator==(const ReadView<K, V>& other) const {
+        bool operator==(const ReadView<K, V, TPolicy>& other) const {
             return m_key == other.m_key;
         }
-        bool operator<(const ReadView<K, V>& other) const {
+        bool operator<(const ReadView<K, V, TPolicy>& other) const {
             return m_key < other.m_key;
         }
-        bool operator>(const ReadView<K, V>& other) const {
+        bool operator>(const ReadView<K, V, TPolicy>& other) const {
             return m_key > other.m_key;
         }
     private:
         // member
         K m_key;
-        const SecureMap<K, V>* m_map = nullptr;
+        const SecureMap<K, V, TPolicy>* m_map = nullptr;
+        typename SecureMap<K, V, TPolicy>::ReadHandle m_handle;
     };
 }
 
 // #include "collection.hpp" (HPPMERGE)
 namespace Memory {
-    // Collection
-    template<typename K>
-    class Collection {
+    // CollectionBase
+    // forwards every operation to the SecureMap of the value type, TDerived provides get<V>()
+    template<typename TDerived, typename K, typename TPolicy>
+    class CollectionBase {
     public:
+        // types
+        using Mutex = typename TPolicy::Mutex;
+
         // emplace
         template<typename V, typename... Args>
         void emplace(const K& key, Args&&... args) {
-            get<V>().emplace(key, forward<Args>(args)...);
+            derived().template get<V>().emplace(key, forward<Args>(args)...);
         }
         // erase
         template<typename V>
-        void erase(const K& key) {
-            get<V>().erase(key);
+        void erase(LookupKey<K> key) {
+            derived().template get<V>().erase(key);
+        }
+        // emplace / assign / erase many
+        template<typename V, typename TRange>
+        void emplaceMany(TRange&& items) {
+            derived().template get<V>().emplaceMany(forward<TRange>(items));
+        }
+        template<typename V, typename TRange>
+        void assignMany(TRange&& items) {
+            derived().template get<V>().assignMany(forward<TRange>(items));
+        }
+        template<typename V, typename TRange>
+        void eraseMany(const TRange& keys) {
+            derived().template get<V>().eraseMany(keys);
         }
         // clear
         template<typename V>
         void clear() {
-            get<V>().clear();
+            derived().template get<V>().clear();
+        }
+
+        // read-modify-write (see SecureMap::update)
+        template<typename V, typename Func>
+        bool update(LookupKey<K> key, Func func) {
+            return derived().template get<V>().update(key, move(func));
+        }
+        template<typename V, typename Func, typename... Args>
+        bool upsert(LookupKey<K> key, Func func, Args&&... args) {
+            return derived().template get<V>().upsert(key, move(func), forward<Args>(args)...);
+        }
+        template<typename V, typename Factory>
+        WriteLocked<V, Mutex> computeIfAbsent(LookupKey<K> key, Factory factory) {
+            return derived().template get<V>().computeIfAbsent(key, move(factory));
+        }
+        template<typename V, typename Pred>
+        bool eraseIf(LookupKey<K> key, Pred pred) {
+            return derived().template get<V>().eraseIf(key, move(pred));
         }
 
         // destroy
         template<typename V>
-        void destroy(const K& key) {
-            get<V>().destroy(key);
+        void destroy(LookupKey<K> key) {
+            derived().template get<V>().destroy(key);
         }
         // clean
         template<typename V>
         void clean() {
-            get<V>().clean();
+            derived().template get<V>().clean();
         } 
+        template<typename V>
+        address cleanStep(address count) {
+            return derived().template get<V>().cleanStep(count);
+        }
 
         // read / write lock
         template<typename V>
-        ReadLocked<V> readLock(const K& key) const {
-            return get<V>().readLock(key);
+        ReadLocked<V, Mutex> readLock(LookupKey<K> key) const {
+            return derived().template get<V>().readLock(key);
+        }
+        template<typename V>
+        WriteLocked<V, Mutex> writeLock(LookupKey<K> key) {
+            return derived().template get<V>().writeLock(key);
+        }
+        // upgrade lock (see SecureMap::upgradeLock)
+        template<typename V>
+        UpgradeLocked<V, Mutex> upgradeLock(LookupKey<K> key) {
+            return derived().template get<V>().upgradeLock(key);
+        }
+        // try read / write lock
+        template<typename V>
+        LockAttempt<ReadLocked<V, Mutex>> tryReadLock(LookupKey<K> key) const {
+            return derived().template get<V>().tryReadLock(key);
+        }
+        template<typename V>
+        LockAttempt<WriteLocked<V, Mutex>> tryWriteLock(LookupKey<K> key) {
+            return derived().template get<V>().tryWriteLock(key);
+        }
+        // read / write lock for
+        template<typename V, typename Rep, typename Period>
+        LockAttempt<ReadLocked<V, Mutex>> readLockFor(LookupKey<K> key, const std::chrono::duration<Rep, Period>& timeout) const {
+            return derived().template get<V>().readLockFor(key, timeout);
+        }
+        template<typename V, typename Rep, typename Period>
+        LockAttempt<WriteLocked<V, Mutex>> writeLockFor(LookupKey<K> key, const std::chrono::duration<Rep, Period>& timeout) {
+            return derived().template get<V>().writeLockFor(key, timeout);
+        }
+        // read / write lock async (see SecureMap::writeLockAsync)
+        template<typename V, typename TExecutor>
+        auto readLockAsync(LookupKey<K> key, TExecutor& executor) const {
+            return derived().template get<V>().readLockAsync(key, executor);
+        }
+        template<typename V, typename TExecutor>
+        auto writeLockAsync(LookupKey<K> key, TExecutor& executor) {
+            return derived().template get<V>().writeLockAsync(key, executor);
+        }
+        // read / write lock many (across value types, entries are locked by key and then by type)
+        template<typename... Vs, typename TRange>
+        LockSet<K, shared_lock<Mutex>> readLockMany(const TRange& keys) const {
+            return lockMany<LockSet<K, shared_lock<Mutex>>, Vs...>(derived(), keys);
+        }
+        template<typename... Vs, typename TRange>
+        LockSet<K, unique_lock<Mutex>> writeLockMany(const TRange& keys) {
+            return lockMany<LockSet<K, unique_lock<Mutex>>, Vs...>(derived(), keys);
+        }
+        // readCopy
+        template<typename V>
+        Opt<V> readCopy(LookupKey<K> key) const {
+            return derived().template get<V>().readCopy(key);
+        }
+
+        // change log (of one value type, see SecureMap::enableChangeLog)
+        template<typename V>
+        ChangeLog<K>& enableChangeLog(address capacity = 1 << 16) {
+            return derived().template get<V>().enableChangeLog(capacity);
+        }
+        template<typename V>
+        ChangeLog<K>* changeLog() const {
+            return derived().template get<V>().changeLog();
+        }
+
+        // save / load (snapshot of one value type, see SecureMap::save)
+        template<typename V>
+        void save(const string& path) const {
+            derived().template get<V>().save(path);
+        }
+        template<typename V>
+        void save(const string& path, ThreadPool& pool) const {
+            derived().template get<V>().save(path, pool);
+        }
+        template<typename V>
+        void load(const string& path) {
+            derived().template get<V>().load(path);
+        }
+
+        // parallel foreach
+        template<typename V>
+        void parallelForEach(function<void(const K&, WriteLocked<V, Mutex>&)> func, ThreadPool& pool) {
+            derived().template get<V>().parallelForEach(move(func), pool);
         }
         template<typename V>
-        WriteLocked<V> writeLock(const K& key) {
-            return get<V>().writeLock(key);
+        void parallelForEach(function<void(const K&, ReadLocked<V, Mutex>&)> func, ThreadPool& pool) const {
+            derived().template get<V>().parallelForEach(move(func), pool);
+        }
+    protected:
+        // derived
+        TDerived& derived() {
+            return static_cast<TDerived&>(*this);
+        }
+        const TDerived& derived() const {
+            return static_cast<const TDerived&>(*this);
+        }
+
+        // lockMany
+        // the map locks are taken shared in type order for the lookup pass, then the entries are locked
+        template<typename TSet, typename... Vs, typename TSelf, typename TRange>
+        static TSet lockMany(TSelf& self, const TRange& keys) {
+            List<std::pair<address, MapMutex*>> mutexes = { { typeid(Vs).hash_code(), &self.template get<Vs>().m_mapMutex }... };
+            std::sort(mutexes.begin(), mutexes.end());
+            mutexes.erase(std::unique(mutexes.begin(), mutexes.end()), mutexes.end());
+            List<shared_lock<MapMutex>> locks;
+            for (auto& [type, mutex] : mutexes) {
+                locks.emplace_back(*mutex);
+            }
+            TSet set;
+            (SecureMap<K, Vs, TPolicy>::collect(self.template get<Vs>(), set, keys), ...);
+            set.acquire();
+            return set;
+        }
+    };
+
+    // Collection
+    // value types are registered at runtime, every type gets a static slot index,
+    // so get<V>() is an indexed load without lock once the type was added
+    template<typename K, typename TPolicy = MapPolicy>
+    class Collection : public CollectionBase<Collection<K, TPolicy>, K, TPolicy> {
+    public:
+        // constructor / destructor
+        Collection() = default;
+        ~Collection() {
+            for (auto& chunk : m_chunks) {
+                delete chunk.load(std::memory_order_relaxed);
+            }
         }
-        
-        // addType
+        // copy
+        Collection(const Collection&) = delete;
+        // copy assign
+        Collection& operator=(const Collection&) = delete;
+
+        // addType (slow path, publishes the new map into the slot of its type)
         template<typename V>
         void addType() {
+            address index = typeIndex<V>();
+            if (index >= ChunkCount * ChunkSize) {
+                throw std::length_error("Collection::addType");
+            }
             unique_lock lock(m_mapMutex);
-            m_map.try_emplace(typeid(V).hash_code(), static_cast<ISecureMap*>(new SecureMap<K, V>()));
+            // the map is only constructed for a new type
+            if (m_map.contains(typeid(V).hash_code())) {
+                return;
+            }
+            auto it = m_map.emplace(typeid(V).hash_code(), make_unique<SecureMap<K, V, TPolicy>>()).first;
+            m_names.try_emplace(typeid(V).hash_code(), typeid(V).name());
+            Chunk* chunk = m_chunks[index / ChunkSize].load(std::memory_order_relaxed);
+            if (!chunk) {
+                chunk = new Chunk();
+                m_chunks[index / ChunkSize].store(chunk, std::memory_order_release);
+            }
+            chunk->maps[index % ChunkSize].store(it->second.get(), std::memory_order_release);
         }
 
-        // get
-        template<typename V>
-        SecureMap<K, V>& get() {
+        // stats (per value type, zero unless compiled with SAFEMAP_LOCK_STATS)
+        Map<string, MapStats> stats() const {
             shared_lock lock(m_mapMutex);
-            return *reinterpret_cast<SecureMap<K, V>*>(m_map.at(typeid(V).hash_code()).get());
+            Map<string, MapStats> stats;
+            for (const auto& [type, map] : m_map) {
+                stats[m_names.at(type)] += map->stats();
+            }
+            return stats;
         }
+
+        // get (throws out_of_range if the type was not added)
         template<typename V>
-        const SecureMap<K, V>& get() const {
-            shared_lock lock(m_mapMutex);
-            return *reinterpret_cast<SecureMap<K, V>*>(m_map.at(typeid(V).hash_code()).get());
+        SecureMap<K, V, TPolicy>& get() {
+            return *static_cast<SecureMap<K, V, TPolicy>*>(find(typeIndex<V>()));
+        }
+        template<typename V>
+        const SecureMap<K, V, TPolicy>& get() const {
+            return *static_cast<const SecureMap<K, V, TPolicy>*>(find(typeIndex<V>()));
         }
 
         // // iterate
@@ -575,8 +4809,66 @@ namespace Memory {
         //     return m_map.end();
         // }
     private:
-        // map
+        // Chunk (slots are allocated in chunks, published chunks and maps never move)
+        static constexpr address ChunkSize = 64;
+        static constexpr address ChunkCount = 64;
+        struct Chunk {
+            Array<std::atomic<ISecureMap*>, ChunkSize> maps;
+        };
+
+        // typeIndex (per value type, assigned on first use)
+        template<typename V>
+        static address typeIndex() {
+            static const address index = s_typeCount++;
+            return index;
+        }
+        // find
+        ISecureMap* find(address index) const {
+            if (index < ChunkCount * ChunkSize) {
+                if (Chunk* chunk = m_chunks[index / ChunkSize].load(std::memory_order_acquire)) {
+                    if (ISecureMap* map = chunk->maps[index % ChunkSize].load(std::memory_order_acquire)) {
+                        return map;
+                    }
+                }
+            }
+            throw std::out_of_range("Collection::get");
+        }
+
+        // slots
+        Array<std::atomic<Chunk*>, ChunkCount> m_chunks = {};
+        inline static atomic_address s_typeCount = 0;
+        // map (owns the maps, by type hash)
         Map<address, unique_ptr<ISecureMap>> m_map;
+        Map<address, string> m_names;
         mutable shared_mutex m_mapMutex;
     };
+
+    // BasicStaticCollection
+    // value types are fixed at compile time, the maps are members and get<V>() resolves statically
+    template<typename K, typename TPolicy, typename... Ts>
+    class BasicStaticCollection : public CollectionBase<BasicStaticCollection<K, TPolicy, Ts...>, K, TPolicy> {
+    public:
+        // stats (per value type, zero unless compiled with SAFEMAP_LOCK_STATS)
+        Map<string, MapStats> stats() const {
+            Map<string, MapStats> stats;
+            ((stats[typeid(Ts).name()] += get<Ts>().stats()), ...);
+            return stats;
+        }
+
+        // get
+        template<typename V>
+        SecureMap<K, V, TPolicy>& get() {
+            return std::get<SecureMap<K, V, TPolicy>>(m_maps);
+        }
+        template<typename V>
+        const SecureMap<K, V, TPolicy>& get() const {
+            return std::get<SecureMap<K, V, TPolicy>>(m_maps);
+        }
+    private:
+        // maps
+        std::tuple<SecureMap<K, Ts, TPolicy>...> m_maps;
+    };
+    // StaticCollection
+    template<typename K, typename... Ts>
+    using StaticCollection = BasicStaticCollection<K, MapPolicy, Ts...>;
 }
\ No newline at end of file
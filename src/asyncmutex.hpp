@@ -0,0 +1,154 @@
+#pragma once
+#include "common.hpp"
+#include "common_thread.hpp"
+
+namespace Memory {
+    // AsyncWaiter
+    // queue node of a pending AsyncMutex acquisition, grant is called once the lock was handed over
+    struct AsyncWaiter {
+        AsyncWaiter* next = nullptr;
+        bool exclusive = false;
+        // blocking waiters are granted under the internal guard, coroutine waiters after it was released
+        bool blocking = false;
+        void (*grant)(AsyncWaiter*) = nullptr;
+    };
+
+    // AsyncMutex
+    // reader-writer lock with a FIFO wait queue, a release hands the lock directly to the next waiters,
+    // so coroutines can wait for an entry without occupying a thread (see SecureMap::writeLockAsync)
+    class AsyncMutex {
+    public:
+        // constructor
+        AsyncMutex() = default;
+        // copy
+        AsyncMutex(const AsyncMutex&) = delete;
+        // copy assign
+        AsyncMutex& operator=(const AsyncMutex&) = delete;
+
+        // lock / unlock
+        void lock() {
+            wait(true);
+        }
+        bool try_lock() {
+            unique_lock guard(m_guard);
+            if (m_head || m_writer || m_readers) {
+                return false;
+            }
+            m_writer = true;
+            return true;
+        }
+        void unlock() {
+            release(true);
+        }
+        // lock / unlock shared
+        void lock_shared() {
+            wait(false);
+        }
+        bool try_lock_shared() {
+            unique_lock guard(m_guard);
+            if (m_head || m_writer) {
+                return false;
+            }
+            ++m_readers;
+            return true;
+        }
+        void unlock_shared() {
+            release(false);
+        }
+
+        // lock async (true if the lock was free, otherwise the waiter is queued and granted later)
+        bool lockAsync(AsyncWaiter& waiter) {
+            unique_lock guard(m_guard);
+            return acquire(waiter);
+        }
+    private:
+        // BlockingWaiter
+        struct BlockingWaiter {
+            AsyncWaiter node;
+            std::atomic_bool granted = false;
+        };
+
+        // acquire (requires the guard, waiters queue up behind earlier ones even if the lock is free for them)
+        bool acquire(AsyncWaiter& waiter) {
+            if (!m_head && !m_writer && (!waiter.exclusive || m_readers == 0)) {
+                if (waiter.exclusive) {
+                    m_writer = true;
+                }
+                else {
+                    ++m_readers;
+                }
+                return true;
+            }
+            waiter.next = nullptr;
+            (m_tail ? m_tail->next : m_head) = &waiter;
+            m_tail = &waiter;
+            return false;
+        }
+        // wait (blocks the calling thread until the lock is handed over)
+        void wait(bool exclusive) {
+            BlockingWaiter waiter;
+            waiter.node.exclusive = exclusive;
+            waiter.node.blocking = true;
+            waiter.node.grant = [](AsyncWaiter* node) {
+                auto* self = reinterpret_cast<BlockingWaiter*>(node);
+                self->granted.store(true, std::memory_order_release);
+                self->granted.notify_one();
+            };
+            {
+                unique_lock guard(m_guard);
+                if (acquire(waiter.node)) {
+                    return;
+                }
+            }
+            waiter.granted.wait(false, std::memory_order_acquire);
+            // the grant ran under the guard, once we get it the notify is done and the waiter may go away
+            unique_lock guard(m_guard);
+        }
+        // release (hands the lock to the waiters at the front: one writer or a run of readers)
+        void release(bool exclusive) {
+            AsyncWaiter* granted = nullptr;
+            {
+                unique_lock guard(m_guard);
+                if (exclusive) {
+                    m_writer = false;
+                }
+                else {
+                    --m_readers;
+                }
+                while (m_head && !m_writer && (!m_head->exclusive || m_readers == 0)) {
+                    AsyncWaiter* waiter = m_head;
+                    m_head = waiter->next;
+                    if (!m_head) {
+                        m_tail = nullptr;
+                    }
+                    if (waiter->exclusive) {
+                        m_writer = true;
+                    }
+                    else {
+                        ++m_readers;
+                    }
+                    if (waiter->blocking) {
+                        waiter->grant(waiter);
+                    }
+                    else {
+                        waiter->next = granted;
+                        granted = waiter;
+                    }
+                }
+            }
+            // coroutine waiters may resume inline and lock this mutex again
+            while (granted) {
+                AsyncWaiter* next = granted->next;
+                granted->grant(granted);
+                granted = next;
+            }
+        }
+
+        // member
+        mutex m_guard;
+        uint32 m_readers = 0;
+        bool m_writer = false;
+        AsyncWaiter* m_head = nullptr;
+        AsyncWaiter* m_tail = nullptr;
+    };
+}
\ No newline at end of file
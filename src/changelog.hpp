@@ -0,0 +1,197 @@
+#pragma once
+#include "lock.hpp"
+#include "rwlock.hpp"
+#include <bit> // bit_ceil
+#include <cstring> // memcpy
+
+namespace Memory {
+    // ChangeKind
+    enum class ChangeKind : uint8 {
+        Insert, Erase, Destroy, Write
+    };
+    // Change
+    template<typename K>
+    struct Change {
+        uint64 sequence = 0;
+        ChangeKind kind = ChangeKind::Insert;
+        K key = K();
+    };
+
+    // ChangeLog
+    // bounded ring of the latest changes of a map, writers claim a sequence number and never wait for subscribers,
+    // every subscriber reads at its own position and learns when it fell behind by more than the capacity,
+    // slots are stamped with the sequence they hold: a writer claims its slot with a compare exchange and never
+    // replaces a newer sequence (it only waits for a writer one lap older that is still copying into the same slot),
+    // trivially copyable keys are stored as atomic words and validated by the stamp, other keys are copied under a slot mutex
+    template<typename K>
+    class ChangeLog : public IWriteObserver {
+    public:
+        // Subscriber (read position in the log)
+        class Subscriber {
+        public:
+            // sequence (of the next change to read)
+            uint64 sequence() const {
+                return m_next;
+            }
+
+            // friend
+            friend class ChangeLog;
+        private:
+            // constructor
+            Subscriber(uint64 next)
+                : m_next(next) {}
+
+            // member
+            uint64 m_next;
+        };
+
+        // constructor (capacity is rounded up to a power of two)
+        explicit ChangeLog(address capacity)
+            : m_slots(std::bit_ceil(std::max<address>(capacity, 2))), m_mask(m_slots.size() - 1) {
+            // slots start out written by the lap before the first one, so they read as not yet written
+            for (address i = 0; i < m_slots.size(); ++i) {
+                m_slots[i].stamp.store(2 * i, std::memory_order_relaxed);
+            }
+        }
+        // copy
+        ChangeLog(const ChangeLog&) = delete;
+        // copy assign
+        ChangeLog& operator=(const ChangeLog&) = delete;
+
+        // record
+        void record(ChangeKind kind, const K& key) {
+            uint64 sequence = m_head.fetch_add(1, std::memory_order_relaxed);
+            Slot& slot = m_slots[sequence & m_mask];
+            uint64 stamp = stampOf(sequence);
+            uint64 current = slot.stamp.load(std::memory_order_relaxed);
+            while (true) {
+                if (current >= stamp) {
+                    // a writer one lap ahead already took the slot, subscribers see this change as overwritten
+                    return;
+                }
+                if (current & 1) {
+                    std::this_thread::yield();
+                    current = slot.stamp.load(std::memory_order_relaxed);
+                    continue;
+                }
+                if (slot.stamp.compare_exchange_weak(current, stamp | 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            // the odd stamp must be visible before any payload write (see SeqMutex::begin)
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.kind.store(kind, std::memory_order_relaxed);
+            if constexpr (IsAtomicKey) {
+                Array<uint64, KeyWords> words = {};
+                std::memcpy(words.data(), &key, sizeof(K));
+                for (address i = 0; i < KeyWords; ++i) {
+                    slot.key[i].store(words[i], std::memory_order_relaxed);
+                }
+            }
+            else {
+                unique_lock lock(slot.mutex);
+                slot.key = key;
+            }
+            slot.stamp.store(stamp, std::memory_order_release);
+        }
+        // onWrite (see Locked::observe)
+        void onWrite(const void* key) override {
+            record(ChangeKind::Write, *static_cast<const K*>(key));
+        }
+
+        // subscribe (the subscriber sees the changes recorded from now on)
+        Subscriber subscribe() const {
+            return Subscriber(m_head.load(std::memory_order_acquire));
+        }
+        // poll
+        // appends up to count changes in sequence order, returns false if changes were overwritten before
+        // the subscriber read them (it then continues with the oldest change still held, a full scan resyncs)
+        bool poll(Subscriber& subscriber, List<Change<K>>& out, address count = ~address(0)) const {
+            bool complete = true;
+            uint64 head = m_head.load(std::memory_order_acquire);
+            if (head - subscriber.m_next > m_slots.size()) {
+                subscriber.m_next = head - m_slots.size();
+                complete = false;
+            }
+            for (address taken = 0; taken < count && subscriber.m_next < head;) {
+                Change<K> change;
+                change.sequence = subscriber.m_next;
+                int64 lap = read(m_slots[subscriber.m_next & m_mask], change);
+                if (lap < 0) {
+                    // claimed, but not written yet
+                    break;
+                }
+                if (lap > 0) {
+                    subscriber.m_next = std::max(subscriber.m_next + 1, m_head.load(std::memory_order_acquire) - m_slots.size());
+                    complete = false;
+                    continue;
+                }
+                out.emplace_back(move(change));
+                ++subscriber.m_next;
+                ++taken;
+            }
+            return complete;
+        }
+
+        // capacity
+        address capacity() const {
+            return m_slots.size();
+        }
+    private:
+        // types
+        static constexpr bool IsAtomicKey = std::is_trivially_copyable_v<K>;
+        static constexpr address KeyWords = (sizeof(K) + sizeof(uint64) - 1) / sizeof(uint64);
+        struct Unguarded {};
+
+        // Slot (stamp is 2 * (sequence + capacity) once written, odd while being written)
+        struct alignas(64) Slot {
+            atomic_uint64 stamp;
+            std::atomic<ChangeKind> kind;
+            std::conditional_t<IsAtomicKey, Array<atomic_uint64, KeyWords>, K> key;
+            [[no_unique_address]] mutable std::conditional_t<IsAtomicKey, Unguarded, CompactMutex> mutex;
+        };
+
+        // stampOf (sequences are shifted by one lap, so the initial stamps are older than every real one)
+        uint64 stampOf(uint64 sequence) const {
+            return 2 * (sequence + m_slots.size());
+        }
+        // read
+        // compares the slot with the sequence of change (0 and change filled, < 0 not written yet, > 0 overwritten),
+        // the copy only counts if the stamp did not move while it was taken
+        int64 read(const Slot& slot, Change<K>& change) const {
+            uint64 expected = stampOf(change.sequence);
+            while (true) {
+                uint64 before = slot.stamp.load(std::memory_order_acquire);
+                if ((before | 1) == (expected | 1)) {
+                    if (before & 1) {
+                        return -1;
+                    }
+                }
+                else {
+                    return before < expected ? -1 : 1;
+                }
+                change.kind = slot.kind.load(std::memory_order_relaxed);
+                if constexpr (IsAtomicKey) {
+                    Array<uint64, KeyWords> words;
+                    for (address i = 0; i < KeyWords; ++i) {
+                        words[i] = slot.key[i].load(std::memory_order_relaxed);
+                    }
+                    std::memcpy(static_cast<void*>(&change.key), words.data(), sizeof(K));
+                }
+                else {
+                    shared_lock lock(slot.mutex);
+                    change.key = slot.key;
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.stamp.load(std::memory_order_relaxed) == before) {
+                    return 0;
+                }
+            }
+        }
+
+        // member
+        List<Slot> m_slots;
+        address m_mask;
+        atomic_uint64 m_head = 0;
+    };
+}
\ No newline at end of file
@@ -1,65 +1,252 @@
 #pragma once
 #include "map.hpp"
+#include <stdexcept> // out_of_range, length_error
 
 namespace Memory {
-    // Collection
-    template<typename K>
-    class Collection {
+    // CollectionBase
+    // forwards every operation to the SecureMap of the value type, TDerived provides get<V>()
+    template<typename TDerived, typename K, typename TPolicy>
+    class CollectionBase {
     public:
+        // types
+        using Mutex = typename TPolicy::Mutex;
+
         // emplace
         template<typename V, typename... Args>
         void emplace(const K& key, Args&&... args) {
-            get<V>().emplace(key, forward<Args>(args)...);
+            derived().template get<V>().emplace(key, forward<Args>(args)...);
         }
         // erase
         template<typename V>
-        void erase(const K& key) {
-            get<V>().erase(key);
+        void erase(LookupKey<K> key) {
+            derived().template get<V>().erase(key);
+        }
+        // emplace / assign / erase many
+        template<typename V, typename TRange>
+        void emplaceMany(TRange&& items) {
+            derived().template get<V>().emplaceMany(forward<TRange>(items));
+        }
+        template<typename V, typename TRange>
+        void assignMany(TRange&& items) {
+            derived().template get<V>().assignMany(forward<TRange>(items));
+        }
+        template<typename V, typename TRange>
+        void eraseMany(const TRange& keys) {
+            derived().template get<V>().eraseMany(keys);
         }
         // clear
         template<typename V>
         void clear() {
-            get<V>().clear();
+            derived().template get<V>().clear();
+        }
+
+        // read-modify-write (see SecureMap::update)
+        template<typename V, typename Func>
+        bool update(LookupKey<K> key, Func func) {
+            return derived().template get<V>().update(key, move(func));
+        }
+        template<typename V, typename Func, typename... Args>
+        bool upsert(LookupKey<K> key, Func func, Args&&... args) {
+            return derived().template get<V>().upsert(key, move(func), forward<Args>(args)...);
+        }
+        template<typename V, typename Factory>
+        WriteLocked<V, Mutex> computeIfAbsent(LookupKey<K> key, Factory factory) {
+            return derived().template get<V>().computeIfAbsent(key, move(factory));
+        }
+        template<typename V, typename Pred>
+        bool eraseIf(LookupKey<K> key, Pred pred) {
+            return derived().template get<V>().eraseIf(key, move(pred));
         }
 
         // destroy
         template<typename V>
-        void destroy(const K& key) {
-            get<V>().destroy(key);
+        void destroy(LookupKey<K> key) {
+            derived().template get<V>().destroy(key);
         }
         // clean
         template<typename V>
         void clean() {
-            get<V>().clean();
+            derived().template get<V>().clean();
         } 
+        template<typename V>
+        address cleanStep(address count) {
+            return derived().template get<V>().cleanStep(count);
+        }
 
         // read / write lock
         template<typename V>
-        ReadLocked<V> readLock(const K& key) const {
-            return get<V>().readLock(key);
+        ReadLocked<V, Mutex> readLock(LookupKey<K> key) const {
+            return derived().template get<V>().readLock(key);
+        }
+        template<typename V>
+        WriteLocked<V, Mutex> writeLock(LookupKey<K> key) {
+            return derived().template get<V>().writeLock(key);
+        }
+        // upgrade lock (see SecureMap::upgradeLock)
+        template<typename V>
+        UpgradeLocked<V, Mutex> upgradeLock(LookupKey<K> key) {
+            return derived().template get<V>().upgradeLock(key);
+        }
+        // try read / write lock
+        template<typename V>
+        LockAttempt<ReadLocked<V, Mutex>> tryReadLock(LookupKey<K> key) const {
+            return derived().template get<V>().tryReadLock(key);
+        }
+        template<typename V>
+        LockAttempt<WriteLocked<V, Mutex>> tryWriteLock(LookupKey<K> key) {
+            return derived().template get<V>().tryWriteLock(key);
+        }
+        // read / write lock for
+        template<typename V, typename Rep, typename Period>
+        LockAttempt<ReadLocked<V, Mutex>> readLockFor(LookupKey<K> key, const std::chrono::duration<Rep, Period>& timeout) const {
+            return derived().template get<V>().readLockFor(key, timeout);
+        }
+        template<typename V, typename Rep, typename Period>
+        LockAttempt<WriteLocked<V, Mutex>> writeLockFor(LookupKey<K> key, const std::chrono::duration<Rep, Period>& timeout) {
+            return derived().template get<V>().writeLockFor(key, timeout);
+        }
+        // read / write lock async (see SecureMap::writeLockAsync)
+        template<typename V, typename TExecutor>
+        auto readLockAsync(LookupKey<K> key, TExecutor& executor) const {
+            return derived().template get<V>().readLockAsync(key, executor);
+        }
+        template<typename V, typename TExecutor>
+        auto writeLockAsync(LookupKey<K> key, TExecutor& executor) {
+            return derived().template get<V>().writeLockAsync(key, executor);
+        }
+        // read / write lock many (across value types, entries are locked by key and then by type)
+        template<typename... Vs, typename TRange>
+        LockSet<K, shared_lock<Mutex>> readLockMany(const TRange& keys) const {
+            return lockMany<LockSet<K, shared_lock<Mutex>>, Vs...>(derived(), keys);
+        }
+        template<typename... Vs, typename TRange>
+        LockSet<K, unique_lock<Mutex>> writeLockMany(const TRange& keys) {
+            return lockMany<LockSet<K, unique_lock<Mutex>>, Vs...>(derived(), keys);
+        }
+        // readCopy
+        template<typename V>
+        Opt<V> readCopy(LookupKey<K> key) const {
+            return derived().template get<V>().readCopy(key);
         }
+
+        // change log (of one value type, see SecureMap::enableChangeLog)
         template<typename V>
-        WriteLocked<V> writeLock(const K& key) {
-            return get<V>().writeLock(key);
+        ChangeLog<K>& enableChangeLog(address capacity = 1 << 16) {
+            return derived().template get<V>().enableChangeLog(capacity);
         }
-        
-        // addType
+        template<typename V>
+        ChangeLog<K>* changeLog() const {
+            return derived().template get<V>().changeLog();
+        }
+
+        // save / load (snapshot of one value type, see SecureMap::save)
+        template<typename V>
+        void save(const string& path) const {
+            derived().template get<V>().save(path);
+        }
+        template<typename V>
+        void save(const string& path, ThreadPool& pool) const {
+            derived().template get<V>().save(path, pool);
+        }
+        template<typename V>
+        void load(const string& path) {
+            derived().template get<V>().load(path);
+        }
+
+        // parallel foreach
+        template<typename V>
+        void parallelForEach(function<void(const K&, WriteLocked<V, Mutex>&)> func, ThreadPool& pool) {
+            derived().template get<V>().parallelForEach(move(func), pool);
+        }
+        template<typename V>
+        void parallelForEach(function<void(const K&, ReadLocked<V, Mutex>&)> func, ThreadPool& pool) const {
+            derived().template get<V>().parallelForEach(move(func), pool);
+        }
+    protected:
+        // derived
+        TDerived& derived() {
+            return static_cast<TDerived&>(*this);
+        }
+        const TDerived& derived() const {
+            return static_cast<const TDerived&>(*this);
+        }
+
+        // lockMany
+        // the map locks are taken shared in type order for the lookup pass, then the entries are locked
+        template<typename TSet, typename... Vs, typename TSelf, typename TRange>
+        static TSet lockMany(TSelf& self, const TRange& keys) {
+            List<std::pair<address, MapMutex*>> mutexes = { { typeid(Vs).hash_code(), &self.template get<Vs>().m_mapMutex }... };
+            std::sort(mutexes.begin(), mutexes.end());
+            mutexes.erase(std::unique(mutexes.begin(), mutexes.end()), mutexes.end());
+            List<shared_lock<MapMutex>> locks;
+            for (auto& [type, mutex] : mutexes) {
+                locks.emplace_back(*mutex);
+            }
+            TSet set;
+            (SecureMap<K, Vs, TPolicy>::collect(self.template get<Vs>(), set, keys), ...);
+            set.acquire();
+            return set;
+        }
+    };
+
+    // Collection
+    // value types are registered at runtime, every type gets a static slot index,
+    // so get<V>() is an indexed load without lock once the type was added
+    template<typename K, typename TPolicy = MapPolicy>
+    class Collection : public CollectionBase<Collection<K, TPolicy>, K, TPolicy> {
+    public:
+        // constructor / destructor
+        Collection() = default;
+        ~Collection() {
+            for (auto& chunk : m_chunks) {
+                delete chunk.load(std::memory_order_relaxed);
+            }
+        }
+        // copy
+        Collection(const Collection&) = delete;
+        // copy assign
+        Collection& operator=(const Collection&) = delete;
+
+        // addType (slow path, publishes the new map into the slot of its type)
         template<typename V>
         void addType() {
+            address index = typeIndex<V>();
+            if (index >= ChunkCount * ChunkSize) {
+                throw std::length_error("Collection::addType");
+            }
             unique_lock lock(m_mapMutex);
-            m_map.try_emplace(typeid(V).hash_code(), static_cast<ISecureMap*>(new SecureMap<K, V>()));
+            // the map is only constructed for a new type
+            if (m_map.contains(typeid(V).hash_code())) {
+                return;
+            }
+            auto it = m_map.emplace(typeid(V).hash_code(), make_unique<SecureMap<K, V, TPolicy>>()).first;
+            m_names.try_emplace(typeid(V).hash_code(), typeid(V).name());
+            Chunk* chunk = m_chunks[index / ChunkSize].load(std::memory_order_relaxed);
+            if (!chunk) {
+                chunk = new Chunk();
+                m_chunks[index / ChunkSize].store(chunk, std::memory_order_release);
+            }
+            chunk->maps[index % ChunkSize].store(it->second.get(), std::memory_order_release);
         }
 
-        // get
-        template<typename V>
-        SecureMap<K, V>& get() {
+        // stats (per value type, zero unless compiled with SAFEMAP_LOCK_STATS)
+        Map<string, MapStats> stats() const {
             shared_lock lock(m_mapMutex);
-            return *reinterpret_cast<SecureMap<K, V>*>(m_map.at(typeid(V).hash_code()).get());
+            Map<string, MapStats> stats;
+            for (const auto& [type, map] : m_map) {
+                stats[m_names.at(type)] += map->stats();
+            }
+            return stats;
         }
+
+        // get (throws out_of_range if the type was not added)
         template<typename V>
-        const SecureMap<K, V>& get() const {
-            shared_lock lock(m_mapMutex);
-            return *reinterpret_cast<SecureMap<K, V>*>(m_map.at(typeid(V).hash_code()).get());
+        SecureMap<K, V, TPolicy>& get() {
+            return *static_cast<SecureMap<K, V, TPolicy>*>(find(typeIndex<V>()));
+        }
+        template<typename V>
+        const SecureMap<K, V, TPolicy>& get() const {
+            return *static_cast<const SecureMap<K, V, TPolicy>*>(find(typeIndex<V>()));
         }
 
         // // iterate
@@ -82,8 +269,66 @@ namespace Memory {
         //     return m_map.end();
         // }
     private:
-        // map
+        // Chunk (slots are allocated in chunks, published chunks and maps never move)
+        static constexpr address ChunkSize = 64;
+        static constexpr address ChunkCount = 64;
+        struct Chunk {
+            Array<std::atomic<ISecureMap*>, ChunkSize> maps;
+        };
+
+        // typeIndex (per value type, assigned on first use)
+        template<typename V>
+        static address typeIndex() {
+            static const address index = s_typeCount++;
+            return index;
+        }
+        // find
+        ISecureMap* find(address index) const {
+            if (index < ChunkCount * ChunkSize) {
+                if (Chunk* chunk = m_chunks[index / ChunkSize].load(std::memory_order_acquire)) {
+                    if (ISecureMap* map = chunk->maps[index % ChunkSize].load(std::memory_order_acquire)) {
+                        return map;
+                    }
+                }
+            }
+            throw std::out_of_range("Collection::get");
+        }
+
+        // slots
+        Array<std::atomic<Chunk*>, ChunkCount> m_chunks = {};
+        inline static atomic_address s_typeCount = 0;
+        // map (owns the maps, by type hash)
         Map<address, unique_ptr<ISecureMap>> m_map;
+        Map<address, string> m_names;
         mutable shared_mutex m_mapMutex;
     };
+
+    // BasicStaticCollection
+    // value types are fixed at compile time, the maps are members and get<V>() resolves statically
+    template<typename K, typename TPolicy, typename... Ts>
+    class BasicStaticCollection : public CollectionBase<BasicStaticCollection<K, TPolicy, Ts...>, K, TPolicy> {
+    public:
+        // stats (per value type, zero unless compiled with SAFEMAP_LOCK_STATS)
+        Map<string, MapStats> stats() const {
+            Map<string, MapStats> stats;
+            ((stats[typeid(Ts).name()] += get<Ts>().stats()), ...);
+            return stats;
+        }
+
+        // get
+        template<typename V>
+        SecureMap<K, V, TPolicy>& get() {
+            return std::get<SecureMap<K, V, TPolicy>>(m_maps);
+        }
+        template<typename V>
+        const SecureMap<K, V, TPolicy>& get() const {
+            return std::get<SecureMap<K, V, TPolicy>>(m_maps);
+        }
+    private:
+        // maps
+        std::tuple<SecureMap<K, Ts, TPolicy>...> m_maps;
+    };
+    // StaticCollection
+    template<typename K, typename... Ts>
+    using StaticCollection = BasicStaticCollection<K, MapPolicy, Ts...>;
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include <mutex> // mutex, recursive_mutex, unique_lock
 #include <shared_mutex> // shared_mutex, shared_lock
 #include <atomic> // atomic dtypes...
+#include <thread> // thread
+#include <condition_variable> // condition_variable
 
 namespace Memory {
     // lock
@@ -11,6 +13,9 @@ namespace Memory {
     using std::mutex;
     using std::shared_mutex;
     using std::recursive_mutex;
+    // thread
+    using std::thread;
+    using std::condition_variable;
     // atomic
     // :: address
     using atomic_address = std::atomic_size_t;
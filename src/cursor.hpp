@@ -0,0 +1,32 @@
+#pragma once
+#include "common.hpp"
+
+namespace Memory {
+    // Cursor
+    // resumable position of an ordered scan over the keys in [from, to), see SecureMap::advance
+    template<typename K>
+    class Cursor {
+    public:
+        // constructor
+        Cursor() = default;
+        Cursor(const K& from)
+            : m_next(from) {}
+        Cursor(const K& from, const K& to)
+            : m_next(from), m_to(to) {}
+
+        // done
+        bool done() const {
+            return m_done;
+        }
+
+        // friend
+        template<typename K2, typename V2, typename TPolicy2>
+        friend class SecureMap;
+    private:
+        // member
+        Opt<K> m_next;
+        Opt<K> m_to;
+        bool m_inclusive = true;
+        bool m_done = false;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,140 @@
+#pragma once
+#include "common.hpp"
+#include "common_thread.hpp"
+#include <algorithm> // remove_if
+
+namespace Memory {
+    // EpochDomain
+    // epoch based reclamation: readers pin the current epoch while they dereference shared pointers,
+    // retired objects are reclaimed once every pinned reader has entered a later epoch
+    class EpochDomain {
+    private:
+        // Record (one per thread, reused after the thread exits)
+        struct alignas(64) Record {
+            atomic_uint64 epoch = 0; // 0 while not pinned
+            std::atomic_bool used = true;
+            address depth = 0;
+            Record* next = nullptr;
+        };
+    public:
+        // Guard
+        class Guard {
+        public:
+            // constructor / destructor
+            Guard(Record& record)
+                : m_record(&record) {}
+            ~Guard() {
+                if (m_record && --m_record->depth == 0) {
+                    m_record->epoch.store(0, std::memory_order_release);
+                }
+            }
+            // copy
+            Guard(const Guard&) = delete;
+            // copy assign
+            Guard& operator=(const Guard&) = delete;
+        private:
+            // member
+            Record* m_record;
+        };
+
+        // destructor
+        ~EpochDomain() {
+            for (auto& [epoch, reclaim] : m_retired) {
+                reclaim();
+            }
+            while (Record* record = m_records.load()) {
+                m_records = record->next;
+                delete record;
+            }
+        }
+        // copy
+        EpochDomain(const EpochDomain&) = delete;
+        // copy assign
+        EpochDomain& operator=(const EpochDomain&) = delete;
+
+        // pin (nested pins of one thread share the outermost epoch)
+        [[nodiscard]] Guard pin() {
+            Record& record = local();
+            if (record.depth++ == 0) {
+                record.epoch.store(m_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                // the pin must be visible before the reader loads any shared pointer
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+            return Guard(record);
+        }
+        // retire (call after unlinking, reclaim returns false while the object is still in use and is retried)
+        void retire(function<bool()> reclaim) {
+            unique_lock lock(m_retiredMutex);
+            m_retired.emplace_back(m_epoch.fetch_add(1, std::memory_order_seq_cst), move(reclaim));
+            collect();
+        }
+        // flush (reclaims whatever is no longer reachable)
+        void flush() {
+            unique_lock lock(m_retiredMutex);
+            collect();
+        }
+
+        // instance (shared by all read-mostly maps)
+        static EpochDomain& instance() {
+            static EpochDomain domain;
+            return domain;
+        }
+    private:
+        // constructor (thread records are per domain, so there is only the one instance)
+        EpochDomain() = default;
+
+        // local (record of the calling thread)
+        Record& local() {
+            // Owner (hands the record back when the thread exits)
+            struct Owner {
+                Record* record = nullptr;
+                ~Owner() {
+                    if (record) {
+                        record->used.store(false, std::memory_order_release);
+                    }
+                }
+            };
+            thread_local Owner owner;
+            if (!owner.record) {
+                owner.record = acquire();
+            }
+            return *owner.record;
+        }
+        // acquire (reuses a free record or publishes a new one)
+        Record* acquire() {
+            for (Record* record = m_records.load(std::memory_order_acquire); record; record = record->next) {
+                bool used = false;
+                if (!record->used.load(std::memory_order_relaxed) && record->used.compare_exchange_strong(used, true, std::memory_order_acquire)) {
+                    return record;
+                }
+            }
+            Record* record = new Record();
+            record->next = m_records.load(std::memory_order_relaxed);
+            while (!m_records.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed));
+            return record;
+        }
+        // collect (requires the retired mutex)
+        void collect() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint64 oldest = UINT64_MAX;
+            for (Record* record = m_records.load(std::memory_order_acquire); record; record = record->next) {
+                uint64 epoch = record->epoch.load(std::memory_order_acquire);
+                if (epoch != 0) {
+                    oldest = std::min(oldest, epoch);
+                }
+            }
+            // objects retired at epoch e may still be seen by readers pinned at e or earlier
+            auto it = std::remove_if(m_retired.begin(), m_retired.end(), [oldest](auto& retired) {
+                return retired.first < oldest && retired.second();
+            });
+            m_retired.erase(it, m_retired.end());
+        }
+
+        // epoch
+        atomic_uint64 m_epoch = 1;
+        std::atomic<Record*> m_records = nullptr;
+        // retired
+        mutex m_retiredMutex;
+        List<std::pair<uint64, function<bool()>>> m_retired;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,338 @@
+#pragma once
+#include "common.hpp"
+#include "key.hpp"
+#include <stdexcept> // out_of_range, length_error
+#include <iterator> // forward_iterator_tag
+
+namespace Memory {
+    // FlatHashMap
+    // open-addressing hash map (linear probing, backward-shift deletion)
+    // the probe table only stores 8 byte slots (entry index + hash fragment),
+    // entries live in a deque and never move, so references and iterators stay valid on rehash,
+    // an iterator keeps a pointer to its entry, dereferencing it does not read the deque that grows on insert,
+    // a transparent THash (e.g. KeyHash<string>) also allows lookups by other key types such as string_view
+    template<typename K, typename T, template<typename> typename TAllocator = std::allocator, typename THash = KeyHash<K>>
+    class FlatHashMap {
+    public:
+        // types
+        using key_type = K;
+        using mapped_type = T;
+        using value_type = std::pair<const K, T>;
+        template<typename Q>
+        static constexpr bool IsLookup = std::is_same_v<Q, K> || requires { typename THash::is_transparent; };
+
+        // Iterator
+        template<bool IsConst>
+        class Iterator {
+        public:
+            // types
+            using Owner = std::conditional_t<IsConst, const FlatHashMap, FlatHashMap>;
+            using value_type = std::pair<const K, T>;
+            using Value = std::conditional_t<IsConst, const value_type, value_type>;
+            using iterator_category = std::forward_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using pointer = Value*;
+            using reference = Value&;
+
+            // constructor
+            Iterator() = default;
+            Iterator(Owner* map, address index)
+                : m_map(map), m_index(index) {
+                skip();
+            }
+            template<bool OtherConst> requires(IsConst && !OtherConst)
+            Iterator(const Iterator<OtherConst>& other)
+                : m_map(other.m_map), m_index(other.m_index), m_value(other.m_value) {}
+
+            // access
+            Value& operator*() const {
+                return *m_value;
+            }
+            Value* operator->() const {
+                return m_value;
+            }
+            // increment
+            Iterator& operator++() {
+                ++m_index;
+                skip();
+                return *this;
+            }
+            // compare
+            bool operator==(const Iterator& other) const {
+                return m_index == other.m_index;
+            }
+            // index
+            address index() const {
+                return m_index;
+            }
+
+            // friend
+            template<bool OtherConst>
+            friend class Iterator;
+        private:
+            // skip (empty entries)
+            void skip() {
+                while (m_index < m_map->m_entries.size() && !m_map->m_entries[m_index]) {
+                    ++m_index;
+                }
+                m_value = m_index < m_map->m_entries.size() ? &*m_map->m_entries[m_index] : nullptr;
+            }
+
+            // member
+            Owner* m_map = nullptr;
+            address m_index = 0;
+            Value* m_value = nullptr;
+        };
+        using iterator = Iterator<false>;
+        using const_iterator = Iterator<true>;
+
+        // constructor / destructor
+        FlatHashMap() = default;
+        explicit FlatHashMap(const TAllocator<value_type>& allocator)
+            : m_entries(allocator), m_free(allocator), m_slots(allocator) {}
+        ~FlatHashMap() = default;
+        // copy
+        FlatHashMap(const FlatHashMap&) = delete;
+        // copy assign
+        FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+        // size
+        address size() const {
+            return m_size;
+        }
+        bool empty() const {
+            return m_size == 0;
+        }
+
+        // find
+        iterator find(const K& key) {
+            return find<K>(key);
+        }
+        const_iterator find(const K& key) const {
+            return find<K>(key);
+        }
+        template<typename Q> requires(IsLookup<Q>)
+        iterator find(const Q& key) {
+            address slot = findSlot(key);
+            return slot == npos ? end() : iterator(this, m_slots[slot].entry - 1);
+        }
+        template<typename Q> requires(IsLookup<Q>)
+        const_iterator find(const Q& key) const {
+            address slot = findSlot(key);
+            return slot == npos ? end() : const_iterator(this, m_slots[slot].entry - 1);
+        }
+        // contains
+        bool contains(const K& key) const {
+            return contains<K>(key);
+        }
+        template<typename Q> requires(IsLookup<Q>)
+        bool contains(const Q& key) const {
+            return findSlot(key) != npos;
+        }
+        // at
+        T& at(const K& key) {
+            return at<K>(key);
+        }
+        const T& at(const K& key) const {
+            return at<K>(key);
+        }
+        template<typename Q> requires(IsLookup<Q>)
+        T& at(const Q& key) {
+            address slot = findSlot(key);
+            if (slot == npos) {
+                throw std::out_of_range("FlatHashMap::at");
+            }
+            return m_entries[m_slots[slot].entry - 1]->second;
+        }
+        template<typename Q> requires(IsLookup<Q>)
+        const T& at(const Q& key) const {
+            address slot = findSlot(key);
+            if (slot == npos) {
+                throw std::out_of_range("FlatHashMap::at");
+            }
+            return m_entries[m_slots[slot].entry - 1]->second;
+        }
+        // operator[]
+        T& operator[](const K& key) {
+            return try_emplace(key).first->second;
+        }
+
+        // try_emplace
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+            uint32 hash = hashOf(key);
+            address slot = findSlot(key, hash);
+            if (slot != npos) {
+                return { iterator(this, m_slots[slot].entry - 1), false };
+            }
+            if (m_free.empty() && m_entries.size() == MaxEntries) {
+                throw std::length_error("FlatHashMap: too many entries");
+            }
+            if ((m_size + 1) * 4 > m_slots.size() * 3) {
+                rehash(m_slots.empty() ? 16 : m_slots.size() * 2);
+            }
+            // entry
+            address index;
+            if (m_free.empty()) {
+                index = m_entries.size();
+                m_entries.emplace_back();
+            }
+            else {
+                index = m_free.back();
+                m_free.pop_back();
+            }
+            m_entries[index].emplace(
+                std::piecewise_construct,
+                std::forward_as_tuple(key),
+                std::forward_as_tuple(forward<Args>(args)...)
+            );
+            // slot
+            insertSlot({ static_cast<uint32>(index + 1), hash });
+            ++m_size;
+            return { iterator(this, index), true };
+        }
+
+        // erase
+        address erase(const K& key) {
+            return erase<K>(key);
+        }
+        template<typename Q> requires(IsLookup<Q>)
+        address erase(const Q& key) {
+            address slot = findSlot(key);
+            if (slot == npos) {
+                return 0;
+            }
+            eraseSlot(slot);
+            return 1;
+        }
+        iterator erase(iterator it) {
+            address index = it.index();
+            eraseSlot(findSlot(m_entries[index]->first));
+            return iterator(this, index + 1);
+        }
+        // clear
+        void clear() {
+            m_entries.clear();
+            m_free.clear();
+            m_slots.clear();
+            m_size = 0;
+        }
+        // reserve
+        void reserve(address count) {
+            address capacity = m_slots.empty() ? 16 : m_slots.size();
+            while (count * 4 > capacity * 3) {
+                capacity *= 2;
+            }
+            if (capacity != m_slots.size()) {
+                rehash(capacity);
+            }
+        }
+
+        // iterate
+        // :: begin
+        iterator begin() {
+            return iterator(this, 0);
+        }
+        const_iterator begin() const {
+            return const_iterator(this, 0);
+        }
+        // :: end
+        iterator end() {
+            return iterator(this, m_entries.size());
+        }
+        const_iterator end() const {
+            return const_iterator(this, m_entries.size());
+        }
+        // :: seek (first entry at or after the given position)
+        iterator seek(address index) {
+            return iterator(this, std::min(index, m_entries.size()));
+        }
+        const_iterator seek(address index) const {
+            return const_iterator(this, std::min(index, m_entries.size()));
+        }
+    private:
+        // Slot (entry is index + 1, 0 marks an empty slot)
+        struct Slot {
+            uint32 entry = 0;
+            uint32 hash = 0;
+        };
+        static constexpr address npos = ~address(0);
+        // entry indices are stored + 1 in 32 bits
+        static constexpr address MaxEntries = ~uint32(0);
+
+        // hashOf
+        template<typename Q>
+        static uint32 hashOf(const Q& key) {
+            uint64 hash = static_cast<uint64>(THash{}(key));
+            return static_cast<uint32>((hash * 0x9E3779B97F4A7C15ull) >> 32);
+        }
+        // findSlot
+        template<typename Q>
+        address findSlot(const Q& key) const {
+            return findSlot(key, hashOf(key));
+        }
+        template<typename Q>
+        address findSlot(const Q& key, uint32 hash) const {
+            if (m_slots.empty()) {
+                return npos;
+            }
+            address mask = m_slots.size() - 1;
+            for (address slot = hash & mask;; slot = (slot + 1) & mask) {
+                const Slot& current = m_slots[slot];
+                if (current.entry == 0) {
+                    return npos;
+                }
+                if (current.hash == hash && m_entries[current.entry - 1]->first == key) {
+                    return slot;
+                }
+            }
+        }
+        // insertSlot
+        void insertSlot(Slot slot) {
+            address mask = m_slots.size() - 1;
+            address index = slot.hash & mask;
+            while (m_slots[index].entry != 0) {
+                index = (index + 1) & mask;
+            }
+            m_slots[index] = slot;
+        }
+        // eraseSlot (backward-shift, keeps probe sequences tombstone free)
+        void eraseSlot(address slot) {
+            address index = m_slots[slot].entry - 1;
+            m_entries[index].reset();
+            m_free.push_back(index);
+            --m_size;
+            address mask = m_slots.size() - 1;
+            address next = slot;
+            while (true) {
+                next = (next + 1) & mask;
+                if (m_slots[next].entry == 0) {
+                    break;
+                }
+                address home = m_slots[next].hash & mask;
+                bool movable = slot <= next ? (home <= slot || home > next) : (home <= slot && home > next);
+                if (movable) {
+                    m_slots[slot] = m_slots[next];
+                    slot = next;
+                }
+            }
+            m_slots[slot] = {};
+        }
+        // rehash
+        void rehash(address capacity) {
+            m_slots.assign(capacity, {});
+            for (address index = 0; index < m_entries.size(); ++index) {
+                if (m_entries[index]) {
+                    insertSlot({ static_cast<uint32>(index + 1), hashOf(m_entries[index]->first) });
+                }
+            }
+        }
+
+        // entries
+        std::deque<Opt<value_type>, TAllocator<Opt<value_type>>> m_entries;
+        std::vector<address, TAllocator<address>> m_free;
+        // slots
+        std::vector<Slot, TAllocator<Slot>> m_slots;
+        address m_size = 0;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+#include "common.hpp"
+
+namespace Memory {
+    // KeyLookup
+    // parameter type of the lookups of a key type, string keys are looked up through a string_view,
+    // so callers holding a view or a literal do not construct a string per lookup
+    // (specialize together with KeyHash for other keys that have a cheap borrowed form)
+    template<typename K>
+    struct KeyLookup {
+        using Type = const K&;
+    };
+    template<>
+    struct KeyLookup<string> {
+        using Type = string_view;
+    };
+    template<typename K>
+    using LookupKey = typename KeyLookup<K>::Type;
+
+    // KeyHash (hashes a key and its lookup form alike)
+    template<typename K>
+    struct KeyHash {
+        address operator()(const K& key) const {
+            return std::hash<K>{}(key);
+        }
+    };
+    template<>
+    struct KeyHash<string> {
+        using is_transparent = void;
+        // std::hash of a string equals the one of its string_view
+        address operator()(string_view key) const {
+            return std::hash<string_view>{}(key);
+        }
+    };
+}
\ No newline at end of file
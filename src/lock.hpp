@@ -1,18 +1,118 @@
 #pragma once
+#include "common.hpp"
 #include "common_thread.hpp"
+#include "lockorder.hpp"
+#include <chrono> // steady_clock
+#include <utility> // exchange
 
 namespace Memory {
+    // Interface for write observers (told about a write lock right before it is released, see ChangeLog)
+    class IWriteObserver {
+    public:
+        // constructor / destructor
+        IWriteObserver() = default;
+        virtual ~IWriteObserver() = default;
+
+        // onWrite (key points to the key of the written entry)
+        virtual void onWrite(const void* key) = 0;
+    };
+
+    // UpgradeLock
+    // owns the upgrade mode of a mutex (lock_upgrade / unlock_upgrade, see CompactMutex and UpgradeMutex),
+    // upgrade promotes it to a unique_lock that takes over the ownership
+    template<typename TMutex>
+    class UpgradeLock {
+    public:
+        // types
+        using mutex_type = TMutex;
+
+        // constructor / destructor
+        UpgradeLock() = default;
+        explicit UpgradeLock(TMutex& mutex)
+            : m_mutex(&mutex) {
+            lock();
+        }
+        UpgradeLock(TMutex& mutex, std::defer_lock_t)
+            : m_mutex(&mutex) {}
+        ~UpgradeLock() {
+            if (m_owns) {
+                m_mutex->unlock_upgrade();
+            }
+        }
+        // copy
+        UpgradeLock(const UpgradeLock&) = delete;
+        // copy assign
+        UpgradeLock& operator=(const UpgradeLock&) = delete;
+        // move
+        UpgradeLock(UpgradeLock&& other)
+            : m_mutex(std::exchange(other.m_mutex, nullptr)), m_owns(std::exchange(other.m_owns, false)) {}
+        // move assign
+        UpgradeLock& operator=(UpgradeLock&& other) {
+            if (m_owns) {
+                m_mutex->unlock_upgrade();
+            }
+            m_mutex = std::exchange(other.m_mutex, nullptr);
+            m_owns = std::exchange(other.m_owns, false);
+            return *this;
+        }
+
+        // lock / unlock
+        void lock() {
+            m_mutex->lock_upgrade();
+            m_owns = true;
+        }
+        bool try_lock() {
+            m_owns = m_mutex->try_lock_upgrade();
+            return m_owns;
+        }
+        void unlock() {
+            m_mutex->unlock_upgrade();
+            m_owns = false;
+        }
+        // release (gives up the ownership without unlocking)
+        TMutex* release() {
+            m_owns = false;
+            return std::exchange(m_mutex, nullptr);
+        }
+        // upgrade (waits until the readers are gone)
+        unique_lock<TMutex> upgrade() {
+            m_mutex->upgrade();
+            return unique_lock<TMutex>(*release(), std::adopt_lock);
+        }
+
+        // mutex
+        TMutex* mutex() const {
+            return m_mutex;
+        }
+        // isValid
+        explicit operator bool() const {
+            return m_owns;
+        }
+    private:
+        // member
+        TMutex* m_mutex = nullptr;
+        bool m_owns = false;
+    };
+
     // Locked
     template<typename T, typename TLock>
     class Locked {
     public:
+        // types
+        static constexpr bool IsUpgrade = requires(TLock& lock) { lock.upgrade(); };
+
         // constructor
         Locked()
             : m_ptr(nullptr) {}
-        Locked(T* ptr, shared_mutex& mutex)
+        Locked(T* ptr, typename TLock::mutex_type& mutex)
             : m_ptr(ptr), m_lock(mutex) {}
+        Locked(T* ptr, TLock&& lock)
+            : m_ptr(ptr), m_lock(move(lock)) {}
         // destructor
-        ~Locked() = default;
+        ~Locked() {
+            notify();
+            untrack();
+        }
         // copy
         Locked(const Locked<T, TLock>&) = delete;
         // copy assign
@@ -20,12 +120,19 @@ namespace Memory {
         // move
         template<typename U>
         Locked(Locked<U, TLock>&& other)
-            : m_ptr((T*)other.m_ptr), m_lock(move(other.m_lock)) {}
+            : m_ptr((T*)other.m_ptr), m_lock(move(other.m_lock)), m_observer(other.m_observer), m_key(other.m_key) {
+            other.m_observer = nullptr;
+        }
         // move assign
         template<typename U>
         Locked<T, TLock>& operator=(Locked<U, TLock>&& other) {
+            notify();
+            untrack();
             m_ptr = (T*)other.m_ptr;
             m_lock = move(other.m_lock);
+            m_observer = other.m_observer;
+            m_key = other.m_key;
+            other.m_observer = nullptr;
             return *this;
         }
 
@@ -33,14 +140,42 @@ namespace Memory {
         T* operator->() {
             return m_ptr;
         }
+        // operator*
+        T& operator*() {
+            return *m_ptr;
+        }
         // release
         void release() {
+            notify();
+            untrack();
             if (m_lock) {
                 m_lock.unlock();
                 m_lock.release();
             }
         }
 
+        // upgrade
+        // (upgrade locks only) continues as write lock on the same value, this handle is empty afterwards,
+        // no writer can come in between, so what was read under the upgrade lock still holds
+        Locked<std::remove_const_t<T>, unique_lock<typename TLock::mutex_type>> upgrade() requires(IsUpgrade) {
+            using Mutable = std::remove_const_t<T>;
+            if (!m_lock) {
+                return {};
+            }
+            // the entry stays held, so LockOrder keeps tracking it until the write lock is released
+            Locked<Mutable, unique_lock<typename TLock::mutex_type>> locked(const_cast<Mutable*>(m_ptr), m_lock.upgrade());
+            locked.observe(m_observer, m_key);
+            m_ptr = nullptr;
+            m_observer = nullptr;
+            return locked;
+        }
+
+        // observe (the observer is notified once, while the lock is still held, upgrade locks pass it on to upgrade)
+        void observe(IWriteObserver* observer, const void* key) {
+            m_observer = observer;
+            m_key = key;
+        }
+
         // isValid
         operator bool() const {
             return m_ptr != nullptr;
@@ -50,13 +185,68 @@ namespace Memory {
         template<typename U, typename ULock>
         friend class Locked;
     private:
+        // notify
+        void notify() {
+            if (!IsUpgrade && m_observer && m_lock) {
+                m_observer->onWrite(m_key);
+            }
+            m_observer = nullptr;
+        }
+        // untrack (the held lock is about to be released, see LockOrder)
+        void untrack() {
+            if (m_lock) {
+                LockOrder::release(m_lock.mutex());
+            }
+        }
+
         // pointer
         T* m_ptr;
         TLock m_lock;
+        // observer
+        IWriteObserver* m_observer = nullptr;
+        const void* m_key = nullptr;
     };
     // ReadLocked / WriteLocked
-    template<typename T>
-    using ReadLocked = Locked<const T, shared_lock<shared_mutex>>;
-    template<typename T>
-    using WriteLocked = Locked<T, unique_lock<shared_mutex>>;
+    template<typename T, typename TMutex = shared_mutex>
+    using ReadLocked = Locked<const T, shared_lock<TMutex>>;
+    template<typename T, typename TMutex = shared_mutex>
+    using WriteLocked = Locked<T, unique_lock<TMutex>>;
+    template<typename T, typename TMutex>
+    using UpgradeLocked = Locked<const T, UpgradeLock<TMutex>>;
+
+    // LockStatus / LockAttempt (result of a non-blocking or deadline-bounded lock)
+    enum class LockStatus {
+        Acquired, Missing, Contended
+    };
+    template<typename TLocked>
+    struct LockAttempt {
+        TLocked locked;
+        LockStatus status = LockStatus::Missing;
+
+        // isValid
+        operator bool() const {
+            return status == LockStatus::Acquired;
+        }
+    };
+
+    // tryLockUntil
+    // works with every mutex of the policies: tries, then yields and finally sleeps in short steps until the deadline
+    template<typename TLock>
+    bool tryLockUntil(TLock& lock, std::chrono::steady_clock::time_point deadline) {
+        for (address attempt = 0;; ++attempt) {
+            if (lock.try_lock()) {
+                return true;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                return false;
+            }
+            if (attempt < 64) {
+                std::this_thread::yield();
+            }
+            else {
+                std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(deadline - now, std::chrono::microseconds(50)));
+            }
+        }
+    }
 }
\ No newline at end of file
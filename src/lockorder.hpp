@@ -0,0 +1,168 @@
+#pragma once
+#include "common.hpp"
+#include "common_thread.hpp"
+#include <typeinfo> // type_info
+#ifdef SAFEMAP_LOCK_ORDER
+#include <sstream> // ostringstream
+#include <algorithm> // reverse
+#endif
+
+namespace Memory {
+    // LockOrder
+    // validates the hierarchy rule of product.md when SAFEMAP_LOCK_ORDER is defined, otherwise every call is empty:
+    // entry locks held by a thread are tracked, acquiring B while holding A adds the edge A -> B to a global graph,
+    // an edge that closes a cycle (possible deadlock) or a lock the thread already holds (self re-entry) is reported
+    class LockOrder {
+    public:
+        // acquire (before a blocking acquisition)
+        static void acquire([[maybe_unused]] const void* lock) {
+#ifdef SAFEMAP_LOCK_ORDER
+            state().check(lock);
+            held().emplace_back(lock);
+#endif
+        }
+        // acquired (after a non-blocking acquisition, it can not deadlock but is held from now on)
+        static void acquired([[maybe_unused]] const void* lock) {
+#ifdef SAFEMAP_LOCK_ORDER
+            held().emplace_back(lock);
+#endif
+        }
+        // release
+        static void release([[maybe_unused]] const void* lock) {
+#ifdef SAFEMAP_LOCK_ORDER
+            auto& locks = held();
+            for (auto it = locks.rbegin(); it != locks.rend(); ++it) {
+                if (*it == lock) {
+                    locks.erase(std::next(it).base());
+                    break;
+                }
+            }
+#endif
+        }
+        // name (key and value type shown in reports)
+        template<typename K>
+        static void name([[maybe_unused]] const void* lock, [[maybe_unused]] const K& key, [[maybe_unused]] const std::type_info& type) {
+#ifdef SAFEMAP_LOCK_ORDER
+            std::ostringstream stream;
+            if constexpr (requires(std::ostream& out) { out << key; }) {
+                stream << "key " << key;
+            }
+            else {
+                stream << "entry " << lock;
+            }
+            stream << " (" << type.name() << ")";
+            State& current = state();
+            unique_lock locked(current.guard);
+            current.names[lock] = stream.str();
+#endif
+        }
+        // forget (the lock is destroyed, its address may be reused by an unrelated entry)
+        static void forget([[maybe_unused]] const void* lock) {
+#ifdef SAFEMAP_LOCK_ORDER
+            State& current = state();
+            unique_lock locked(current.guard);
+            current.edges.erase(lock);
+            for (auto& [from, to] : current.edges) {
+                to.erase(lock);
+            }
+            current.names.erase(lock);
+#endif
+        }
+        // onViolation (replaces the default handler, which prints the report and aborts)
+        static void onViolation([[maybe_unused]] function<void(const string&)> handler) {
+#ifdef SAFEMAP_LOCK_ORDER
+            State& current = state();
+            unique_lock locked(current.guard);
+            current.handler = move(handler);
+#endif
+        }
+#ifdef SAFEMAP_LOCK_ORDER
+    private:
+        // State
+        struct State {
+            mutex guard;
+            HashMap<const void*, HashSet<const void*>> edges;
+            HashMap<const void*, string> names;
+            function<void(const string&)> handler = [](const string& report) {
+                std::cerr << report << std::endl;
+                std::abort();
+            };
+
+            // check (the report is built under the mutex, the handler runs outside of it)
+            void check(const void* lock) {
+                string report;
+                {
+                    unique_lock locked(guard);
+                    for (const void* other : held()) {
+                        if (other == lock) {
+                            report = "LockOrder: self re-entry on " + label(lock);
+                            break;
+                        }
+                        if (edges[other].contains(lock)) {
+                            continue;
+                        }
+                        List<const void*> path;
+                        if (find(lock, other, path)) {
+                            report = "LockOrder: cycle " + label(other);
+                            for (const void* step : path) {
+                                report += " -> " + label(step);
+                            }
+                            break;
+                        }
+                        edges[other].emplace(lock);
+                    }
+                }
+                if (!report.empty()) {
+                    handler(report);
+                }
+            }
+            // find (breadth first search for a path from -> to, path receives it including both ends)
+            bool find(const void* from, const void* to, List<const void*>& path) {
+                HashMap<const void*, const void*> parent = { { from, nullptr } };
+                Queue<const void*> pending;
+                pending.push(from);
+                while (!pending.empty()) {
+                    const void* current = pending.front();
+                    pending.pop();
+                    if (current == to) {
+                        for (const void* step = to; step; step = parent[step]) {
+                            path.emplace_back(step);
+                        }
+                        std::reverse(path.begin(), path.end());
+                        return true;
+                    }
+                    auto it = edges.find(current);
+                    if (it != edges.end()) {
+                        for (const void* next : it->second) {
+                            if (parent.emplace(next, current).second) {
+                                pending.push(next);
+                            }
+                        }
+                    }
+                }
+                return false;
+            }
+            // label (requires the mutex)
+            string label(const void* lock) const {
+                auto it = names.find(lock);
+                if (it != names.end()) {
+                    return it->second;
+                }
+                std::ostringstream stream;
+                stream << "entry " << lock;
+                return stream.str();
+            }
+        };
+
+        // state / held (locks held by the calling thread, in acquisition order)
+        static State& state() {
+            static State current;
+            return current;
+        }
+        static List<const void*>& held() {
+            thread_local List<const void*> locks;
+            return locks;
+        }
+#endif
+    };
+}
\ No newline at end of file
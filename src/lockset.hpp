@@ -0,0 +1,111 @@
+#pragma once
+#include "storage.hpp"
+#include "stats.hpp"
+#include "key.hpp"
+#include <algorithm> // sort, unique, lower_bound
+#include <stdexcept> // out_of_range
+#include <typeinfo> // typeid
+
+namespace Memory {
+    // LockSet
+    // entry locks of several keys (and value types) that are acquired in canonical order,
+    // i.e. by key and then by type, and released together when the set is destroyed
+    template<typename K, typename TLock>
+    class LockSet {
+    public:
+        // types
+        static constexpr bool IsShared = std::is_same_v<TLock, shared_lock<typename TLock::mutex_type>>;
+        template<typename V>
+        using Value = std::conditional_t<IsShared, const V, V>;
+        using Pointer = std::conditional_t<IsShared, const void*, void*>;
+
+        // constructor / destructor
+        LockSet() = default;
+        ~LockSet() {
+            release();
+        }
+        // copy
+        LockSet(const LockSet&) = delete;
+        // copy assign
+        LockSet& operator=(const LockSet&) = delete;
+        // move
+        LockSet(LockSet&&) = default;
+        // move assign
+        LockSet& operator=(LockSet&& other) {
+            release();
+            m_entries = move(other.m_entries);
+            return *this;
+        }
+
+        // find (nullptr if the key was missing or its value is destroyed)
+        template<typename V>
+        Value<V>* find(LookupKey<K> key) {
+            address type = typeid(V).hash_code();
+            auto it = std::lower_bound(m_entries.begin(), m_entries.end(), key, [type](const Entry& entry, LookupKey<K> key) {
+                return entry.key < key || (!(key < entry.key) && entry.type < type);
+            });
+            if (it == m_entries.end() || key < it->key || it->type != type) {
+                return nullptr;
+            }
+            auto storage = static_cast<Value<Storage<V>>*>(it->value);
+            return storage->isValid() ? &storage->get() : nullptr;
+        }
+        // at
+        template<typename V>
+        Value<V>& at(LookupKey<K> key) {
+            Value<V>* value = find<V>(key);
+            if (!value) {
+                throw std::out_of_range("LockSet::at");
+            }
+            return *value;
+        }
+        // size (number of held entry locks)
+        address size() const {
+            return m_entries.size();
+        }
+        // release
+        void release() {
+            for (auto& entry : m_entries) {
+                if (entry.observer && entry.lock) {
+                    entry.observer->onWrite(&entry.key);
+                }
+                if (entry.lock) {
+                    LockOrder::release(entry.lock.mutex());
+                }
+            }
+            m_entries.clear();
+        }
+
+        // add (unlocked entry, used by the maps while they hold their map lock, the observer is told on release)
+        void add(const K& key, address type, Pointer value, TLock&& lock, LockCounter& counter, IWriteObserver* observer = nullptr) {
+            m_entries.push_back({ key, type, value, move(lock), &counter, observer });
+        }
+        // acquire (sorts, drops duplicates and locks every entry in canonical order)
+        void acquire() {
+            std::sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) {
+                return a.key < b.key || (!(b.key < a.key) && a.type < b.type);
+            });
+            auto last = std::unique(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) {
+                return a.type == b.type && !(a.key < b.key) && !(b.key < a.key);
+            });
+            m_entries.erase(last, m_entries.end());
+            for (auto& entry : m_entries) {
+                LockOrder::acquire(entry.lock.mutex());
+                entry.counter->acquire(entry.lock);
+            }
+        }
+    private:
+        // Entry
+        struct Entry {
+            K key;
+            address type;
+            Pointer value;
+            TLock lock;
+            LockCounter* counter;
+            IWriteObserver* observer;
+        };
+
+        // member
+        List<Entry> m_entries;
+    };
+}
\ No newline at end of file
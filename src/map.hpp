@@ -1,6 +1,17 @@
 #pragma once
 #include "value.hpp"
 #include "storage.hpp"
+#include "policy.hpp"
+#include "pool.hpp"
+#include "stats.hpp"
+#include "lockset.hpp"
+#include "cursor.hpp"
+#include "snapshot.hpp"
+#include "changelog.hpp"
+#include "key.hpp"
+#include <utility> // as_const
+#include <coroutine> // coroutine_handle
+#include <stdexcept> // out_of_range
 
 namespace Memory {
     // Interface for SecureMap
@@ -9,54 +20,333 @@ namespace Memory {
         // constructor / destructor
         ISecureMap() = default;
         virtual ~ISecureMap() = default;
+
+        // stats
+        virtual MapStats stats() const = 0;
+    };
+
+    // EntryHandle (entry cached by a view, only valid while no entry of its stripe was freed since, see SecureMap::resolve)
+    template<typename K, typename TEntry>
+    struct EntryHandle {
+        TEntry* entry = nullptr;
+        const K* key = nullptr;
+        uint64 generation = 0;
     };
 
     // SecureMap
-    template<typename K, typename V>
+    template<typename K, typename V, typename TPolicy = MapPolicy>
     class SecureMap : public ISecureMap {
     public:
+        // types
+        using Mutex = typename TPolicy::Mutex;
+        using Lookup = LookupKey<K>;
+        using Entry = SecureValue<Storage<V>, Mutex>;
+        using Container = typename TPolicy::template Container<K, Entry>;
+        using ReadHandle = EntryHandle<K, const Entry>;
+        using WriteHandle = EntryHandle<K, Entry>;
+        using Resource = typename TPolicy::Resource;
+        static constexpr bool IsPooled = !std::is_same_v<Resource, NoResource>;
+        static constexpr bool IsOrdered = requires(Container& map, const K& key) { map.lower_bound(key); };
+        static constexpr bool IsAsync = requires(Mutex& mutex, AsyncWaiter& waiter) { mutex.lockAsync(waiter); };
+        static constexpr bool IsUpgradeable = requires(Mutex& mutex) { mutex.lock_upgrade(); mutex.upgrade(); };
+
+        // LockAwaiter
+        // result of readLockAsync / writeLockAsync, co_await yields the locked value (empty if the key is missing or destroyed),
+        // the executor only needs submit(function<void()>), e.g. ThreadPool
+        template<bool IsShared, typename TExecutor>
+        class LockAwaiter : private AsyncWaiter {
+        public:
+            // types
+            using Owner = std::conditional_t<IsShared, const SecureMap, SecureMap>;
+            using EntryLocked = std::conditional_t<IsShared, ReadLocked<Storage<V>, Mutex>, WriteLocked<Storage<V>, Mutex>>;
+            using ValueLocked = std::conditional_t<IsShared, ReadLocked<V, Mutex>, WriteLocked<V, Mutex>>;
+
+            // constructor
+            // (the key is copied, the awaiter may outlive the caller's buffer)
+            LockAwaiter(Owner& map, Lookup key, TExecutor& executor)
+                : m_map(&map), m_key(key), m_executor(&executor) {
+                exclusive = !IsShared;
+                grant = &LockAwaiter::resume;
+            }
+            // copy (the awaiter is linked into the wait queue of the entry)
+            LockAwaiter(const LockAwaiter&) = delete;
+            // copy assign
+            LockAwaiter& operator=(const LockAwaiter&) = delete;
+
+            // await
+            // the entry is looked up and queued for under the shared map lock, so it can not be erased while awaited
+            bool await_ready() {
+                shared_lock lock(m_map->m_mapMutex);
+                auto it = m_map->m_map.find(m_key);
+                if (it == m_map->m_map.end() || it->second.isPending()) {
+                    return true;
+                }
+                m_entry = &it->second;
+                m_entryKey = &it->first;
+                return m_entry->lockAsync(*this);
+            }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                m_handle = handle;
+                // granted in the meantime, go on without suspending
+                return m_state.exchange(Suspended, std::memory_order_acq_rel) != Granted;
+            }
+            ValueLocked await_resume() {
+                if (!m_entry) {
+                    return {};
+                }
+                EntryLocked locked = [&]() {
+                    if constexpr (IsShared) {
+                        return m_entry->readLock(std::adopt_lock);
+                    }
+                    else {
+                        return m_map->observe(m_entry->writeLock(std::adopt_lock), *m_entryKey);
+                    }
+                }();
+                if (!locked->isValid()) {
+                    return {};
+                }
+                return locked;
+            }
+        private:
+            // state
+            static constexpr uint8 Waiting = 0;
+            static constexpr uint8 Suspended = 1;
+            static constexpr uint8 Granted = 2;
+
+            // resume (called by the releasing thread once the entry lock was handed over)
+            static void resume(AsyncWaiter* waiter) {
+                auto* self = static_cast<LockAwaiter*>(waiter);
+                if (self->m_state.exchange(Granted, std::memory_order_acq_rel) == Suspended) {
+                    std::coroutine_handle<> handle = self->m_handle;
+                    self->m_executor->submit([handle]() {
+                        handle.resume();
+                    });
+                }
+            }
+
+            // member
+            Owner* m_map;
+            K m_key;
+            TExecutor* m_executor;
+            std::conditional_t<IsShared, const Entry, Entry>* m_entry = nullptr;
+            const K* m_entryKey = nullptr;
+            std::coroutine_handle<> m_handle;
+            atomic_uint8 m_state = Waiting;
+        };
+
         // constructor / destructor
-        SecureMap() = default;
-        ~SecureMap() = default;
+        SecureMap() requires(!IsPooled) = default;
+        SecureMap() requires(IsPooled)
+            : m_map(&m_resource) {}
+        ~SecureMap() {
+            delete m_changeLog.load(std::memory_order_relaxed);
+        }
 
         // emplace
+        // the node is inserted under a short exclusive map lock, the value is constructed under its entry lock only,
+        // so an expensive constructor stalls nobody: the key reads as missing until the value exists (see insert)
         template<typename... Args>
         void emplace(const K& key, Args&&... args) {
-            unique_lock lock(m_mapMutex);
             // ASSERT(!m_map.contains(key));
-            m_map[key].writeLock()->construct(forward<Args>(args)...);
+            auto [locked, entry, stored] = insert(key);
+            construct(locked, *entry, key, [&](Storage<V>& storage) {
+                storage.construct(forward<Args>(args)...);
+            });
+            record(ChangeKind::Insert, *stored);
         }
         // erase
-        void erase(const K& key) {
-            destroy(key);
+        void erase(Lookup key) {
+            {
+                shared_lock lock(m_mapMutex);
+                auto it = locate(key);
+                discard(it->first, it->second);
+            }
             unique_lock lock(m_mapMutex);
             // ASSERT(m_map.contains(key));
-            m_map.erase(key);
+            auto it = m_map.find(key);
+            if (it == m_map.end()) {
+                return;
+            }
+            if (removable(it->first, it->second)) {
+                freed(it->second);
+                m_map.erase(it);
+            }
+        }
+        // emplace many (the whole batch under one exclusive map lock, ascending keys are inserted with a hint, see batch for busy entries)
+        template<typename TRange>
+        void emplaceMany(TRange&& items) {
+            batch(forward<TRange>(items), [this](const K& key, Storage<V>& storage, auto&& value) {
+                storage.construct(forward<decltype(value)>(value));
+                record(ChangeKind::Insert, key);
+            });
+        }
+        // assign many (assigns existing values, constructs missing ones)
+        template<typename TRange>
+        void assignMany(TRange&& items) {
+            batch(forward<TRange>(items), [this](const K& key, Storage<V>& storage, auto&& value) {
+                if (storage.isValid()) {
+                    storage.get() = forward<decltype(value)>(value);
+                    record(ChangeKind::Write, key);
+                }
+                else {
+                    storage.construct(forward<decltype(value)>(value));
+                    record(ChangeKind::Insert, key);
+                }
+            });
+        }
+        // erase many (destroys under the shared map lock, then removes all keys under one exclusive lock)
+        template<typename TRange>
+        void eraseMany(const TRange& keys) {
+            {
+                shared_lock lock(m_mapMutex);
+                for (const auto& key : keys) {
+                    auto it = m_map.find(key);
+                    if (it != m_map.end()) {
+                        discard(it->first, it->second);
+                    }
+                }
+            }
+            unique_lock lock(m_mapMutex);
+            for (const auto& key : keys) {
+                auto it = m_map.find(key);
+                // entries re-emplaced in the meantime stay
+                if (it != m_map.end() && removable(it->first, it->second)) {
+                    freed(it->second);
+                    m_map.erase(it);
+                }
+            }
         }
         // clear
+        // a pooled map whose entries are all free is cleared in one exclusive section without erasing node by node (see rebuild),
+        // otherwise the values are destroyed under the entry locks first and entries still held stay behind as tombstones
         void clear() {
+            if constexpr (IsPooled) {
+                unique_lock lock(m_mapMutex);
+                auto free = [this](auto& item) {
+                    return bool(item.second.writeLockUntil(std::chrono::steady_clock::time_point(), m_entryCounter));
+                };
+                if (std::all_of(m_map.begin(), m_map.end(), free)) {
+                    rebuild();
+                    return;
+                }
+            }
             {
                 shared_lock lock(m_mapMutex);
                 for (auto it = m_map.begin(); it != m_map.end(); ++it) {
-                    it->second.writeLock()->destroy();
+                    discard(it->first, it->second);
                 }
             }
             unique_lock lock(m_mapMutex);
-            m_map.clear();
+            freed();
+            auto idle = [this](auto& item) {
+                return removable(item.first, item.second);
+            };
+            if (std::all_of(m_map.begin(), m_map.end(), idle)) {
+                if constexpr (IsPooled) {
+                    rebuild();
+                }
+                else {
+                    m_tombstones.clear();
+                    m_map.clear();
+                }
+                return;
+            }
+            // entries still held (or awaited) by someone stay behind as tombstones
+            m_tombstones.clear();
+            auto it = m_map.begin();
+            while (it != m_map.end()) {
+                it = idle(*it) ? m_map.erase(it) : std::next(it);
+            }
+        }
+
+        // read-modify-write (one lookup, the exclusive map lock is only taken if a node has to be created)
+        // :: update (func modifies the value in place, returns false if the key is missing or destroyed)
+        template<typename Func>
+        bool update(Lookup key, Func func) {
+            auto [locked, entry, stored] = obtain(key, false);
+            if (!locked || !locked->isValid()) {
+                return false;
+            }
+            func(locked->get());
+            record(ChangeKind::Write, *stored);
+            return true;
+        }
+        // :: upsert (func modifies a present value, otherwise the value is constructed from args, returns whether it was inserted)
+        template<typename Func, typename... Args>
+        bool upsert(Lookup key, Func func, Args&&... args) {
+            auto [locked, entry, stored] = obtain(key, true);
+            if (locked->isValid()) {
+                func(locked->get());
+                record(ChangeKind::Write, *stored);
+                return false;
+            }
+            construct(locked, *entry, key, [&](Storage<V>& storage) {
+                storage.construct(forward<Args>(args)...);
+            });
+            record(ChangeKind::Insert, *stored);
+            return true;
+        }
+        // :: compute if absent (a missing or destroyed value is constructed from factory(), returns the write locked value)
+        template<typename Factory>
+        WriteLocked<V, Mutex> computeIfAbsent(Lookup key, Factory factory) {
+            WriteLocked<Storage<V>, Mutex> locked;
+            Entry* entry;
+            const K* stored;
+            std::tie(locked, entry, stored) = obtain(key, true);
+            if (locked->isValid()) {
+                return observe(move(locked), *stored);
+            }
+            construct(locked, *entry, key, [&](Storage<V>& storage) {
+                storage.construct(factory());
+            });
+            record(ChangeKind::Insert, *stored);
+            return locked;
+        }
+        // :: erase if
+        // destroys the value if pred(value) holds, the node is reclaimed later as after destroy,
+        // pred runs under the shared map lock and must not call into the map
+        template<typename Pred>
+        bool eraseIf(Lookup key, Pred pred) {
+            shared_lock lock(m_mapMutex);
+            auto it = m_map.find(key);
+            if (it == m_map.end() || it->second.isPending()) {
+                return false;
+            }
+            auto locked = it->second.writeLock(m_entryCounter);
+            if (!locked->isValid() || !pred(std::as_const(locked->get()))) {
+                return false;
+            }
+            locked->destroy();
+            record(ChangeKind::Erase, it->first);
+            unique_lock tombstoneLock(m_tombstoneMutex);
+            m_tombstones.emplace_back(it->first);
+            return true;
         }
 
         // destroy
-        void destroy(const K& key) {
+        // destroy (the entry stays behind as a tombstone until clean, cleanStep or a later emplace reclaims it,
+        // an entry that is already destroyed is neither recorded nor remembered again)
+        void destroy(Lookup key) {
             shared_lock lock(m_mapMutex);
             // ASSERT(m_map.contains(key));
-            m_map.at(key).writeLock()->destroy();
+            auto it = locate(key);
+            auto locked = it->second.writeLock(m_entryCounter);
+            if (!locked->isValid()) {
+                return;
+            }
+            locked->destroy();
+            record(ChangeKind::Destroy, it->first);
+            unique_lock tombstoneLock(m_tombstoneMutex);
+            m_tombstones.emplace_back(it->first);
         }
         // clean
         void clean() {
             unique_lock lock(m_mapMutex);
+            m_tombstones.clear();
             auto it = m_map.begin();
             while (it != m_map.end()) {
-                if (!it->second.readLock()->isValid()) {
+                if (removable(it->first, it->second)) {
+                    freed(it->second);
                     it = m_map.erase(it);
                 }
                 else {
@@ -64,80 +354,887 @@ namespace Memory {
                 }
             }
         } 
+        // clean step (reclaims at most count tombstones under a short exclusive map lock, returns how many are left)
+        address cleanStep(address count) {
+            unique_lock lock(m_mapMutex);
+            reclaim(count);
+            return m_tombstones.size();
+        }
+        // tombstones (destroyed entries not yet reclaimed)
+        address tombstones() const {
+            shared_lock lock(m_mapMutex);
+            unique_lock tombstoneLock(m_tombstoneMutex);
+            return m_tombstones.size();
+        }
 
         // read / write lock
-        ReadLocked<V> readLock(const K& key) const {
+        ReadLocked<V, Mutex> readLock(Lookup key) const {
+            shared_lock lock(m_mapMutex);
+            auto it = m_map.find(key);
+            if (it != m_map.end() && !it->second.isPending()) {
+                return it->second.readLock(m_entryCounter);
+            }
+            return {};
+        }
+        WriteLocked<V, Mutex> writeLock(Lookup key) {
+            shared_lock lock(m_mapMutex);
+            auto it = m_map.find(key);
+            if (it != m_map.end() && !it->second.isPending()) {
+                return observe(it->second.writeLock(m_entryCounter), it->first);
+            }
+            return {};
+        }
+        // upgrade lock
+        // shared with readers, but exclusive among upgraders and writers: reads that turn out to need a write
+        // promote with upgrade() on the handle, without a second lookup and without another writer in between
+        // (empty if the key is missing or destroyed, requires the UpgradePolicy or the CompactPolicy)
+        UpgradeLocked<V, Mutex> upgradeLock(Lookup key) requires(IsUpgradeable) {
+            shared_lock lock(m_mapMutex);
+            auto it = m_map.find(key);
+            if (it == m_map.end() || it->second.isPending()) {
+                return {};
+            }
+            auto locked = it->second.upgradeLock(m_entryCounter);
+            if (!locked->isValid()) {
+                return {};
+            }
+            if (ChangeLog<K>* log = changeLog()) {
+                locked.observe(log, &it->first);
+            }
+            return locked;
+        }
+        // try read / write lock (never waits, the status tells a missing key from a busy entry)
+        LockAttempt<ReadLocked<V, Mutex>> tryReadLock(Lookup key) const {
+            return attempt(*this, key, std::chrono::steady_clock::time_point());
+        }
+        LockAttempt<WriteLocked<V, Mutex>> tryWriteLock(Lookup key) {
+            return attempt(*this, key, std::chrono::steady_clock::time_point());
+        }
+        // read / write lock for (the map lock and the entry lock are awaited until the deadline at most)
+        template<typename Rep, typename Period>
+        LockAttempt<ReadLocked<V, Mutex>> readLockFor(Lookup key, const std::chrono::duration<Rep, Period>& timeout) const {
+            return attempt(*this, key, std::chrono::steady_clock::now() + timeout);
+        }
+        template<typename Rep, typename Period>
+        LockAttempt<WriteLocked<V, Mutex>> writeLockFor(Lookup key, const std::chrono::duration<Rep, Period>& timeout) {
+            return attempt(*this, key, std::chrono::steady_clock::now() + timeout);
+        }
+        // read / write lock (through a handle, the lookup is only repeated after a node of the handle's stripe was freed,
+        // the shared map lock stays since nodes are freed under the exclusive one, a destroyed value counts as missing)
+        ReadLocked<V, Mutex> readLock(Lookup key, ReadHandle& handle) const {
             shared_lock lock(m_mapMutex);
-            if (m_map.contains(key)) {
-                return m_map.at(key).readLock();
+            const Entry* entry = resolve(*this, key, handle);
+            if (entry && !entry->isPending()) {
+                auto locked = entry->readLock(m_entryCounter);
+                if (locked->isValid()) {
+                    return locked;
+                }
             }
             return {};
         }
-        WriteLocked<V> writeLock(const K& key) {
+        WriteLocked<V, Mutex> writeLock(Lookup key, WriteHandle& handle) {
+            shared_lock lock(m_mapMutex);
+            Entry* entry = resolve(*this, key, handle);
+            if (entry && !entry->isPending()) {
+                auto locked = entry->writeLock(m_entryCounter);
+                if (locked->isValid()) {
+                    return observe(move(locked), *handle.key);
+                }
+            }
+            return {};
+        }
+        // read / write lock async
+        // co_await suspends the coroutine while the entry is busy instead of blocking the thread,
+        // it is resumed on executor once the lock was handed over (requires the AsyncPolicy)
+        template<typename TExecutor>
+        LockAwaiter<true, TExecutor> readLockAsync(Lookup key, TExecutor& executor) const requires(IsAsync) {
+            return { *this, key, executor };
+        }
+        template<typename TExecutor>
+        LockAwaiter<false, TExecutor> writeLockAsync(Lookup key, TExecutor& executor) requires(IsAsync) {
+            return { *this, key, executor };
+        }
+        // read / write lock many
+        // one lookup pass under the shared map lock, then the entries are locked in key order,
+        // so lock sets that overlap can not deadlock each other
+        template<typename TRange>
+        LockSet<K, shared_lock<Mutex>> readLockMany(const TRange& keys) const {
+            LockSet<K, shared_lock<Mutex>> set;
+            shared_lock lock(m_mapMutex);
+            collect(*this, set, keys);
+            set.acquire();
+            return set;
+        }
+        template<typename TRange>
+        LockSet<K, unique_lock<Mutex>> writeLockMany(const TRange& keys) {
+            LockSet<K, unique_lock<Mutex>> set;
+            shared_lock lock(m_mapMutex);
+            collect(*this, set, keys);
+            set.acquire();
+            return set;
+        }
+        // lock many (write locks)
+        template<typename... Keys>
+        LockSet<K, unique_lock<Mutex>> lockMany(const Keys&... keys) {
+            return writeLockMany(Array<K, sizeof...(Keys)>{ K(keys)... });
+        }
+
+        // readCopy (copies small values without the entry lock, requires a SeqMutex entry policy)
+        // the lookup itself still takes the shared map lock, ReadMostlySecureMap::readCopy takes no lock at all
+        Opt<V> readCopy(Lookup key) const requires std::is_trivially_copyable_v<V> && requires(const Mutex& mutex) { mutex.version(); } {
             shared_lock lock(m_mapMutex);
-            if (m_map.contains(key)) {
-                return m_map.at(key).writeLock();
+            auto it = m_map.find(key);
+            if (it != m_map.end() && !it->second.isPending()) {
+                Storage<V> storage = it->second.readCopy();
+                if (storage.isValid()) {
+                    return storage.get();
+                }
             }
             return {};
         }
-        
+
+        // stats (zero unless compiled with SAFEMAP_LOCK_STATS)
+        MapStats stats() const override {
+#ifdef SAFEMAP_LOCK_STATS
+            return { m_mapMutex.stats(), m_entryCounter.snapshot() };
+#else
+            return {};
+#endif
+        }
+
         // iterate
         // :: foreach
-        void forEach(function<void(const K&, WriteLocked<V>&)> func) {
-            typename Map<K, SecureValue<Storage<V>>>::iterator it;
-            WriteLocked<Storage<V>> locked;
+        // func takes (key, WriteLocked) or (key, ReadLocked) and may return false to stop early,
+        // returns whether all entries were visited, with the change log enabled every entry visited through a WriteLocked
+        // is recorded as Write (whether it was modified is not known), visit with a ReadLocked to log nothing
+        template<typename Func>
+        bool forEach(Func&& func) {
+            return scan(*this, [this]() { return m_map.begin(); }, [this](const auto& it) { return it == m_map.end(); }, func);
+        }
+        template<typename Func>
+        bool forEach(Func&& func) const {
+            return scan(*this, [this]() { return m_map.begin(); }, [this](const auto& it) { return it == m_map.end(); }, func);
+        }
+        // :: foreach read (read locks, also on a mutable map)
+        template<typename Func>
+        bool forEachRead(Func&& func) const {
+            return forEach(func);
+        }
+        // :: foreach available (as forEach, but entries locked by someone else are skipped)
+        template<typename Func>
+        bool forEachAvailable(Func&& func) {
+            return scan<true>(*this, [this]() { return m_map.begin(); }, [this](const auto& it) { return it == m_map.end(); }, func);
+        }
+        template<typename Func>
+        bool forEachAvailable(Func&& func) const {
+            return scan<true>(*this, [this]() { return m_map.begin(); }, [this](const auto& it) { return it == m_map.end(); }, func);
+        }
+        // :: foreach range (keys in [from, to), ordered containers only)
+        template<typename Func>
+        bool forEachRange(Lookup from, Lookup to, Func&& func) requires(IsOrdered) {
+            return scan(*this, [&]() { return m_map.lower_bound(from); }, [&](const auto& it) { return it == m_map.end() || !(it->first < to); }, func);
+        }
+        template<typename Func>
+        bool forEachRange(Lookup from, Lookup to, Func&& func) const requires(IsOrdered) {
+            return scan(*this, [&]() { return m_map.lower_bound(from); }, [&](const auto& it) { return it == m_map.end() || !(it->first < to); }, func);
+        }
+        // :: foreach prefix (keys starting with prefix, e.g. string keys)
+        template<typename Func>
+        bool forEachPrefix(Lookup prefix, Func&& func) requires(IsOrdered && requires(const K& key) { key.starts_with(prefix); }) {
+            return scan(*this, [&]() { return m_map.lower_bound(prefix); }, [&](const auto& it) { return it == m_map.end() || !it->first.starts_with(prefix); }, func);
+        }
+        template<typename Func>
+        bool forEachPrefix(Lookup prefix, Func&& func) const requires(IsOrdered && requires(const K& key) { key.starts_with(prefix); }) {
+            return scan(*this, [&]() { return m_map.lower_bound(prefix); }, [&](const auto& it) { return it == m_map.end() || !it->first.starts_with(prefix); }, func);
+        }
+        // :: advance (visits up to count entries from the cursor on, returns whether entries are left)
+        template<typename Func>
+        bool advance(Cursor<K>& cursor, address count, Func&& func) requires(IsOrdered) {
+            return step(*this, cursor, count, func);
+        }
+        template<typename Func>
+        bool advance(Cursor<K>& cursor, address count, Func&& func) const requires(IsOrdered) {
+            return step(*this, cursor, count, func);
+        }
+        // :: parallel foreach (chunks of the key space run on the pool, entries are locked as in forEach)
+        void parallelForEach(function<void(const K&, WriteLocked<V, Mutex>&)> func, ThreadPool& pool) {
+            parallelTraverse(*this, func, pool);
+        }
+        void parallelForEach(function<void(const K&, ReadLocked<V, Mutex>&)> func, ThreadPool& pool) const {
+            parallelTraverse(*this, func, pool);
+        }
+        // save
+        // streams a snapshot of all values to disk, the map lock is only held while advancing between entries (see traverse)
+        // and every value is copied under its read lock, so entries inserted or erased meanwhile may or may not be part of it,
+        // the parallel form serializes chunks of SaveChunk entries on the pool and writes them in order, a round at a time
+        void save(const string& path, ThreadPool& pool) const requires(Serializable<K> && Serializable<V>) {
+            SnapshotWriter<K, V> writer(path);
+            auto bounds = partition(*this, SaveChunk);
+            address round = pool.size() + 1;
+            List<List<char>> chunks(round);
+            List<uint64> counts(round);
+            for (address first = 0; first < bounds.size(); first += round) {
+                address last = std::min(first + round, bounds.size());
+                List<function<void()>> tasks;
+                for (address chunk = first; chunk < last; ++chunk) {
+                    tasks.emplace_back([this, &bounds, &chunks, &counts, first, chunk]() {
+                        List<char>& out = chunks[chunk - first];
+                        uint64& count = counts[chunk - first];
+                        out.clear();
+                        count = 0;
+                        auto func = [&](const K& key, ReadLocked<V, Mutex>& locked) {
+                            Serializer<K>::write(key, out);
+                            Serializer<V>::write(*locked, out);
+                            ++count;
+                        };
+                        range(*this, bounds, chunk, func);
+                    });
+                }
+                pool.run(move(tasks));
+                for (address chunk = first; chunk < last; ++chunk) {
+                    writer.write(chunks[chunk - first], counts[chunk - first]);
+                }
+            }
+            writer.commit();
+        }
+        void save(const string& path) const requires(Serializable<K> && Serializable<V>) {
+            SnapshotWriter<K, V> writer(path);
+            List<char> out;
+            uint64 count = 0;
+            auto func = [&](const K& key, ReadLocked<V, Mutex>& locked) {
+                Serializer<K>::write(key, out);
+                Serializer<V>::write(*locked, out);
+                ++count;
+                if (count == SaveChunk) {
+                    locked.release();
+                    writer.write(out, count);
+                    out.clear();
+                    count = 0;
+                }
+            };
+            forEach(func);
+            writer.write(out, count);
+            writer.commit();
+        }
+        // load
+        // the file is mapped and its records are decoded in chunks of SaveChunk without any map lock, each chunk is then
+        // moved in as one batch (see batch), present keys are replaced, a record found to be corrupt throws once it is reached
+        void load(const string& path) requires(Serializable<K> && Serializable<V>) {
+            SnapshotRecords<K, V> records(path);
+            List<std::pair<K, V>> chunk;
+            chunk.reserve(std::min<address>(records.size(), SaveChunk));
+            auto flush = [&]() {
+                emplaceMany(stdr::subrange(std::make_move_iterator(chunk.begin()), std::make_move_iterator(chunk.end())));
+                chunk.clear();
+            };
+            for (auto&& record : records) {
+                chunk.emplace_back(move(record));
+                if (chunk.size() == SaveChunk) {
+                    flush();
+                }
+            }
+            flush();
+        }
+
+        // change log
+        // opt-in record of inserts, erases, destroys and released write locks (see ChangeLog),
+        // replicas poll it instead of rescanning the map
+        ChangeLog<K>& enableChangeLog(address capacity = 1 << 16) {
+            unique_lock lock(m_mapMutex);
+            if (!m_changeLog.load(std::memory_order_relaxed)) {
+                m_changeLog.store(new ChangeLog<K>(capacity), std::memory_order_release);
+            }
+            return *m_changeLog.load(std::memory_order_relaxed);
+        }
+        ChangeLog<K>* changeLog() const {
+            return m_changeLog.load(std::memory_order_acquire);
+        }
+
+        // friend
+        template<typename TDerived2, typename K2, typename TPolicy2>
+        friend class CollectionBase;
+        template<typename K2, typename V2, address Shards2, typename TPolicy2>
+        friend class ShardedSecureMap;
+    private:
+        // types
+        using Obtained = std::tuple<WriteLocked<Storage<V>, Mutex>, Entry*, const K*>;
+
+        // collect (adds the unlocked entries of all present keys, requires the map lock, pending ones count as missing)
+        template<typename TSelf, typename TSet, typename TRange>
+        static void collect(TSelf& self, TSet& set, const TRange& keys) {
+            for (const auto& key : keys) {
+                auto it = self.m_map.find(key);
+                if (it != self.m_map.end() && !it->second.isPending()) {
+                    auto [value, lock] = [&]() {
+                        if constexpr (TSet::IsShared) {
+                            return it->second.readLock(std::defer_lock);
+                        }
+                        else {
+                            return it->second.writeLock(std::defer_lock);
+                        }
+                    }();
+                    if constexpr (TSet::IsShared) {
+                        set.add(it->first, typeid(V).hash_code(), value, move(lock), self.m_entryCounter);
+                    }
+                    else {
+                        set.add(it->first, typeid(V).hash_code(), value, move(lock), self.m_entryCounter, self.changeLog());
+                    }
+                }
+            }
+        }
+        // locate (throws out_of_range for a missing key, a pending one is not there yet)
+        auto locate(Lookup key) {
+            auto it = m_map.find(key);
+            if (it == m_map.end() || it->second.isPending()) {
+                throw std::out_of_range("SecureMap: missing key");
+            }
+            return it;
+        }
+        // obtain
+        // write locked entry of key (possibly destroyed, then it is pending, see construct) and the key stored in the map,
+        // the entry lock keeps both in place once the map lock is gone, with create a missing node is inserted (see insert),
+        // without it a pending entry counts as missing
+        Obtained obtain(Lookup key, bool create) {
             {
                 shared_lock lock(m_mapMutex);
-                if (m_map.empty()) {
-                    return;
+                auto it = m_map.find(key);
+                if (it != m_map.end() && !it->second.isPending()) {
+                    auto locked = it->second.writeLock(m_entryCounter);
+                    if (!create || locked->isValid()) {
+                        return { move(locked), &it->second, &it->first };
+                    }
+                }
+                else if (!create) {
+                    return { WriteLocked<Storage<V>, Mutex>(), nullptr, nullptr };
                 }
-                it = m_map.begin();
-                locked = it->second.writeLock();
             }
+            // missing, destroyed or pending, a value to construct is only marked pending under the exclusive map lock
+            return insert(K(key));
+        }
+        // insert
+        // write locked entry of key (inserted if missing) and the key stored in the map, the entry is only try-locked
+        // under the exclusive map lock (a busy one is awaited under the shared lock, a pending one by retrying),
+        // a destroyed value is marked pending before the exclusive map lock is released, so readers that find the node
+        // treat it as missing instead of waiting under the map lock until the caller constructed it
+        Obtained insert(const K& key) {
             while (true) {
-                WriteLocked<V> locked_value;
-                if (locked->isValid()) {
-                    locked_value = move(locked);
-                    func(it->first, locked_value);
+                {
+                    unique_lock lock(m_mapMutex);
+                    reclaim(ReclaimPerWrite);
+                    auto [it, inserted] = m_map.try_emplace(key);
+                    if (inserted) {
+                        it->second.name(it->first, typeid(V));
+                    }
+                    if (!it->second.isPending()) {
+                        if (auto locked = it->second.writeLockUntil(std::chrono::steady_clock::time_point(), m_entryCounter)) {
+                            if (!locked->isValid()) {
+                                it->second.setPending(true);
+                            }
+                            return { move(locked), &it->second, &it->first };
+                        }
+                    }
                 }
-                shared_lock lock(m_mapMutex);
-                if (++it == m_map.end()) {
-                    return;
+                {
+                    shared_lock lock(m_mapMutex);
+                    auto it = m_map.find(key);
+                    if (it != m_map.end() && !it->second.isPending()) {
+                        auto locked = it->second.writeLock(m_entryCounter);
+                        if (locked->isValid()) {
+                            return { move(locked), &it->second, &it->first };
+                        }
+                        // destroyed meanwhile, marked pending on the next attempt
+                        continue;
+                    }
+                }
+                std::this_thread::yield();
+            }
+        }
+        // construct
+        // constructs the value of an entry returned by obtain or insert through make(storage) and clears its pending flag,
+        // if make throws, the node is erased again (left for reclaim while someone else holds it) and the exception passed on
+        template<typename Make>
+        void construct(WriteLocked<Storage<V>, Mutex>& locked, Entry& entry, Lookup key, Make make) {
+            try {
+                make(*locked);
+            }
+            catch (...) {
+                entry.setPending(false);
+                locked.release();
+                abandon(key);
+                throw;
+            }
+            entry.setPending(false);
+        }
+        // abandon (erases the node of a value that was never constructed, see construct)
+        void abandon(Lookup key) {
+            unique_lock lock(m_mapMutex);
+            auto it = m_map.find(key);
+            if (it != m_map.end() && removable(it->first, it->second)) {
+                freed(it->second);
+                m_map.erase(it);
+            }
+        }
+        // discard
+        // destroys the value of an entry (requires the map lock) and records the erase while the entry is still locked,
+        // so it is logged before a re-emplace of the key, erase, eraseMany and clear only log values they actually destroyed
+        void discard(const K& key, Entry& entry) {
+            if (entry.isPending()) {
+                return;
+            }
+            auto locked = entry.writeLock(m_entryCounter);
+            if (locked->isValid()) {
+                locked->destroy();
+                record(ChangeKind::Erase, key);
+            }
+        }
+        // rebuild
+        // requires the exclusive map lock and entries nobody holds or awaits (nobody can lock one while the exclusive lock is held):
+        // values and elements are destroyed in place, the container itself is abandoned and its nodes go back with the whole pool
+        void rebuild() requires(IsPooled) {
+            freed();
+            m_tombstones.clear();
+            for (auto& item : m_map) {
+                if (auto locked = item.second.writeLockUntil(std::chrono::steady_clock::time_point(), m_entryCounter)) {
+                    if (locked->isValid()) {
+                        locked->destroy();
+                        record(ChangeKind::Erase, item.first);
+                    }
+                }
+                std::destroy_at(&item);
+            }
+            m_resource.release();
+            std::construct_at(&m_map, &m_resource);
+        }
+        // record (no-op unless the change log is enabled)
+        void record(ChangeKind kind, const K& key) {
+            if (ChangeLog<K>* log = changeLog()) {
+                log->record(kind, key);
+            }
+        }
+        // observe (a write lock on a valid entry reports its release, key must be the key stored in the map)
+        WriteLocked<Storage<V>, Mutex> observe(WriteLocked<Storage<V>, Mutex>&& locked, const K& key) {
+            ChangeLog<K>* log = changeLog();
+            if (log && locked && locked->isValid()) {
+                locked.observe(log, &key);
+            }
+            return locked;
+        }
+        // removable
+        // requires the exclusive map lock: a destroyed entry that nobody holds or awaits (see AsyncMutex),
+        // a busy entry is remembered as tombstone and reclaimed later
+        bool removable(const K& key, Entry& entry) {
+            auto locked = entry.writeLockUntil(std::chrono::steady_clock::time_point(), m_entryCounter);
+            if (!locked) {
+                m_tombstones.emplace_back(key);
+                return false;
+            }
+            return !locked->isValid();
+        }
+        // reclaim
+        // requires the exclusive map lock (destroy only adds tombstones under the shared one),
+        // tombstones whose entry is locked right now are kept for later
+        void reclaim(address count) {
+            if (m_tombstones.empty()) {
+                return;
+            }
+            address kept = 0;
+            for (address i = 0; i < count && kept < m_tombstones.size(); ++i) {
+                K key = move(m_tombstones.back());
+                m_tombstones.pop_back();
+                auto it = m_map.find(key);
+                if (it == m_map.end()) {
+                    continue;
+                }
+                auto locked = it->second.writeLockUntil(std::chrono::steady_clock::time_point(), m_entryCounter);
+                if (!locked) {
+                    m_tombstones.push_front(move(key));
+                    ++kept;
+                }
+                else if (!locked->isValid()) {
+                    locked.release();
+                    freed(it->second);
+                    m_map.erase(it);
+                }
+            }
+        }
+        // attempt (a destroyed or pending value counts as missing)
+        template<typename TSelf>
+        static auto attempt(TSelf& self, Lookup key, std::chrono::steady_clock::time_point deadline) {
+            using ValueLocked = std::conditional_t<std::is_const_v<TSelf>, ReadLocked<V, Mutex>, WriteLocked<V, Mutex>>;
+            using Attempt = LockAttempt<ValueLocked>;
+            shared_lock lock(self.m_mapMutex, std::defer_lock);
+            if (!tryLockUntil(lock, deadline)) {
+                return Attempt{ {}, LockStatus::Contended };
+            }
+            auto it = self.m_map.find(key);
+            if (it == self.m_map.end() || it->second.isPending()) {
+                return Attempt{ {}, LockStatus::Missing };
+            }
+            auto locked = [&]() {
+                if constexpr (std::is_const_v<TSelf>) {
+                    return it->second.readLockUntil(deadline, self.m_entryCounter);
                 }
                 else {
-                    locked = it->second.writeLock();
+                    return it->second.writeLockUntil(deadline, self.m_entryCounter);
                 }
+            }();
+            if (!locked) {
+                return Attempt{ {}, LockStatus::Contended };
+            }
+            if (!locked->isValid()) {
+                return Attempt{ {}, LockStatus::Missing };
             }
+            if constexpr (!std::is_const_v<TSelf>) {
+                locked = self.observe(move(locked), it->first);
+            }
+            return Attempt{ move(locked), LockStatus::Acquired };
+        }
+        // resolve (requires the map lock, entries stay put until they are erased)
+        template<typename TSelf, typename THandle>
+        static auto resolve(TSelf& self, Lookup key, THandle& handle) {
+            if (!handle.entry || handle.generation != self.m_freed[stripe(handle.entry)]) {
+                auto it = self.m_map.find(key);
+                if (it != self.m_map.end()) {
+                    handle = { &it->second, &it->first, self.m_freed[stripe(&it->second)] };
+                }
+                else {
+                    handle = {};
+                }
+            }
+            return handle.entry;
+        }
+        // stripe (of the freed generations, by node address, so a node reused at the same address is noticed)
+        static address stripe(const Entry* entry) {
+            return (reinterpret_cast<std::uintptr_t>(entry) >> 4) % FreedStripes;
         }
-        void forEach(function<void(const K&, ReadLocked<V>&)> func) const {
-            typename Map<K, SecureValue<Storage<V>>>::const_iterator it;
-            ReadLocked<Storage<V>> locked;
+        // freed (requires the exclusive map lock, call when the node of entry is erased, or without entry when all are)
+        void freed(const Entry& entry) {
+            ++m_generation;
+            ++m_freed[stripe(&entry)];
+        }
+        void freed() {
+            ++m_generation;
+            for (uint64& generation : m_freed) {
+                ++generation;
+            }
+        }
+        // batch (func receives the key, the locked storage and the value of every (key, value) item)
+        // the exclusive map lock only inserts the nodes: missing or destroyed entries are try-locked and marked pending there
+        // and constructed once it is released (see insert), present, busy and repeated keys are applied afterwards in item order
+        // through obtain, so neither value construction nor a holder waiting for the map lock can stall the exclusive section
+        template<typename TRange, typename Func>
+        void batch(TRange&& items, Func func) {
+            using Value = std::remove_cvref_t<std::tuple_element_t<1, std::remove_cvref_t<stdr::range_reference_t<TRange>>>>;
+            struct Placeholder {
+                const K* key;
+                Entry* entry;
+                WriteLocked<Storage<V>, Mutex> locked;
+                Value value;
+            };
+            List<Placeholder> placeholders;
+            List<std::pair<K, Value>> deferred;
             {
-                shared_lock lock(m_mapMutex);
-                if (m_map.empty()) {
-                    return;
+                unique_lock lock(m_mapMutex);
+                reclaim(ReclaimPerWrite);
+                if constexpr (!IsOrdered && stdr::sized_range<TRange>) {
+                    m_map.reserve(m_map.size() + stdr::size(items));
+                }
+                // entries can not be erased while the exclusive lock is held, so their address identifies them
+                HashSet<const Entry*> seen;
+                auto hint = m_map.end();
+                for (auto&& item : items) {
+                    auto it = hint;
+                    if constexpr (IsOrdered) {
+                        it = m_map.try_emplace(hint, std::get<0>(item));
+                        hint = std::next(it);
+                    }
+                    else {
+                        it = m_map.try_emplace(std::get<0>(item)).first;
+                    }
+                    it->second.name(it->first, typeid(V));
+                    WriteLocked<Storage<V>, Mutex> locked;
+                    if (seen.emplace(&it->second).second && !it->second.isPending()) {
+                        locked = it->second.writeLockUntil(std::chrono::steady_clock::time_point(), m_entryCounter);
+                    }
+                    if (locked && !locked->isValid()) {
+                        it->second.setPending(true);
+                        placeholders.push_back({ &it->first, &it->second, move(locked), std::get<1>(forward<decltype(item)>(item)) });
+                        continue;
+                    }
+                    locked.release();
+                    deferred.emplace_back(it->first, std::get<1>(forward<decltype(item)>(item)));
                 }
-                it = m_map.begin();
-                locked = it->second.readLock();
             }
-            while (true) {
-                ReadLocked<V> locked_value;
+            // the placeholders are held by this thread only, a throwing func abandons the ones not constructed yet
+            address constructed = 0;
+            try {
+                for (; constructed < placeholders.size(); ++constructed) {
+                    auto& [key, entry, locked, value] = placeholders[constructed];
+                    func(*key, *locked, move(value));
+                    entry->setPending(false);
+                    locked.release();
+                }
+            }
+            catch (...) {
+                for (address i = constructed; i < placeholders.size(); ++i) {
+                    // the node may be erased as soon as its entry is released
+                    K key = *placeholders[i].key;
+                    placeholders[i].entry->setPending(false);
+                    placeholders[i].locked.release();
+                    abandon(key);
+                }
+                throw;
+            }
+            for (auto& [key, value] : deferred) {
+                auto [locked, entry, stored] = obtain(key, true);
                 if (locked->isValid()) {
-                    locked_value = move(locked);
-                    func(it->first, locked_value);
+                    func(*stored, *locked, move(value));
+                    continue;
                 }
-                shared_lock lock(m_mapMutex);
-                if (++it == m_map.end()) {
-                    return;
+                construct(locked, *entry, key, [&](Storage<V>& storage) {
+                    func(*stored, storage, move(value));
+                });
+            }
+        }
+        // scan (read locks on a mutable map too, unless func takes a WriteLocked)
+        template<bool SkipContended = false, typename TSelf, typename Start, typename Stop, typename Func>
+        static bool scan(TSelf& self, Start start, Stop stop, Func& func) {
+            if constexpr (!std::is_const_v<TSelf> && !std::is_invocable_v<Func&, const K&, WriteLocked<V, Mutex>&>) {
+                return traverse<SkipContended>(std::as_const(self), start, stop, func);
+            }
+            else {
+                return traverse<SkipContended>(self, start, stop, func);
+            }
+        }
+        // step (one chunk of a cursor scan, the cursor is moved past the visited entries)
+        template<typename TSelf, typename Func>
+        static bool step(TSelf& self, Cursor<K>& cursor, address count, Func& func) {
+            if constexpr (!std::is_const_v<TSelf> && !std::is_invocable_v<Func&, const K&, WriteLocked<V, Mutex>&>) {
+                return step(std::as_const(self), cursor, count, func);
+            }
+            else {
+                if (cursor.m_done) {
+                    return false;
+                }
+                address visited = 0;
+                auto start = [&]() {
+                    if (!cursor.m_next) {
+                        return self.m_map.begin();
+                    }
+                    return cursor.m_inclusive ? self.m_map.lower_bound(*cursor.m_next) : self.m_map.upper_bound(*cursor.m_next);
+                };
+                auto stop = [&](const auto& it) {
+                    if (it == self.m_map.end() || (cursor.m_to && !(it->first < *cursor.m_to))) {
+                        cursor.m_done = true;
+                        return true;
+                    }
+                    if (visited++ == count) {
+                        cursor.m_next = it->first;
+                        cursor.m_inclusive = true;
+                        return true;
+                    }
+                    return false;
+                };
+                auto visit = [&](const K& key, auto& locked) {
+                    if constexpr (std::is_same_v<std::invoke_result_t<Func&, const K&, decltype(locked)>, bool>) {
+                        if (!func(key, locked)) {
+                            cursor.m_next = key;
+                            cursor.m_inclusive = false;
+                            return false;
+                        }
+                    }
+                    else {
+                        func(key, locked);
+                    }
+                    return true;
+                };
+                traverse(self, start, stop, visit);
+                return !cursor.m_done;
+            }
+        }
+        // traverse
+        // visits the entries from start() until stop(it), the map lock is only held while advancing and is never taken
+        // while an entry is held (see LockOrder): the position of the current entry is kept, so once the generation shows
+        // that entries were erased meanwhile the iterator is sought again instead of advanced, returns false if func returned false
+        template<bool SkipContended = false, typename TSelf, typename Start, typename Stop, typename Func>
+        static bool traverse(TSelf& self, Start start, Stop stop, Func& func) {
+            constexpr bool IsConst = std::is_const_v<TSelf>;
+            using EntryLocked = std::conditional_t<IsConst, ReadLocked<Storage<V>, Mutex>, WriteLocked<Storage<V>, Mutex>>;
+            using ValueLocked = std::conditional_t<IsConst, ReadLocked<V, Mutex>, WriteLocked<V, Mutex>>;
+            using Position = std::conditional_t<IsOrdered, K, address>;
+            decltype(self.m_map.begin()) it;
+            EntryLocked locked;
+            // position of the current entry and the generation it was reached in, taken under the map lock
+            Opt<Position> position;
+            uint64 generation = 0;
+            // key of the locked entry, taken under the map lock (the container is only touched while it is held)
+            const K* key = nullptr;
+            auto lockEntry = [&]() {
+                key = &it->first;
+                if constexpr (IsOrdered) {
+                    // assigned, so a key buffer is reused from entry to entry
+                    if (position) {
+                        *position = it->first;
+                    }
+                    else {
+                        position.emplace(it->first);
+                    }
                 }
                 else {
-                    locked = it->second.readLock();
+                    position = it.index();
+                }
+                generation = self.m_generation;
+                if (it->second.isPending()) {
+                    // under construction, skipped like a destroyed entry
+                    locked.release();
+                }
+                else if constexpr (SkipContended && IsConst) {
+                    locked = it->second.readLockUntil(std::chrono::steady_clock::time_point(), self.m_entryCounter);
+                }
+                else if constexpr (SkipContended) {
+                    locked = it->second.writeLockUntil(std::chrono::steady_clock::time_point(), self.m_entryCounter);
+                }
+                else if constexpr (IsConst) {
+                    locked = it->second.readLock(self.m_entryCounter);
+                }
+                else {
+                    locked = it->second.writeLock(self.m_entryCounter);
+                }
+                if constexpr (!IsConst) {
+                    locked = self.observe(move(locked), it->first);
+                }
+                if (locked && !locked->isValid()) {
+                    locked.release();
                 }
+            };
+            {
+                shared_lock lock(self.m_mapMutex);
+                it = start();
+                if (stop(it)) {
+                    return true;
+                }
+                lockEntry();
+            }
+            while (true) {
+                if (locked) {
+                    ValueLocked locked_value = move(locked);
+                    if constexpr (std::is_same_v<std::invoke_result_t<Func&, const K&, ValueLocked&>, bool>) {
+                        if (!func(*key, locked_value)) {
+                            return false;
+                        }
+                    }
+                    else {
+                        func(*key, locked_value);
+                    }
+                }
+                shared_lock lock(self.m_mapMutex);
+                if (generation != self.m_generation) {
+                    if constexpr (IsOrdered) {
+                        it = self.m_map.upper_bound(*position);
+                    }
+                    else {
+                        it = self.m_map.seek(*position + 1);
+                    }
+                }
+                else {
+                    ++it;
+                }
+                if (stop(it)) {
+                    return true;
+                }
+                lockEntry();
             }
         }
-    private:
+        // parallelTraverse
+        template<typename TSelf, typename Func>
+        static void parallelTraverse(TSelf& self, Func& func, ThreadPool& pool) {
+            List<function<void()>> tasks;
+            schedule(self, func, (pool.size() + 1) * 4, tasks);
+            pool.run(move(tasks));
+        }
+        // schedule (appends the tasks of a parallel traversal in about chunkCount chunks, func must outlive them)
+        template<typename TSelf, typename Func>
+        static void schedule(TSelf& self, Func& func, address chunkCount, List<function<void()>>& tasks) {
+            address size = 0;
+            {
+                shared_lock lock(self.m_mapMutex);
+                size = self.m_map.size();
+            }
+            auto bounds = make_shared<const List<std::conditional_t<IsOrdered, K, address>>>(
+                partition(self, std::max<address>(1, (size + chunkCount - 1) / chunkCount))
+            );
+            for (address chunk = 0; chunk < bounds->size(); ++chunk) {
+                tasks.emplace_back([&self, &func, bounds, chunk]() {
+                    range(self, *bounds, chunk, func);
+                });
+            }
+        }
+        // partition (first position of every chunk of chunkSize entries)
+        // ordered containers are split by key, unordered ones by position (FlatHashMap entries never move),
+        // so bounds stay meaningful when their entry is erased in the meantime
+        static List<std::conditional_t<IsOrdered, K, address>> partition(const SecureMap& self, address chunkSize) {
+            List<std::conditional_t<IsOrdered, K, address>> bounds;
+            shared_lock lock(self.m_mapMutex);
+            address index = 0;
+            for (auto it = self.m_map.begin(); it != self.m_map.end(); ++it, ++index) {
+                if (index % chunkSize == 0) {
+                    if constexpr (IsOrdered) {
+                        bounds.emplace_back(it->first);
+                    }
+                    else {
+                        bounds.emplace_back(it.index());
+                    }
+                }
+            }
+            return bounds;
+        }
+        // range (traverses one chunk of a partition)
+        template<typename TSelf, typename TBounds, typename Func>
+        static void range(TSelf& self, const TBounds& bounds, address chunk, Func& func) {
+            auto start = [&]() {
+                if constexpr (IsOrdered) {
+                    return self.m_map.lower_bound(bounds[chunk]);
+                }
+                else {
+                    return self.m_map.seek(bounds[chunk]);
+                }
+            };
+            auto stop = [&](const auto& it) {
+                if (it == self.m_map.end()) {
+                    return true;
+                }
+                if (chunk + 1 == bounds.size()) {
+                    return false;
+                }
+                if constexpr (IsOrdered) {
+                    return !(it->first < bounds[chunk + 1]);
+                }
+                else {
+                    return !(it.index() < bounds[chunk + 1]);
+                }
+            };
+            traverse(self, start, stop, func);
+        }
+
+        // resource (declared first, it outlives the map nodes)
+        [[no_unique_address]] Resource m_resource;
         // map
-        Map<K, SecureValue<Storage<V>>> m_map;
-        mutable shared_mutex m_mapMutex;
+        Container m_map;
+        mutable MapMutex m_mapMutex;
+        // tombstones (keys of destroyed entries, appended under the shared map lock)
+        Deque<K> m_tombstones;
+        mutable mutex m_tombstoneMutex;
+        static constexpr address ReclaimPerWrite = 2;
+        // entries per snapshot chunk (see save)
+        static constexpr address SaveChunk = 1 << 12;
+        // generation (bumped under the exclusive map lock whenever entries are erased)
+        uint64 m_generation = 0;
+        // freed generations (striped by node address, bumped with m_generation, see resolve)
+        static constexpr address FreedStripes = 64;
+        Array<uint64, FreedStripes> m_freed = {};
+        // change log (only set once enabled, published atomically since record and observe read it without the map lock)
+        std::atomic<ChangeLog<K>*> m_changeLog = nullptr;
+        // stats
+        [[no_unique_address]] mutable LockCounter m_entryCounter;
     };
 }
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+#include "flatmap.hpp"
+#include "seqlock.hpp"
+#include "rwlock.hpp"
+#include "asyncmutex.hpp"
+#include <memory_resource> // pmr
+
+namespace Memory {
+    // NoResource (policies without a node pool)
+    struct NoResource {};
+
+    // MapPolicy (ordered std::map, required for ordered iteration)
+    // the comparator is transparent, so keys are found through their lookup form (see KeyLookup)
+    struct MapPolicy {
+        template<typename K, typename T>
+        using Container = std::map<K, T, std::less<>>;
+        using Mutex = shared_mutex;
+        using Resource = NoResource;
+    };
+    // HashPolicy (open-addressing FlatHashMap, for point-lookup heavy workloads)
+    struct HashPolicy {
+        template<typename K, typename T>
+        using Container = FlatHashMap<K, T>;
+        using Mutex = shared_mutex;
+        using Resource = NoResource;
+    };
+    // SeqPolicy (ordered, entries carry a version for optimistic readCopy of small values)
+    struct SeqPolicy : MapPolicy {
+        using Mutex = SeqMutex<>;
+    };
+    // CompactPolicy (ordered, 4 byte entry locks instead of std::shared_mutex)
+    struct CompactPolicy : MapPolicy {
+        using Mutex = CompactMutex;
+    };
+    // UpgradePolicy (ordered, entry locks have an upgrade mode, see SecureMap::upgradeLock, CompactPolicy has one too)
+    struct UpgradePolicy : MapPolicy {
+        using Mutex = UpgradeMutex<>;
+    };
+    // AsyncPolicy (ordered, entry locks can be awaited by coroutines, see SecureMap::writeLockAsync)
+    struct AsyncPolicy : MapPolicy {
+        using Mutex = AsyncMutex;
+    };
+    // PoolPolicy / PoolHashPolicy (nodes come from a per-map pool, released in bulk on clear)
+    // the pool is unsynchronized, nodes are only (de)allocated under the exclusive map lock
+    struct PoolPolicy : MapPolicy {
+        template<typename K, typename T>
+        using Container = std::pmr::map<K, T, std::less<>>;
+        using Resource = std::pmr::unsynchronized_pool_resource;
+    };
+    struct PoolHashPolicy : HashPolicy {
+        template<typename K, typename T>
+        using Container = FlatHashMap<K, T, std::pmr::polymorphic_allocator>;
+        using Resource = std::pmr::unsynchronized_pool_resource;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+#pragma once
+#include "common.hpp"
+#include "common_thread.hpp"
+
+namespace Memory {
+    // ThreadPool
+    // work-stealing pool: every worker pops its own deque from the back
+    // and steals from the front of the other deques when it runs dry
+    class ThreadPool {
+    public:
+        // constructor / destructor
+        ThreadPool(address threadCount = std::max(1u, thread::hardware_concurrency())) {
+            for (address i = 0; i < threadCount; ++i) {
+                m_workers.emplace_back(make_unique<Worker>());
+            }
+            for (address i = 0; i < threadCount; ++i) {
+                m_threads.emplace_back([this, i]() { work(i); });
+            }
+        }
+        ~ThreadPool() {
+            {
+                unique_lock lock(m_sleepMutex);
+                m_stop = true;
+            }
+            m_sleep.notify_all();
+            for (auto& worker : m_threads) {
+                worker.join();
+            }
+        }
+        // copy
+        ThreadPool(const ThreadPool&) = delete;
+        // copy assign
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // submit
+        void submit(function<void()> task) {
+            address index = s_pool == this ? s_index : m_next++ % m_workers.size();
+            // counted before it is published, a worker that takes it right away must not decrement first (m_pending is unsigned)
+            ++m_pending;
+            {
+                unique_lock lock(m_workers[index]->queueMutex);
+                m_workers[index]->tasks.emplace_back(move(task));
+            }
+            {
+                unique_lock lock(m_sleepMutex);
+            }
+            m_sleep.notify_one();
+        }
+        // run (blocks until all tasks finished, the calling thread helps out meanwhile)
+        void run(List<function<void()>> tasks) {
+            atomic_address remaining = tasks.size();
+            mutex doneMutex;
+            condition_variable done;
+            for (auto& task : tasks) {
+                submit([&remaining, &doneMutex, &done, task = move(task)]() {
+                    task();
+                    unique_lock lock(doneMutex);
+                    if (--remaining == 0) {
+                        done.notify_all();
+                    }
+                });
+            }
+            function<void()> task;
+            while (remaining > 0 && acquire(s_pool == this ? s_index : 0, task)) {
+                task();
+                task = nullptr;
+            }
+            // nothing left to steal, the remaining tasks are being executed
+            unique_lock lock(doneMutex);
+            done.wait(lock, [&]() { return remaining == 0; });
+        }
+
+        // size
+        address size() const {
+            return m_workers.size();
+        }
+    private:
+        // Worker
+        struct alignas(64) Worker {
+            mutex queueMutex;
+            Deque<function<void()>> tasks;
+        };
+
+        // acquire (own queue first, then steal)
+        bool acquire(address index, function<void()>& task) {
+            for (address offset = 0; offset < m_workers.size(); ++offset) {
+                Worker& worker = *m_workers[(index + offset) % m_workers.size()];
+                unique_lock lock(worker.queueMutex);
+                if (!worker.tasks.empty()) {
+                    if (offset == 0) {
+                        task = move(worker.tasks.back());
+                        worker.tasks.pop_back();
+                    }
+                    else {
+                        task = move(worker.tasks.front());
+                        worker.tasks.pop_front();
+                    }
+                    --m_pending;
+                    return true;
+                }
+            }
+            return false;
+        }
+        // work
+        void work(address index) {
+            s_pool = this;
+            s_index = index;
+            while (true) {
+                function<void()> task;
+                if (acquire(index, task)) {
+                    task();
+                    continue;
+                }
+                unique_lock lock(m_sleepMutex);
+                m_sleep.wait(lock, [&]() { return m_stop || m_pending > 0; });
+                if (m_stop && m_pending == 0) {
+                    return;
+                }
+            }
+        }
+
+        // workers
+        List<unique_ptr<Worker>> m_workers;
+        List<thread> m_threads;
+        atomic_address m_next = 0;
+        atomic_address m_pending = 0;
+        // sleep
+        mutex m_sleepMutex;
+        condition_variable m_sleep;
+        bool m_stop = false;
+        // current worker
+        inline static thread_local ThreadPool* s_pool = nullptr;
+        inline static thread_local address s_index = 0;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,278 @@
+#pragma once
+#include "map.hpp"
+#include "epoch.hpp"
+
+namespace Memory {
+    // ReadMostlySecureMap
+    // lookups and traversal take no map lock: the keys live in an immutable sorted snapshot,
+    // writers publish a modified copy and retire the old snapshot (and erased entries) to the EpochDomain,
+    // values are locked per entry as in SecureMap
+    template<typename K, typename V, typename TPolicy = MapPolicy>
+    class ReadMostlySecureMap : public ISecureMap {
+    public:
+        // types
+        using Mutex = typename TPolicy::Mutex;
+
+        // constructor / destructor
+        ReadMostlySecureMap()
+            : m_snapshot(new Snapshot()) {}
+        ~ReadMostlySecureMap() {
+            Snapshot* snapshot = m_snapshot.load();
+            for (auto& [key, entry] : *snapshot) {
+                delete entry;
+            }
+            delete snapshot;
+        }
+        // copy
+        ReadMostlySecureMap(const ReadMostlySecureMap&) = delete;
+        // copy assign
+        ReadMostlySecureMap& operator=(const ReadMostlySecureMap&) = delete;
+
+        // emplace
+        template<typename... Args>
+        void emplace(const K& key, Args&&... args) {
+            unique_lock lock(m_writeMutex);
+            const Snapshot& current = *m_snapshot.load(std::memory_order_relaxed);
+            auto it = lowerBound(current, key);
+            if (it != current.end() && !(key < it->first)) {
+                it->second->writeLock(m_entryCounter)->construct(forward<Args>(args)...);
+                return;
+            }
+            // not yet published, nobody else can lock it
+            Entry* entry = new Entry();
+            entry->writeLock()->construct(forward<Args>(args)...);
+            Snapshot* next = new Snapshot();
+            next->reserve(current.size() + 1);
+            next->insert(next->end(), current.begin(), it);
+            next->emplace_back(key, entry);
+            next->insert(next->end(), it, current.end());
+            publish(next);
+        }
+        // emplace many (publishes one snapshot for the whole batch)
+        template<typename TRange>
+        void emplaceMany(TRange&& items) {
+            unique_lock lock(m_writeMutex);
+            const Snapshot& current = *m_snapshot.load(std::memory_order_relaxed);
+            Map<K, Entry*> added;
+            for (auto&& item : items) {
+                const K& key = std::get<0>(item);
+                auto it = lowerBound(current, key);
+                if (it != current.end() && !(key < it->first)) {
+                    it->second->writeLock(m_entryCounter)->construct(std::get<1>(forward<decltype(item)>(item)));
+                    continue;
+                }
+                Entry*& entry = added[key];
+                if (!entry) {
+                    entry = new Entry();
+                }
+                entry->writeLock()->construct(std::get<1>(forward<decltype(item)>(item)));
+            }
+            if (added.empty()) {
+                return;
+            }
+            Snapshot* next = new Snapshot();
+            next->reserve(current.size() + added.size());
+            std::merge(current.begin(), current.end(), added.begin(), added.end(), std::back_inserter(*next), [](const auto& a, const auto& b) {
+                return a.first < b.first;
+            });
+            publish(next);
+        }
+        // erase
+        void erase(LookupKey<K> key) {
+            destroy(key);
+            unique_lock lock(m_writeMutex);
+            const Snapshot& current = *m_snapshot.load(std::memory_order_relaxed);
+            auto it = lowerBound(current, key);
+            // entries re-emplaced in the meantime stay
+            if (it == current.end() || key < it->first || it->second->readLock(m_entryCounter)->isValid()) {
+                return;
+            }
+            Entry* entry = it->second;
+            Snapshot* next = new Snapshot();
+            next->reserve(current.size() - 1);
+            next->insert(next->end(), current.begin(), it);
+            next->insert(next->end(), it + 1, current.end());
+            publish(next);
+            retire(entry);
+        }
+        // clear
+        void clear() {
+            traverse(*this, [](const K&, WriteLocked<Storage<V>, Mutex>& locked) {
+                locked->destroy();
+                return true;
+            });
+            clean();
+        }
+
+        // destroy
+        void destroy(LookupKey<K> key) {
+            auto guard = EpochDomain::instance().pin();
+            const Snapshot& current = *m_snapshot.load(std::memory_order_acquire);
+            auto it = lowerBound(current, key);
+            if (it != current.end() && !(key < it->first)) {
+                it->second->writeLock(m_entryCounter)->destroy();
+            }
+        }
+        // clean
+        void clean() {
+            unique_lock lock(m_writeMutex);
+            const Snapshot& current = *m_snapshot.load(std::memory_order_relaxed);
+            Snapshot* next = new Snapshot();
+            List<Entry*> erased;
+            for (const auto& [key, entry] : current) {
+                if (entry->readLock(m_entryCounter)->isValid()) {
+                    next->emplace_back(key, entry);
+                }
+                else {
+                    erased.emplace_back(entry);
+                }
+            }
+            publish(next);
+            for (Entry* entry : erased) {
+                retire(entry);
+            }
+        }
+
+        // read / write lock (the snapshot is only pinned until the entry is locked)
+        ReadLocked<V, Mutex> readLock(LookupKey<K> key) const {
+            auto guard = EpochDomain::instance().pin();
+            const Snapshot& current = *m_snapshot.load(std::memory_order_acquire);
+            auto it = lowerBound(current, key);
+            if (it != current.end() && !(key < it->first)) {
+                return static_cast<const Entry*>(it->second)->readLock(m_entryCounter);
+            }
+            return {};
+        }
+        WriteLocked<V, Mutex> writeLock(LookupKey<K> key) {
+            auto guard = EpochDomain::instance().pin();
+            const Snapshot& current = *m_snapshot.load(std::memory_order_acquire);
+            auto it = lowerBound(current, key);
+            if (it != current.end() && !(key < it->first)) {
+                return it->second->writeLock(m_entryCounter);
+            }
+            return {};
+        }
+        // readCopy (no lock at all: the snapshot is pinned by the epoch and the value copied optimistically, see SecureMap::readCopy)
+        Opt<V> readCopy(LookupKey<K> key) const requires std::is_trivially_copyable_v<V> && requires(const Mutex& mutex) { mutex.version(); } {
+            auto guard = EpochDomain::instance().pin();
+            const Snapshot& current = *m_snapshot.load(std::memory_order_acquire);
+            auto it = lowerBound(current, key);
+            if (it != current.end() && !(key < it->first)) {
+                Storage<V> storage = static_cast<const Entry*>(it->second)->readCopy();
+                if (storage.isValid()) {
+                    return storage.get();
+                }
+            }
+            return {};
+        }
+
+        // stats (only entry locks, lookups take no map lock)
+        MapStats stats() const override {
+#ifdef SAFEMAP_LOCK_STATS
+            return { {}, m_entryCounter.snapshot() };
+#else
+            return {};
+#endif
+        }
+
+        // iterate
+        // :: foreach
+        // visits the snapshot current at the start, it stays pinned for the whole traversal,
+        // func may return false to stop early (see SecureMap::forEach)
+        template<typename Func>
+        bool forEach(Func&& func) {
+            if constexpr (std::is_invocable_v<Func&, const K&, WriteLocked<V, Mutex>&>) {
+                return traverse(*this, [&func](const K& key, WriteLocked<Storage<V>, Mutex>& locked) {
+                    return visit<WriteLocked<V, Mutex>>(func, key, locked);
+                });
+            }
+            else {
+                return forEachRead(func);
+            }
+        }
+        template<typename Func>
+        bool forEach(Func&& func) const {
+            return traverse(*this, [&func](const K& key, ReadLocked<Storage<V>, Mutex>& locked) {
+                return visit<ReadLocked<V, Mutex>>(func, key, locked);
+            });
+        }
+        // :: foreach read
+        template<typename Func>
+        bool forEachRead(Func&& func) const {
+            return forEach(func);
+        }
+    private:
+        // types
+        using Entry = SecureValue<Storage<V>, Mutex>;
+        using Snapshot = List<std::pair<K, Entry*>>;
+
+        // lowerBound
+        static typename Snapshot::const_iterator lowerBound(const Snapshot& snapshot, LookupKey<K> key) {
+            return std::lower_bound(snapshot.begin(), snapshot.end(), key, [](const auto& entry, LookupKey<K> key) {
+                return entry.first < key;
+            });
+        }
+        // publish (requires the write mutex)
+        void publish(Snapshot* next) {
+            Snapshot* previous = m_snapshot.exchange(next, std::memory_order_acq_rel);
+            EpochDomain::instance().retire([previous]() {
+                delete previous;
+                return true;
+            });
+        }
+        // retire (an entry is only freed once nobody holds its lock anymore)
+        static void retire(Entry* entry) {
+            EpochDomain::instance().retire([entry]() {
+                auto [value, lock] = entry->writeLock(std::defer_lock);
+                if (!lock.try_lock()) {
+                    return false;
+                }
+                lock.unlock();
+                delete entry;
+                return true;
+            });
+        }
+        // traverse (returns false if func returned false)
+        template<typename TSelf, typename Func>
+        static bool traverse(TSelf& self, Func func) {
+            auto guard = EpochDomain::instance().pin();
+            const Snapshot& current = *self.m_snapshot.load(std::memory_order_acquire);
+            for (const auto& [key, entry] : current) {
+                if constexpr (std::is_const_v<TSelf>) {
+                    ReadLocked<Storage<V>, Mutex> locked = static_cast<const Entry*>(entry)->readLock(self.m_entryCounter);
+                    if (!func(key, locked)) {
+                        return false;
+                    }
+                }
+                else {
+                    WriteLocked<Storage<V>, Mutex> locked = entry->writeLock(self.m_entryCounter);
+                    if (!func(key, locked)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+        // visit (valid entries only, returns false if func returned false)
+        template<typename ValueLocked, typename Func, typename EntryLocked>
+        static bool visit(Func& func, const K& key, EntryLocked& locked) {
+            if (!locked->isValid()) {
+                return true;
+            }
+            ValueLocked value = move(locked);
+            if constexpr (std::is_same_v<std::invoke_result_t<Func&, const K&, ValueLocked&>, bool>) {
+                return func(key, value);
+            }
+            else {
+                func(key, value);
+                return true;
+            }
+        }
+
+        // snapshot
+        std::atomic<Snapshot*> m_snapshot;
+        mutex m_writeMutex;
+        // stats
+        [[no_unique_address]] mutable LockCounter m_entryCounter;
+    };
+}
\ No newline at end of file
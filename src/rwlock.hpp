@@ -0,0 +1,194 @@
+#pragma once
+#include "common.hpp"
+#include "common_thread.hpp"
+
+namespace Memory {
+    // CompactMutex
+    // 4 byte reader-writer lock (writer bit, sleeper bit, upgrader bit, 29 bit reader count),
+    // threads spin briefly and then sleep on the state word (futex on linux)
+    class CompactMutex {
+    public:
+        // constructor
+        CompactMutex() = default;
+        // copy
+        CompactMutex(const CompactMutex&) = delete;
+        // copy assign
+        CompactMutex& operator=(const CompactMutex&) = delete;
+
+        // lock / unlock
+        void lock() {
+            for (address spin = 0;; ++spin) {
+                uint32 state = m_state.load(std::memory_order_relaxed);
+                if ((state & (Writer | Upgrader | Readers)) == 0) {
+                    if (m_state.compare_exchange_weak(state, state | Writer, std::memory_order_acquire, std::memory_order_relaxed)) {
+                        return;
+                    }
+                    continue;
+                }
+                wait(state, spin);
+            }
+        }
+        bool try_lock() {
+            uint32 state = m_state.load(std::memory_order_relaxed);
+            return (state & (Writer | Upgrader | Readers)) == 0
+                && m_state.compare_exchange_strong(state, state | Writer, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+        void unlock() {
+            uint32 state = m_state.fetch_and(~(Writer | Sleepers), std::memory_order_release);
+            if (state & Sleepers) {
+                m_state.notify_all();
+            }
+        }
+        // lock / unlock shared
+        void lock_shared() {
+            for (address spin = 0;; ++spin) {
+                uint32 state = m_state.load(std::memory_order_relaxed);
+                if ((state & Writer) == 0) {
+                    if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                        return;
+                    }
+                    continue;
+                }
+                wait(state, spin);
+            }
+        }
+        bool try_lock_shared() {
+            uint32 state = m_state.load(std::memory_order_relaxed);
+            while ((state & Writer) == 0) {
+                if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        void unlock_shared() {
+            uint32 state = m_state.fetch_sub(1, std::memory_order_release);
+            if ((state & Readers) == 1 && (state & Sleepers)) {
+                m_state.fetch_and(~Sleepers, std::memory_order_relaxed);
+                m_state.notify_all();
+            }
+        }
+        // lock / unlock upgrade (shared with readers, exclusive among upgraders and writers)
+        void lock_upgrade() {
+            for (address spin = 0;; ++spin) {
+                uint32 state = m_state.load(std::memory_order_relaxed);
+                if ((state & (Writer | Upgrader)) == 0) {
+                    if (m_state.compare_exchange_weak(state, state | Upgrader, std::memory_order_acquire, std::memory_order_relaxed)) {
+                        return;
+                    }
+                    continue;
+                }
+                wait(state, spin);
+            }
+        }
+        bool try_lock_upgrade() {
+            uint32 state = m_state.load(std::memory_order_relaxed);
+            while ((state & (Writer | Upgrader)) == 0) {
+                if (m_state.compare_exchange_weak(state, state | Upgrader, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        void unlock_upgrade() {
+            uint32 state = m_state.fetch_and(~(Upgrader | Sleepers), std::memory_order_release);
+            if (state & Sleepers) {
+                m_state.notify_all();
+            }
+        }
+        // upgrade (the held upgrade lock becomes the write lock once the readers are gone, release it with unlock)
+        void upgrade() {
+            for (address spin = 0;; ++spin) {
+                uint32 state = m_state.load(std::memory_order_relaxed);
+                if ((state & Readers) == 0) {
+                    if (m_state.compare_exchange_weak(state, (state & ~Upgrader) | Writer, std::memory_order_acquire, std::memory_order_relaxed)) {
+                        return;
+                    }
+                    continue;
+                }
+                wait(state, spin);
+            }
+        }
+    private:
+        // state
+        static constexpr uint32 Writer = 1u << 31;
+        static constexpr uint32 Sleepers = 1u << 30;
+        static constexpr uint32 Upgrader = 1u << 29;
+        static constexpr uint32 Readers = Upgrader - 1;
+
+        // wait (spin first, then announce ourselves and sleep until the state changes)
+        void wait(uint32 state, address spin) {
+            if (spin < 64) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+                __builtin_ia32_pause();
+#endif
+                return;
+            }
+            if ((state & Sleepers) == 0) {
+                if (!m_state.compare_exchange_weak(state, state | Sleepers, std::memory_order_relaxed)) {
+                    return;
+                }
+                state |= Sleepers;
+            }
+            m_state.wait(state, std::memory_order_relaxed);
+        }
+
+        // member
+        atomic_uint32 m_state = 0;
+    };
+
+    // UpgradeMutex
+    // adds the upgrade mode to a shared mutex: writers and the upgrader serialize on a plain mutex first,
+    // so the upgrader already excludes every writer and upgrade only has to wait for the readers
+    template<typename TMutex = shared_mutex>
+    class UpgradeMutex {
+    public:
+        // lock / unlock
+        void lock() {
+            m_upgrade.lock();
+            m_mutex.lock();
+        }
+        bool try_lock() {
+            if (!m_upgrade.try_lock()) {
+                return false;
+            }
+            if (!m_mutex.try_lock()) {
+                m_upgrade.unlock();
+                return false;
+            }
+            return true;
+        }
+        void unlock() {
+            m_mutex.unlock();
+            m_upgrade.unlock();
+        }
+        // lock / unlock shared
+        void lock_shared() {
+            m_mutex.lock_shared();
+        }
+        bool try_lock_shared() {
+            return m_mutex.try_lock_shared();
+        }
+        void unlock_shared() {
+            m_mutex.unlock_shared();
+        }
+        // lock / unlock upgrade
+        void lock_upgrade() {
+            m_upgrade.lock();
+        }
+        bool try_lock_upgrade() {
+            return m_upgrade.try_lock();
+        }
+        void unlock_upgrade() {
+            m_upgrade.unlock();
+        }
+        // upgrade (see CompactMutex::upgrade)
+        void upgrade() {
+            m_mutex.lock();
+        }
+    private:
+        // member
+        mutex m_upgrade;
+        TMutex m_mutex;
+    };
+}
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 #include "common.hpp"
 #include "map.hpp"
+#include "sharded.hpp"
+#include "readmostly.hpp"
 #include "view.hpp"
 #include "collection.hpp"
\ No newline at end of file
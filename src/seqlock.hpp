@@ -0,0 +1,77 @@
+#pragma once
+#include "common.hpp"
+#include "common_thread.hpp"
+#include <cstring> // memcpy
+
+namespace Memory {
+    // SeqMutex
+    // shared mutex with a version counter that is odd while a writer holds it,
+    // readers of trivially copyable values can copy optimistically and validate the version
+    template<typename TMutex = shared_mutex>
+    class SeqMutex {
+    public:
+        // lock / unlock
+        void lock() {
+            m_mutex.lock();
+            begin();
+        }
+        bool try_lock() {
+            if (m_mutex.try_lock()) {
+                begin();
+                return true;
+            }
+            return false;
+        }
+        void unlock() {
+            m_version.store(m_version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            m_mutex.unlock();
+        }
+        // lock / unlock shared
+        void lock_shared() {
+            m_mutex.lock_shared();
+        }
+        bool try_lock_shared() {
+            return m_mutex.try_lock_shared();
+        }
+        void unlock_shared() {
+            m_mutex.unlock_shared();
+        }
+
+        // version
+        uint32 version(std::memory_order order = std::memory_order_acquire) const {
+            return m_version.load(order);
+        }
+    private:
+        // begin (version becomes odd before any write to the value)
+        void begin() {
+            m_version.store(m_version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        // member
+        TMutex m_mutex;
+        atomic_uint32 m_version = 0;
+    };
+
+    // readOptimistic
+    // copies the value without taking the mutex, falls back to a shared lock while writers keep it busy
+    template<typename T, typename TMutex>
+    T readOptimistic(const T& value, TMutex& mutex) {
+        static_assert(std::is_trivially_copyable_v<T>, "optimistic reads require a trivially copyable value");
+        for (address attempt = 0; attempt < 64; ++attempt) {
+            uint32 before = mutex.version();
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            T copy;
+            std::memcpy(static_cast<void*>(&copy), static_cast<const void*>(&value), sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (mutex.version(std::memory_order_relaxed) == before) {
+                return copy;
+            }
+        }
+        shared_lock lock(mutex);
+        return value;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,171 @@
+#pragma once
+#include "map.hpp"
+
+namespace Memory {
+    // ShardedSecureMap
+    // keys are hashed onto independent SecureMaps (each with its own map mutex),
+    // so structural operations on different shards never contend
+    template<typename K, typename V, address Shards = 16, typename TPolicy = MapPolicy>
+    class ShardedSecureMap : public ISecureMap {
+    public:
+        static_assert(Shards > 0, "ShardedSecureMap requires at least one shard");
+        // types
+        using Mutex = typename TPolicy::Mutex;
+
+        // constructor / destructor
+        ShardedSecureMap() = default;
+        ~ShardedSecureMap() = default;
+
+        // emplace
+        template<typename... Args>
+        void emplace(const K& key, Args&&... args) {
+            shard(key).emplace(key, forward<Args>(args)...);
+        }
+        // erase
+        void erase(LookupKey<K> key) {
+            shard(key).erase(key);
+        }
+        // clear
+        void clear() {
+            for (auto& shard : m_shards) {
+                shard.map.clear();
+            }
+        }
+
+        // destroy
+        void destroy(LookupKey<K> key) {
+            shard(key).destroy(key);
+        }
+        // clean
+        void clean() {
+            for (auto& shard : m_shards) {
+                shard.map.clean();
+            }
+        }
+
+        // clean step (count is spread over the shards, returns the tombstones left in all of them)
+        address cleanStep(address count) {
+            address left = 0;
+            for (auto& shard : m_shards) {
+                left += shard.map.cleanStep(count / Shards + 1);
+            }
+            return left;
+        }
+        // tombstones
+        address tombstones() const {
+            address count = 0;
+            for (const auto& shard : m_shards) {
+                count += shard.map.tombstones();
+            }
+            return count;
+        }
+
+        // read / write lock
+        ReadLocked<V, Mutex> readLock(LookupKey<K> key) const {
+            return shard(key).readLock(key);
+        }
+        WriteLocked<V, Mutex> writeLock(LookupKey<K> key) {
+            return shard(key).writeLock(key);
+        }
+        // upgrade lock (see SecureMap::upgradeLock)
+        UpgradeLocked<V, Mutex> upgradeLock(LookupKey<K> key) {
+            return shard(key).upgradeLock(key);
+        }
+        // try read / write lock
+        LockAttempt<ReadLocked<V, Mutex>> tryReadLock(LookupKey<K> key) const {
+            return shard(key).tryReadLock(key);
+        }
+        LockAttempt<WriteLocked<V, Mutex>> tryWriteLock(LookupKey<K> key) {
+            return shard(key).tryWriteLock(key);
+        }
+        // read / write lock for
+        template<typename Rep, typename Period>
+        LockAttempt<ReadLocked<V, Mutex>> readLockFor(LookupKey<K> key, const std::chrono::duration<Rep, Period>& timeout) const {
+            return shard(key).readLockFor(key, timeout);
+        }
+        template<typename Rep, typename Period>
+        LockAttempt<WriteLocked<V, Mutex>> writeLockFor(LookupKey<K> key, const std::chrono::duration<Rep, Period>& timeout) {
+            return shard(key).writeLockFor(key, timeout);
+        }
+        // readCopy
+        Opt<V> readCopy(LookupKey<K> key) const {
+            return shard(key).readCopy(key);
+        }
+
+        // stats (summed over all shards)
+        MapStats stats() const override {
+            MapStats stats;
+            for (const auto& shard : m_shards) {
+                stats += shard.map.stats();
+            }
+            return stats;
+        }
+
+        // iterate
+        // :: foreach (shard by shard, keys are only ordered within a shard)
+        template<typename Func>
+        bool forEach(Func&& func) {
+            for (auto& shard : m_shards) {
+                if (!shard.map.forEach(func)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        template<typename Func>
+        bool forEach(Func&& func) const {
+            for (const auto& shard : m_shards) {
+                if (!shard.map.forEach(func)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        // :: foreach read
+        template<typename Func>
+        bool forEachRead(Func&& func) const {
+            return forEach(func);
+        }
+        // :: parallel foreach (the chunks of all shards are handed to the pool at once, so shards are traversed concurrently)
+        void parallelForEach(function<void(const K&, WriteLocked<V, Mutex>&)> func, ThreadPool& pool) {
+            List<function<void()>> tasks;
+            for (auto& shard : m_shards) {
+                SecureMap<K, V, TPolicy>::schedule(shard.map, func, chunksPerShard(pool), tasks);
+            }
+            pool.run(move(tasks));
+        }
+        void parallelForEach(function<void(const K&, ReadLocked<V, Mutex>&)> func, ThreadPool& pool) const {
+            List<function<void()>> tasks;
+            for (const auto& shard : m_shards) {
+                SecureMap<K, V, TPolicy>::schedule(shard.map, func, chunksPerShard(pool), tasks);
+            }
+            pool.run(move(tasks));
+        }
+
+        // shard
+        SecureMap<K, V, TPolicy>& shard(LookupKey<K> key) {
+            return m_shards[shardIndex(key)].map;
+        }
+        const SecureMap<K, V, TPolicy>& shard(LookupKey<K> key) const {
+            return m_shards[shardIndex(key)].map;
+        }
+        // shardIndex
+        static address shardIndex(LookupKey<K> key) {
+            // fibonacci hashing, spreads identity hashes (e.g. of ints) over all shards
+            uint64 hash = static_cast<uint64>(KeyHash<K>{}(key));
+            return static_cast<address>((hash * 0x9E3779B97F4A7C15ull) >> 32) % Shards;
+        }
+    private:
+        // chunksPerShard (about 4 chunks per thread over all shards, see SecureMap::parallelForEach)
+        static address chunksPerShard(const ThreadPool& pool) {
+            return std::max<address>(1, ((pool.size() + 1) * 4 + Shards - 1) / Shards);
+        }
+
+        // Shard (padded to its own cache line, so shard mutexes do not share one)
+        struct alignas(64) Shard {
+            SecureMap<K, V, TPolicy> map;
+        };
+        // shards
+        Array<Shard, Shards> m_shards;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,421 @@
+#pragma once
+#include "common.hpp"
+#include <cstring> // memcpy
+#include <cerrno> // errno, EINTR
+#include <cstdio> // rename, remove
+#include <fstream> // ofstream, ifstream
+#include <stdexcept> // runtime_error
+#include <typeinfo> // typeid
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h> // open
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+#include <unistd.h> // close
+#endif
+
+namespace Memory {
+    // SnapshotReader (bounds checked view of a snapshot file)
+    class SnapshotReader {
+    public:
+        // constructor
+        SnapshotReader(const char* data, address size)
+            : m_pos(data), m_end(data + size) {}
+
+        // take (the next count bytes)
+        const char* take(address count) {
+            if (static_cast<address>(m_end - m_pos) < count) {
+                throw std::runtime_error("Snapshot: truncated file");
+            }
+            const char* pos = m_pos;
+            m_pos += count;
+            return pos;
+        }
+        // remaining (bytes not taken yet)
+        address remaining() const {
+            return static_cast<address>(m_end - m_pos);
+        }
+        // read (trivially copyable, the file gives no alignment guarantee)
+        template<typename T>
+        T read() {
+            T value;
+            std::memcpy(&value, take(sizeof(T)), sizeof(T));
+            return value;
+        }
+    private:
+        // member
+        const char* m_pos;
+        const char* m_end;
+    };
+
+    // Serializer
+    // specialize for own key / value types: write appends to the buffer, read returns the next value,
+    // an optional static tag() names the encoding in the snapshot header (the type name otherwise, see SnapshotHeader)
+    template<typename T>
+    struct Serializer;
+    // :: trivially copyable (raw bytes)
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    struct Serializer<T> {
+        static void write(const T& value, List<char>& out) {
+            const char* bytes = reinterpret_cast<const char*>(&value);
+            out.insert(out.end(), bytes, bytes + sizeof(T));
+        }
+        static T read(SnapshotReader& in) {
+            return in.read<T>();
+        }
+    };
+    // :: string (length prefixed)
+    template<>
+    struct Serializer<string> {
+        static string tag() {
+            return "string";
+        }
+        static void write(const string& value, List<char>& out) {
+            Serializer<uint64>::write(value.size(), out);
+            out.insert(out.end(), value.begin(), value.end());
+        }
+        static string read(SnapshotReader& in) {
+            address size = in.read<uint64>();
+            return string(in.take(size), size);
+        }
+    };
+    // Serializable
+    template<typename T>
+    concept Serializable = requires(const T& value, List<char>& out, SnapshotReader& in) {
+        Serializer<T>::write(value, out);
+        { Serializer<T>::read(in) } -> std::convertible_to<T>;
+    };
+
+    // SnapshotHeader
+    // layout is the record size for trivially copyable keys and values (0 otherwise), fingerprint hashes the serializer tags
+    // of both types (for every layout), so a snapshot is not silently read back with different types
+    struct SnapshotHeader {
+        Array<char, 4> magic = { 'S', 'M', 'A', 'P' };
+        uint32 version = 2;
+        uint64 layout = 0;
+        uint64 fingerprint = 0;
+        uint64 count = 0;
+
+        // layoutOf
+        template<typename K, typename V>
+        static constexpr uint64 layoutOf() {
+            if constexpr (std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>) {
+                return (uint64(sizeof(K)) << 32) | sizeof(V);
+            }
+            else {
+                return 0;
+            }
+        }
+        // fingerprintOf (FNV-1a of both tags)
+        template<typename K, typename V>
+        static uint64 fingerprintOf() {
+            uint64 hash = 0xCBF29CE484222325ull;
+            for (const string& tag : { tagOf<K>(), tagOf<V>() }) {
+                for (char c : tag) {
+                    hash = (hash ^ static_cast<uint8>(c)) * 0x100000001B3ull;
+                }
+                hash = (hash ^ 0xFF) * 0x100000001B3ull;
+            }
+            return hash;
+        }
+        // tagOf
+        template<typename T>
+        static string tagOf() {
+            if constexpr (requires { { Serializer<T>::tag() } -> std::convertible_to<string>; }) {
+                return Serializer<T>::tag();
+            }
+            else {
+                return typeid(T).name();
+            }
+        }
+    };
+
+    // SnapshotWriter
+    // streams records into a temporary file that replaces path on commit, the header (with the final count) is written last,
+    // the file is synced before the rename and the directory after it, so a crash leaves either the old or the complete new snapshot
+    // (only flushed where fsync is not available), an uncommitted writer removes the temporary file
+    template<typename K, typename V>
+    class SnapshotWriter {
+    public:
+        // constructor / destructor
+        SnapshotWriter(const string& path)
+            : m_path(path), m_temporary(path + ".tmp") {
+#if defined(__unix__) || defined(__APPLE__)
+            m_handle = ::open(m_temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (m_handle < 0) {
+                throw std::runtime_error("Snapshot: can not write " + m_temporary);
+            }
+#else
+            m_file.open(m_temporary, std::ios::binary | std::ios::trunc);
+            if (!m_file) {
+                throw std::runtime_error("Snapshot: can not write " + m_temporary);
+            }
+#endif
+            // placeholder, the count is only known on commit
+            SnapshotHeader header;
+            put(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+        ~SnapshotWriter() {
+            if (!m_committed) {
+                close();
+                std::remove(m_temporary.c_str());
+            }
+        }
+        // copy
+        SnapshotWriter(const SnapshotWriter&) = delete;
+        // copy assign
+        SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+        // write (appends count serialized records)
+        void write(const List<char>& records, uint64 count) {
+            put(records.data(), records.size());
+            m_count += count;
+        }
+        // commit
+        void commit() {
+            SnapshotHeader header;
+            header.layout = SnapshotHeader::layoutOf<K, V>();
+            header.fingerprint = SnapshotHeader::fingerprintOf<K, V>();
+            header.count = m_count;
+#if defined(__unix__) || defined(__APPLE__)
+            bool written = ::pwrite(m_handle, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) && ::fsync(m_handle) == 0;
+#else
+            m_file.seekp(0);
+            m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            bool written = static_cast<bool>(m_file.flush());
+#endif
+            written = close() && written;
+            if (!written) {
+                throw std::runtime_error("Snapshot: can not write " + m_temporary);
+            }
+            if (std::rename(m_temporary.c_str(), m_path.c_str()) != 0) {
+                throw std::runtime_error("Snapshot: can not replace " + m_path);
+            }
+            m_committed = true;
+#if defined(__unix__) || defined(__APPLE__)
+            address separator = m_path.rfind('/');
+            string directory = separator == string::npos ? string(".") : m_path.substr(0, std::max<address>(separator, 1));
+            int handle = ::open(directory.c_str(), O_RDONLY);
+            if (handle >= 0) {
+                ::fsync(handle);
+                ::close(handle);
+            }
+#endif
+        }
+    private:
+        // put
+        void put(const char* data, address size) {
+#if defined(__unix__) || defined(__APPLE__)
+            while (size > 0) {
+                ssize_t written = ::write(m_handle, data, size);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::runtime_error("Snapshot: can not write " + m_temporary);
+                }
+                data += written;
+                size -= static_cast<address>(written);
+            }
+#else
+            if (!m_file.write(data, size)) {
+                throw std::runtime_error("Snapshot: can not write " + m_temporary);
+            }
+#endif
+        }
+        // close (returns false if pending data could not be written)
+        bool close() {
+#if defined(__unix__) || defined(__APPLE__)
+            if (m_handle < 0) {
+                return true;
+            }
+            bool closed = ::close(m_handle) == 0;
+            m_handle = -1;
+            return closed;
+#else
+            if (!m_file.is_open()) {
+                return true;
+            }
+            m_file.close();
+            return !m_file.fail();
+#endif
+        }
+
+        // member
+        string m_path;
+        string m_temporary;
+        uint64 m_count = 0;
+        bool m_committed = false;
+#if defined(__unix__) || defined(__APPLE__)
+        int m_handle = -1;
+#else
+        std::ofstream m_file;
+#endif
+    };
+
+    // MappedFile
+    // read-only memory mapping of a whole file (plain read where mmap is not available)
+    class MappedFile {
+    public:
+        // constructor / destructor
+        MappedFile(const string& path) {
+#if defined(__unix__) || defined(__APPLE__)
+            int handle = ::open(path.c_str(), O_RDONLY);
+            struct stat info;
+            if (handle < 0 || ::fstat(handle, &info) != 0) {
+                if (handle >= 0) {
+                    ::close(handle);
+                }
+                throw std::runtime_error("Snapshot: can not open " + path);
+            }
+            m_size = static_cast<address>(info.st_size);
+            if (m_size > 0) {
+                void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, handle, 0);
+                ::close(handle);
+                if (data == MAP_FAILED) {
+                    throw std::runtime_error("Snapshot: can not map " + path);
+                }
+                ::madvise(data, m_size, MADV_SEQUENTIAL);
+                m_data = static_cast<const char*>(data);
+            }
+            else {
+                ::close(handle);
+            }
+#else
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if (!file) {
+                throw std::runtime_error("Snapshot: can not open " + path);
+            }
+            m_buffer.resize(static_cast<address>(file.tellg()));
+            file.seekg(0);
+            file.read(m_buffer.data(), m_buffer.size());
+            m_data = m_buffer.data();
+            m_size = m_buffer.size();
+#endif
+        }
+        ~MappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+            if (m_data) {
+                ::munmap(const_cast<char*>(m_data), m_size);
+            }
+#endif
+        }
+        // copy
+        MappedFile(const MappedFile&) = delete;
+        // copy assign
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // data / size
+        const char* data() const {
+            return m_data;
+        }
+        address size() const {
+            return m_size;
+        }
+    private:
+        // member
+        const char* m_data = nullptr;
+        address m_size = 0;
+#if !defined(__unix__) && !defined(__APPLE__)
+        List<char> m_buffer;
+#endif
+    };
+
+    // SnapshotRecords
+    // the records of a mapped snapshot as an input range, each record is decoded when it is reached (no copy of the whole file),
+    // the header is checked when it is opened (and the size for fixed layouts), the records while they are decoded,
+    // so a snapshot with variable sized records that is cut short or has bytes left over throws on the first bad record
+    template<typename K, typename V>
+    class SnapshotRecords {
+    public:
+        // Iterator (moves the current record out)
+        class Iterator {
+        public:
+            // types
+            using value_type = std::pair<K, V>;
+            using difference_type = std::ptrdiff_t;
+
+            // constructor
+            Iterator() = default;
+            Iterator(SnapshotRecords* records)
+                : m_records(records) {}
+
+            // access
+            value_type&& operator*() const {
+                return move(*m_records->m_current);
+            }
+            // increment
+            Iterator& operator++() {
+                m_records->next();
+                return *this;
+            }
+            void operator++(int) {
+                ++*this;
+            }
+            // compare
+            bool operator==(std::default_sentinel_t) const {
+                return !m_records->m_current;
+            }
+        private:
+            // member
+            SnapshotRecords* m_records = nullptr;
+        };
+
+        // constructor
+        SnapshotRecords(const string& path)
+            : m_file(path), m_in(m_file.data(), m_file.size()) {
+            SnapshotHeader expected;
+            SnapshotHeader header = m_in.read<SnapshotHeader>();
+            if (header.magic != expected.magic || header.version != expected.version) {
+                throw std::runtime_error("Snapshot: " + path + " is no snapshot");
+            }
+            if (header.layout != SnapshotHeader::layoutOf<K, V>() || header.fingerprint != SnapshotHeader::fingerprintOf<K, V>()) {
+                throw std::runtime_error("Snapshot: " + path + " was saved with other types");
+            }
+            if constexpr (SnapshotHeader::layoutOf<K, V>() != 0) {
+                constexpr address record = sizeof(K) + sizeof(V);
+                if (m_in.remaining() % record != 0 || m_in.remaining() / record != header.count) {
+                    throw std::runtime_error("Snapshot: truncated file");
+                }
+            }
+            m_count = header.count;
+        }
+        // copy
+        SnapshotRecords(const SnapshotRecords&) = delete;
+        // copy assign
+        SnapshotRecords& operator=(const SnapshotRecords&) = delete;
+
+        // iterate (once)
+        Iterator begin() {
+            next();
+            return Iterator(this);
+        }
+        std::default_sentinel_t end() const {
+            return {};
+        }
+        // size
+        address size() const {
+            return m_count;
+        }
+    private:
+        // next
+        void next() {
+            if (m_read == m_count) {
+                if (m_in.remaining() != 0) {
+                    throw std::runtime_error("Snapshot: corrupt file");
+                }
+                m_current.reset();
+                return;
+            }
+            ++m_read;
+            K key = Serializer<K>::read(m_in);
+            m_current.emplace(move(key), Serializer<V>::read(m_in));
+        }
+
+        // member
+        MappedFile m_file;
+        SnapshotReader m_in;
+        address m_count = 0;
+        address m_read = 0;
+        Opt<std::pair<K, V>> m_current;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,148 @@
+#pragma once
+#include "common.hpp"
+#include "common_thread.hpp"
+#include "lock.hpp"
+#include <chrono> // steady_clock
+
+namespace Memory {
+    // LockStats (snapshot of one lock kind)
+    struct LockStats {
+        uint64 acquisitions = 0;
+        uint64 contended = 0;
+        uint64 waitNanos = 0;
+        uint64 maxWaitNanos = 0;
+
+        // operator+=
+        LockStats& operator+=(const LockStats& other) {
+            acquisitions += other.acquisitions;
+            contended += other.contended;
+            waitNanos += other.waitNanos;
+            maxWaitNanos = std::max(maxWaitNanos, other.maxWaitNanos);
+            return *this;
+        }
+    };
+    // MapStats (snapshot of a map, the map mutex and the entry mutexes are kept apart)
+    struct MapStats {
+        LockStats map;
+        LockStats entries;
+
+        // operator+=
+        MapStats& operator+=(const MapStats& other) {
+            map += other.map;
+            entries += other.entries;
+            return *this;
+        }
+    };
+
+    // LockCounter
+    // only counts when SAFEMAP_LOCK_STATS is defined, otherwise acquire() is a plain lock()
+    class LockCounter {
+    public:
+        // acquire (uncontended acquisitions are not timed)
+        template<typename TLock>
+        void acquire(TLock& lock) {
+#ifdef SAFEMAP_LOCK_STATS
+            m_acquisitions.fetch_add(1, std::memory_order_relaxed);
+            if (lock.try_lock()) {
+                return;
+            }
+            auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            uint64 nanos = static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            m_contended.fetch_add(1, std::memory_order_relaxed);
+            m_waitNanos.fetch_add(nanos, std::memory_order_relaxed);
+            uint64 max = m_maxWaitNanos.load(std::memory_order_relaxed);
+            while (nanos > max && !m_maxWaitNanos.compare_exchange_weak(max, nanos, std::memory_order_relaxed));
+#else
+            lock.lock();
+#endif
+        }
+        // acquire until (gives up at the deadline, waits are timed as in acquire)
+        template<typename TLock>
+        bool acquireUntil(TLock& lock, std::chrono::steady_clock::time_point deadline) {
+#ifdef SAFEMAP_LOCK_STATS
+            m_acquisitions.fetch_add(1, std::memory_order_relaxed);
+            if (lock.try_lock()) {
+                return true;
+            }
+            auto start = std::chrono::steady_clock::now();
+            bool acquired = tryLockUntil(lock, deadline);
+            uint64 nanos = static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            m_contended.fetch_add(1, std::memory_order_relaxed);
+            m_waitNanos.fetch_add(nanos, std::memory_order_relaxed);
+            uint64 max = m_maxWaitNanos.load(std::memory_order_relaxed);
+            while (nanos > max && !m_maxWaitNanos.compare_exchange_weak(max, nanos, std::memory_order_relaxed));
+            return acquired;
+#else
+            return tryLockUntil(lock, deadline);
+#endif
+        }
+        // snapshot
+        LockStats snapshot() const {
+#ifdef SAFEMAP_LOCK_STATS
+            return {
+                m_acquisitions.load(std::memory_order_relaxed),
+                m_contended.load(std::memory_order_relaxed),
+                m_waitNanos.load(std::memory_order_relaxed),
+                m_maxWaitNanos.load(std::memory_order_relaxed)
+            };
+#else
+            return {};
+#endif
+        }
+    private:
+#ifdef SAFEMAP_LOCK_STATS
+        // counter
+        atomic_uint64 m_acquisitions = 0;
+        atomic_uint64 m_contended = 0;
+        atomic_uint64 m_waitNanos = 0;
+        atomic_uint64 m_maxWaitNanos = 0;
+#endif
+    };
+
+    // CountedMutex (shared mutex that reports to its own LockCounter)
+    template<typename TMutex>
+    class CountedMutex {
+    public:
+        // lock / unlock
+        void lock() {
+            unique_lock lock(m_mutex, std::defer_lock);
+            m_counter.acquire(lock);
+            lock.release();
+        }
+        bool try_lock() {
+            return m_mutex.try_lock();
+        }
+        void unlock() {
+            m_mutex.unlock();
+        }
+        // lock / unlock shared
+        void lock_shared() {
+            shared_lock lock(m_mutex, std::defer_lock);
+            m_counter.acquire(lock);
+            lock.release();
+        }
+        bool try_lock_shared() {
+            return m_mutex.try_lock_shared();
+        }
+        void unlock_shared() {
+            m_mutex.unlock_shared();
+        }
+
+        // stats
+        LockStats stats() const {
+            return m_counter.snapshot();
+        }
+    private:
+        // member
+        TMutex m_mutex;
+        LockCounter m_counter;
+    };
+
+    // MapMutex (the map-wide mutex, only wrapped while counting)
+#ifdef SAFEMAP_LOCK_STATS
+    using MapMutex = CountedMutex<shared_mutex>;
+#else
+    using MapMutex = shared_mutex;
+#endif
+}
\ No newline at end of file
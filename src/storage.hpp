@@ -1,32 +1,42 @@
 #pragma once
 #include "common.hpp"
+#include <atomic> // atomic_ref
 
 namespace Memory {
     // Storage
+    // the state byte holds the valid bit and the pending bit (see SecureMap::insert), it is only written by the holder of
+    // the entry write lock, but the pending bit is read without the lock, so every access goes through atomic_ref
     template<typename T>
     class Storage {
     public:
         // construct
         template<typename... Args>
         void construct(Args&&... args) {
-            if (m_isValid) {
+            if (isValid()) {
                 destroy();
             }
             std::construct_at(std::bit_cast<T*>(&m_storage), forward<Args>(args)...);
-            m_isValid = true;
+            store(load() | Valid, std::memory_order_relaxed);
         }
         // destroy
         void destroy() {
-            if (m_isValid) {
-                m_isValid = false;
+            if (isValid()) {
+                store(load() & ~Valid, std::memory_order_relaxed);
                 std::destroy_at(std::bit_cast<T*>(&m_storage));
             }
         }
         // isValid
         bool isValid() const {
-            return m_isValid;
+            return load() & Valid;
         }
-        
+        // pending (a value is being constructed by the holder of the write lock, readable without the lock)
+        bool isPending() const {
+            return load(std::memory_order_acquire) & Pending;
+        }
+        void setPending(bool pending) {
+            store(pending ? load() | Pending : load() & ~Pending, std::memory_order_release);
+        }
+
         // get
         T& get() {
             return *std::bit_cast<T*>(&m_storage);
@@ -35,8 +45,20 @@ namespace Memory {
             return *std::bit_cast<const T*>(&m_storage);
         }
     private:
+        // state
+        static constexpr uint8 Valid = 1;
+        static constexpr uint8 Pending = 2;
+
+        // load / store (state)
+        uint8 load(std::memory_order order = std::memory_order_relaxed) const {
+            return std::atomic_ref(const_cast<uint8&>(m_state)).load(order);
+        }
+        void store(uint8 state, std::memory_order order) {
+            std::atomic_ref(m_state).store(state, order);
+        }
+
         // storage
         std::aligned_storage_t<sizeof(T), alignof(T)> m_storage;
-        bool m_isValid = false;
+        uint8 m_state = 0;
     };
-}
\ No newline at end of file
+}
@@ -1,25 +1,146 @@
 #pragma once
 #include "lock.hpp"
+#include "storage.hpp"
+#include "stats.hpp"
+#include "seqlock.hpp"
+#include "rwlock.hpp"
+#include "asyncmutex.hpp"
+#include "lockorder.hpp"
 
 namespace Memory {
     // SecureValue
-    template<typename T>
+    template<typename T, typename TMutex = shared_mutex>
     class SecureValue {
     public:
         // constructor
         template<typename... Args>
         SecureValue(Args&&... args)
             : m_value(forward<Args>(args)...) {}
+        // destructor
+        ~SecureValue() {
+            LockOrder::forget(&m_mutex);
+        }
+
+        // name (how the entry appears in lock order reports)
+        template<typename K>
+        void name(const K& key, const std::type_info& type) const {
+            LockOrder::name(&m_mutex, key, type);
+        }
         // read / write lock
-        ReadLocked<T> readLock() const {
+        ReadLocked<T, TMutex> readLock() const {
+            LockOrder::acquire(&m_mutex);
             return { &m_value, m_mutex };
         }
-        WriteLocked<T> writeLock() {
+        WriteLocked<T, TMutex> writeLock() {
+            LockOrder::acquire(&m_mutex);
             return { &m_value, m_mutex };
         }
+        // read / write lock (counted)
+        ReadLocked<T, TMutex> readLock(LockCounter& counter) const {
+            shared_lock lock(m_mutex, std::defer_lock);
+            LockOrder::acquire(&m_mutex);
+            counter.acquire(lock);
+            return { &m_value, move(lock) };
+        }
+        WriteLocked<T, TMutex> writeLock(LockCounter& counter) {
+            unique_lock lock(m_mutex, std::defer_lock);
+            LockOrder::acquire(&m_mutex);
+            counter.acquire(lock);
+            return { &m_value, move(lock) };
+        }
+        // upgrade lock (counted, requires a mutex with an upgrade mode, see UpgradeLock)
+        UpgradeLocked<T, TMutex> upgradeLock(LockCounter& counter) const requires requires(TMutex& mutex) { mutex.lock_upgrade(); } {
+            UpgradeLock<TMutex> lock(m_mutex, std::defer_lock);
+            LockOrder::acquire(&m_mutex);
+            counter.acquire(lock);
+            return { &m_value, move(lock) };
+        }
+        // try read / write lock (empty while the mutex is busy)
+        ReadLocked<T, TMutex> tryReadLock() const {
+            return readLockUntil(std::chrono::steady_clock::time_point());
+        }
+        WriteLocked<T, TMutex> tryWriteLock() {
+            return writeLockUntil(std::chrono::steady_clock::time_point());
+        }
+        // read / write lock for (empty if the mutex stayed busy until the deadline)
+        template<typename Rep, typename Period>
+        ReadLocked<T, TMutex> readLockFor(const std::chrono::duration<Rep, Period>& timeout) const {
+            return readLockUntil(std::chrono::steady_clock::now() + timeout);
+        }
+        template<typename Rep, typename Period>
+        WriteLocked<T, TMutex> writeLockFor(const std::chrono::duration<Rep, Period>& timeout) {
+            return writeLockUntil(std::chrono::steady_clock::now() + timeout);
+        }
+        ReadLocked<T, TMutex> readLockUntil(std::chrono::steady_clock::time_point deadline) const {
+            shared_lock lock(m_mutex, std::defer_lock);
+            if (!tryLockUntil(lock, deadline)) {
+                return {};
+            }
+            LockOrder::acquired(&m_mutex);
+            return { &m_value, move(lock) };
+        }
+        WriteLocked<T, TMutex> writeLockUntil(std::chrono::steady_clock::time_point deadline) {
+            unique_lock lock(m_mutex, std::defer_lock);
+            if (!tryLockUntil(lock, deadline)) {
+                return {};
+            }
+            LockOrder::acquired(&m_mutex);
+            return { &m_value, move(lock) };
+        }
+        // read / write lock until (counted)
+        ReadLocked<T, TMutex> readLockUntil(std::chrono::steady_clock::time_point deadline, LockCounter& counter) const {
+            shared_lock lock(m_mutex, std::defer_lock);
+            if (!counter.acquireUntil(lock, deadline)) {
+                return {};
+            }
+            LockOrder::acquired(&m_mutex);
+            return { &m_value, move(lock) };
+        }
+        WriteLocked<T, TMutex> writeLockUntil(std::chrono::steady_clock::time_point deadline, LockCounter& counter) {
+            unique_lock lock(m_mutex, std::defer_lock);
+            if (!counter.acquireUntil(lock, deadline)) {
+                return {};
+            }
+            LockOrder::acquired(&m_mutex);
+            return { &m_value, move(lock) };
+        }
+        // read / write lock (deferred, the caller acquires the returned lock, see LockSet)
+        std::pair<const T*, shared_lock<TMutex>> readLock(std::defer_lock_t) const {
+            return { &m_value, shared_lock(m_mutex, std::defer_lock) };
+        }
+        std::pair<T*, unique_lock<TMutex>> writeLock(std::defer_lock_t) {
+            return { &m_value, unique_lock(m_mutex, std::defer_lock) };
+        }
+        // lock async (queues waiter unless the mutex is free right away, see AsyncMutex)
+        bool lockAsync(AsyncWaiter& waiter) const requires requires(TMutex& mutex) { mutex.lockAsync(waiter); } {
+            return m_mutex.lockAsync(waiter);
+        }
+        // read / write lock (adopts a lock that was granted through lockAsync,
+        // not tracked by LockOrder since the coroutine may resume on another thread)
+        ReadLocked<T, TMutex> readLock(std::adopt_lock_t) const {
+            return { &m_value, shared_lock(m_mutex, std::adopt_lock) };
+        }
+        WriteLocked<T, TMutex> writeLock(std::adopt_lock_t) {
+            return { &m_value, unique_lock(m_mutex, std::adopt_lock) };
+        }
+        // readCopy (optimistic, without taking the mutex, see SeqMutex)
+        T readCopy() const requires requires(const TMutex& mutex) { mutex.version(); } {
+            return readOptimistic(m_value, m_mutex);
+        }
+        // pending (read without the mutex: set while the holder of the write lock constructs a new value,
+        // so others can treat the entry as missing instead of waiting for the constructor, see SecureMap::insert)
+        bool isPending() const requires requires(const T& value) { value.isPending(); } {
+            return m_value.isPending();
+        }
+        void setPending(bool pending) requires requires(T& value) { value.setPending(pending); } {
+            m_value.setPending(pending);
+        }
     private:
         // value
         T m_value;
-        mutable shared_mutex m_mutex;
+        mutable TMutex m_mutex;
     };
+
+    // the pending bit shares the state byte of Storage, a CompactPolicy entry keeps its 12 bytes
+    static_assert(sizeof(SecureValue<Storage<int>, CompactMutex>) == 12);
 }
\ No newline at end of file
@@ -8,8 +8,8 @@ namespace Memory {
     public:
         // constructor
         GenericView() = default;
-        template<typename V>
-        GenericView(const K& key, SecureMap<K, V>& map)
+        template<typename V, typename TPolicy>
+        GenericView(const K& key, SecureMap<K, V, TPolicy>& map)
             : m_key(key), m_map(static_cast<void*>(&map)) {}
         // key
         const K& key() const {
@@ -27,9 +27,9 @@ namespace Memory {
         }
     
         // friend
-        template<typename K2, typename V2>
+        template<typename K2, typename V2, typename TPolicy2>
         friend class ReadView;
-        template<typename K2, typename V2>
+        template<typename K2, typename V2, typename TPolicy2>
         friend class WriteView;
     private:
         // member
@@ -38,77 +38,95 @@ namespace Memory {
     };
 
     // WriteView
-    template<typename K, typename V>
+    template<typename K, typename V, typename TPolicy = MapPolicy>
     class WriteView {
     public:
         // constructor
         WriteView() = default;
         WriteView(const GenericView<K>& view)
-            : m_key(view.m_key), m_map(reinterpret_cast<SecureMap<K, V>*>(view.m_map)) {}
-        WriteView(const K& key, SecureMap<K, V>& map)
+            : m_key(view.m_key), m_map(reinterpret_cast<SecureMap<K, V, TPolicy>*>(view.m_map)) {}
+        WriteView(const K& key, SecureMap<K, V, TPolicy>& map)
             : m_key(key), m_map(&map) {}
 
         // key
         const K& key() const {
             return m_key;
         }
-        // operator->
+        // operator-> (resolves the key once, later dereferences only lock the entry under the shared map lock, empty once destroyed)
         auto operator->() {
-            return m_map->writeLock(m_key); 
+            return m_map->writeLock(m_key, m_handle);
+        }
+        // try lock / lock for
+        auto tryLock() {
+            return m_map->tryWriteLock(m_key);
+        }
+        template<typename Rep, typename Period>
+        auto lockFor(const std::chrono::duration<Rep, Period>& timeout) {
+            return m_map->writeLockFor(m_key, timeout);
         }
         // compare
-        bool operator==(const WriteView<K, V>& other) const {
+        bool operator==(const WriteView<K, V, TPolicy>& other) const {
             return m_key == other.m_key;
         }
-        bool operator<(const WriteView<K, V>& other) const {
+        bool operator<(const WriteView<K, V, TPolicy>& other) const {
             return m_key < other.m_key;
         }
-        bool operator>(const WriteView<K, V>& other) const {
+        bool operator>(const WriteView<K, V, TPolicy>& other) const {
             return m_key > other.m_key;
         }
 
         // friend
-        template<typename K2, typename V2>
+        template<typename K2, typename V2, typename TPolicy2>
         friend class ReadView;
     private:
         // member
         K m_key;
-        SecureMap<K, V>* m_map = nullptr;
+        SecureMap<K, V, TPolicy>* m_map = nullptr;
+        typename SecureMap<K, V, TPolicy>::WriteHandle m_handle;
     };
     // ReadView
-    template<typename K, typename V>
+    template<typename K, typename V, typename TPolicy = MapPolicy>
     class ReadView {
     public:
         // constructor
         ReadView() = default;
         ReadView(const GenericView<K>& view)
-            : m_key(view.m_key), m_map(reinterpret_cast<const SecureMap<K, V>*>(view.m_map)) {}
-        ReadView(const WriteView<K, V>& view)
-            : m_key(view.m_key), m_map(view.m_map) {}
-        ReadView(const K& key, const SecureMap<K, V>& map)
+            : m_key(view.m_key), m_map(reinterpret_cast<const SecureMap<K, V, TPolicy>*>(view.m_map)) {}
+        ReadView(const WriteView<K, V, TPolicy>& view)
+            : m_key(view.m_key), m_map(view.m_map), m_handle{ view.m_handle.entry, view.m_handle.key, view.m_handle.generation } {}
+        ReadView(const K& key, const SecureMap<K, V, TPolicy>& map)
             : m_key(key), m_map(&map) {}
 
         // key
         const K& key() const {
             return m_key;
         }
-        // operator->
+        // operator-> (resolves the key once, later dereferences only lock the entry under the shared map lock, empty once destroyed)
         auto operator->() {
-            return m_map->readLock(m_key); 
+            return m_map->readLock(m_key, m_handle);
+        }
+        // try lock / lock for
+        auto tryLock() {
+            return m_map->tryReadLock(m_key);
+        }
+        template<typename Rep, typename Period>
+        auto lockFor(const std::chrono::duration<Rep, Period>& timeout) {
+            return m_map->readLockFor(m_key, timeout);
         }
         // compare
-        bool operator==(const ReadView<K, V>& other) const {
+        bool operator==(const ReadView<K, V, TPolicy>& other) const {
             return m_key == other.m_key;
         }
-        bool operator<(const ReadView<K, V>& other) const {
+        bool operator<(const ReadView<K, V, TPolicy>& other) const {
             return m_key < other.m_key;
         }
-        bool operator>(const ReadView<K, V>& other) const {
+        bool operator>(const ReadView<K, V, TPolicy>& other) const {
             return m_key > other.m_key;
         }
     private:
         // member
         K m_key;
-        const SecureMap<K, V>* m_map = nullptr;
+        const SecureMap<K, V, TPolicy>* m_map = nullptr;
+        typename SecureMap<K, V, TPolicy>::ReadHandle m_handle;
     };
 }
\ No newline at end of file
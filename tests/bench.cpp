@@ -0,0 +1,357 @@
+#include "safemap.hpp"
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+
+using namespace Memory;
+using Clock = std::chrono::steady_clock;
+
+// Options
+struct Options {
+    address keys = 100'000;
+    address millis = 200;
+    List<address> threads;
+    bool json = false;
+};
+
+// Small / Large values
+using Small = int64;
+using Large = Array<double, 50>;
+void touch(Small& value) {
+    ++value;
+}
+void touch(Large& value) {
+    for (address i = 0; i < value.size(); ++i) {
+        value[i] += 1.0;
+    }
+}
+double peek(const Small& value) {
+    return static_cast<double>(value);
+}
+double peek(const Large& value) {
+    return value[0];
+}
+// dosth (uneven per-value work, formerly tests/loop.cpp)
+void dosth(int key, Large& array) {
+    for (int j = 0; j < 50; ++j) {
+        for (int k = 0; k < 100 + (key % 8) * 100; ++k) {
+            array[j] += std::sqrt((double)j + k);
+        }
+    }
+}
+
+// KeyGenerator (uniform or zipf distributed)
+class KeyGenerator {
+public:
+    // constructor
+    KeyGenerator(address keys, double skew, uint64 seed)
+        : m_keys(keys), m_random(seed) {
+        if (skew > 0) {
+            m_cdf.resize(keys);
+            double sum = 0;
+            for (address i = 0; i < keys; ++i) {
+                sum += 1.0 / std::pow(static_cast<double>(i + 1), skew);
+                m_cdf[i] = sum;
+            }
+            for (auto& value : m_cdf) {
+                value /= sum;
+            }
+        }
+    }
+    // next
+    int next() {
+        if (m_cdf.empty()) {
+            return static_cast<int>(m_random() % m_keys);
+        }
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(m_random);
+        return static_cast<int>(std::lower_bound(m_cdf.begin(), m_cdf.end(), u) - m_cdf.begin());
+    }
+private:
+    // member
+    address m_keys;
+    std::mt19937_64 m_random;
+    List<double> m_cdf;
+};
+
+// Result
+struct Result {
+    double opsPerSecond = 0;
+    double p50 = 0, p99 = 0, p999 = 0;
+};
+// percentile
+double percentile(const List<uint32>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[std::min(sorted.size() - 1, static_cast<address>(fraction * sorted.size()))];
+}
+// report
+void report(const Options& options, const string& name, const string& map, const string& value, const string& dist, double reads, address threads, const Result& result) {
+    if (options.json) {
+        std::printf(
+            "{\"bench\":\"%s\",\"map\":\"%s\",\"value\":\"%s\",\"dist\":\"%s\",\"reads\":%.2f,\"threads\":%zu,"
+            "\"ops_per_sec\":%.0f,\"p50_ns\":%.0f,\"p99_ns\":%.0f,\"p999_ns\":%.0f}\n",
+            name.c_str(), map.c_str(), value.c_str(), dist.c_str(), reads, threads,
+            result.opsPerSecond, result.p50, result.p99, result.p999
+        );
+    }
+    else {
+        std::printf(
+            "%-8s %-10s %-6s %-8s reads=%.2f threads=%-3zu %12.0f ops/s  p50=%6.0fns p99=%7.0fns p999=%8.0fns\n",
+            name.c_str(), map.c_str(), value.c_str(), dist.c_str(), reads, threads,
+            result.opsPerSecond, result.p50, result.p99, result.p999
+        );
+    }
+    std::fflush(stdout);
+}
+
+// mixed (point reads / writes, every 8th operation is timed)
+template<typename TMap>
+Result mixed(TMap& map, const Options& options, double skew, double reads, address threadCount) {
+    atomic_uint64 operations = 0;
+    std::atomic_bool running = true;
+    List<List<uint32>> latencies(threadCount);
+    List<thread> workers;
+    for (address t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&, t]() {
+            KeyGenerator keys(options.keys, skew, 1234 + t);
+            std::mt19937_64 random(t);
+            uint64 count = 0;
+            double sink = 0;
+            while (running.load(std::memory_order_relaxed)) {
+                int key = keys.next();
+                bool read = (random() % 10'000) < reads * 10'000;
+                bool timed = (count & 7) == 0;
+                auto start = timed ? Clock::now() : Clock::time_point();
+                if (read) {
+                    auto locked = map.readLock(key);
+                    if (locked) {
+                        sink += peek(*locked);
+                    }
+                }
+                else {
+                    auto locked = map.writeLock(key);
+                    if (locked) {
+                        touch(*locked);
+                    }
+                }
+                if (timed) {
+                    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+                    latencies[t].emplace_back(static_cast<uint32>(std::min<int64>(ns, UINT32_MAX)));
+                }
+                ++count;
+            }
+            operations += count;
+            if (sink == -1) {
+                cout << sink;
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.millis));
+    running = false;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    List<uint32> merged;
+    for (auto& list : latencies) {
+        merged.insert(merged.end(), list.begin(), list.end());
+    }
+    std::sort(merged.begin(), merged.end());
+    return { operations * 1000.0 / options.millis, percentile(merged, 0.5), percentile(merged, 0.99), percentile(merged, 0.999) };
+}
+// churn (every thread emplaces and erases its own key range)
+template<typename TMap>
+Result churn(const Options& options, address threadCount) {
+    TMap map;
+    List<List<uint32>> latencies(threadCount);
+    List<thread> workers;
+    address perThread = std::max<address>(1, options.keys / threadCount);
+    auto start = Clock::now();
+    for (address t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&, t]() {
+            int first = static_cast<int>(t * perThread);
+            for (address i = 0; i < perThread; ++i) {
+                auto begin = Clock::now();
+                map.emplace(first + static_cast<int>(i), Small(0));
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+                latencies[t].emplace_back(static_cast<uint32>(std::min<int64>(ns, UINT32_MAX)));
+            }
+            for (address i = 0; i < perThread; ++i) {
+                map.erase(first + static_cast<int>(i));
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    List<uint32> merged;
+    for (auto& list : latencies) {
+        merged.insert(merged.end(), list.begin(), list.end());
+    }
+    std::sort(merged.begin(), merged.end());
+    return { 2.0 * perThread * threadCount / seconds, percentile(merged, 0.5), percentile(merged, 0.99), percentile(merged, 0.999) };
+}
+
+// ingest (single threaded bulk load, plain std::map vs. emplace per key vs. emplaceMany)
+void ingest(const Options& options) {
+    List<std::pair<int, Small>> items;
+    for (address i = 0; i < options.keys; ++i) {
+        items.emplace_back(static_cast<int>(i), Small(i));
+    }
+    auto time = [&](auto func) {
+        auto start = Clock::now();
+        func();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return Result{ items.size() / seconds, 0, 0, 0 };
+    };
+    report(options, "ingest", "std::map", "small", "-", 0.0, 1, time([&]() {
+        Map<int, Small> map;
+        for (const auto& [key, value] : items) {
+            map.try_emplace(map.end(), key, value);
+        }
+    }));
+    report(options, "ingest", "map", "small", "-", 0.0, 1, time([&]() {
+        SecureMap<int, Small> map;
+        for (const auto& [key, value] : items) {
+            map.emplace(key, value);
+        }
+    }));
+    report(options, "ingestN", "map", "small", "-", 0.0, 1, time([&]() {
+        SecureMap<int, Small> map;
+        map.emplaceMany(items);
+    }));
+    report(options, "ingestN", "hash", "small", "-", 0.0, 1, time([&]() {
+        SecureMap<int, Small, HashPolicy> map;
+        map.emplaceMany(items);
+    }));
+    // snapshot round trip
+    SecureMap<int, Small> source;
+    source.emplaceMany(items);
+    ThreadPool pool;
+    report(options, "save", "map", "small", "-", 0.0, pool.size(), time([&]() {
+        source.save("bench.snapshot", pool);
+    }));
+    report(options, "load", "map", "small", "-", 0.0, 1, time([&]() {
+        SecureMap<int, Small> map;
+        map.load("bench.snapshot");
+    }));
+    std::remove("bench.snapshot");
+}
+
+// suite (mixed read / write workloads for one map type)
+template<typename TMap, typename V>
+void suite(const Options& options, const string& mapName, const string& valueName) {
+    TMap map;
+    if constexpr (requires(List<std::pair<int, V>>& items) { map.emplaceMany(items); }) {
+        List<std::pair<int, V>> items;
+        for (address i = 0; i < options.keys; ++i) {
+            items.emplace_back(static_cast<int>(i), V{});
+        }
+        map.emplaceMany(items);
+    }
+    else {
+        for (address i = 0; i < options.keys; ++i) {
+            map.emplace(static_cast<int>(i), V{});
+        }
+    }
+    for (auto [dist, skew] : { std::pair<const char*, double>{ "uniform", 0.0 }, { "zipf", 0.99 } }) {
+        for (double reads : { 1.0, 0.95, 0.5 }) {
+            for (address threads : options.threads) {
+                report(options, "mixed", mapName, valueName, dist, reads, threads, mixed(map, options, skew, reads, threads));
+            }
+        }
+    }
+}
+// scan (forEach vs. parallelForEach vs. plain std::map with uneven per-value work)
+void scan(const Options& options) {
+    int count = static_cast<int>(std::min<address>(options.keys, 10'000));
+    auto time = [&](auto func) {
+        auto start = Clock::now();
+        func();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return Result{ count / seconds, 0, 0, 0 };
+    };
+    Map<int, Large> plain;
+    SecureMap<int, Large> map;
+    for (int i = 0; i < count; ++i) {
+        plain.try_emplace(i);
+        map.emplace(i);
+    }
+    report(options, "scan", "std::map", "large", "-", 1.0, 1, time([&]() {
+        for (auto& [key, value] : plain) {
+            dosth(key, value);
+        }
+    }));
+    report(options, "scan", "SecureMap", "large", "-", 1.0, 1, time([&]() {
+        map.forEach([](const int& key, WriteLocked<Large>& value) {
+            dosth(key, *value);
+        });
+    }));
+    SecureMap<int, Small> small;
+    for (int i = 0; i < count; ++i) {
+        small.emplace(i, Small(i));
+    }
+    Small sum = 0;
+    report(options, "scan", "SecureMap", "small", "-", 1.0, 1, time([&]() {
+        small.forEachRead([&sum](const int&, ReadLocked<Small>& value) {
+            sum += *value;
+        });
+    }));
+    if (sum == -1) {
+        cout << sum;
+    }
+    for (address threads : options.threads) {
+        ThreadPool pool(threads);
+        report(options, "pscan", "SecureMap", "large", "-", 1.0, threads, time([&]() {
+            map.parallelForEach([](const int& key, WriteLocked<Large>& value) {
+                dosth(key, *value);
+            }, pool);
+        }));
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--json") == 0) {
+            options.json = true;
+        }
+        else if (std::strcmp(argv[i], "--keys") == 0 && i + 1 < argc) {
+            options.keys = std::stoul(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--ms") == 0 && i + 1 < argc) {
+            options.millis = std::stoul(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.threads.emplace_back(std::stoul(argv[++i]));
+        }
+        else {
+            std::printf("usage: bench [--json] [--keys N] [--ms N] [--threads N]...\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (options.threads.empty()) {
+        for (address threads = 1; threads <= std::max(1u, thread::hardware_concurrency()); threads *= 2) {
+            options.threads.emplace_back(threads);
+        }
+    }
+
+    suite<SecureMap<int, Small>, Small>(options, "map", "small");
+    suite<SecureMap<int, Large>, Large>(options, "map", "large");
+    suite<SecureMap<int, Small, HashPolicy>, Small>(options, "hash", "small");
+    suite<ShardedSecureMap<int, Small>, Small>(options, "sharded", "small");
+    suite<SecureMap<int, Small, CompactPolicy>, Small>(options, "compact", "small");
+    suite<ReadMostlySecureMap<int, Small>, Small>(options, "readmostly", "small");
+    for (address threads : options.threads) {
+        report(options, "churn", "map", "small", "-", 0.0, threads, churn<SecureMap<int, Small>>(options, threads));
+        report(options, "churn", "sharded", "small", "-", 0.0, threads, churn<ShardedSecureMap<int, Small>>(options, threads));
+        report(options, "churn", "pool", "small", "-", 0.0, threads, churn<SecureMap<int, Small, PoolPolicy>>(options, threads));
+    }
+    ingest(options);
+    scan(options);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
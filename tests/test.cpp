@@ -1,4 +1,5 @@
 #include "safemap.hpp"
+#include <filesystem> // temp_directory_path
 
 using namespace Memory;
 struct Entity {
@@ -7,6 +8,43 @@ struct Entity {
     string name;
     List<string> components;
 };
+// Detached (fire and forget coroutine)
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+// TemporaryFile (path in the temp directory, removed on scope exit)
+struct TemporaryFile {
+    TemporaryFile(const string& name)
+        : path((std::filesystem::temp_directory_path() / name).string()) {}
+    ~TemporaryFile() {
+        std::filesystem::remove(path);
+    }
+    string path;
+};
+// check (a failed check ends the suite with EXIT_FAILURE)
+void check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "check failed: " << what << endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+// eventually (polls condition until it holds, gives up after a generous deadline)
+template<typename Func>
+bool eventually(Func condition) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::yield();
+    }
+    return true;
+}
 int main() {
     Collection<int> typemap;
     typemap.addType<Entity>();
@@ -34,5 +72,481 @@ int main() {
     views.emplace(GenericView<int>(2, map));
     for (auto& view : views)
         cout << ReadView<int, Entity>(view)->name << endl;
+
+    ShardedSecureMap<int, Entity, 4> sharded;
+    for (int i = 0; i < 8; ++i)
+        sharded.emplace(i, "Shard" + std::to_string(ShardedSecureMap<int, Entity, 4>::shardIndex(i)));
+    sharded.erase(7);
+    cout << sharded.readLock(3)->name << endl;
+
+    SecureMap<string, Entity, HashPolicy> hashed;
+    hashed.emplace("A", "HashedA");
+    hashed.emplace("B", "HashedB");
+    hashed.erase("A");
+    cout << hashed.readLock("B")->name << endl;
+
+    ThreadPool pool(2);
+    typemap.emplace<Entity>(2, "ENTT2");
+    atomic_address visited = 0;
+    typemap.parallelForEach<Entity>([&](const int&, WriteLocked<Entity>& entity) {
+        entity->components.emplace_back("Visited");
+        ++visited;
+    }, pool);
+    cout << visited << endl;
+    // tasks submitted by a worker go to its own deque, while it stays busy only the other worker can steal them
+    atomic_address stolen = 0;
+    std::atomic_bool stealing = false, finished = false;
+    pool.submit([&]() {
+        thread::id owner = std::this_thread::get_id();
+        for (int i = 0; i < 8; ++i)
+            pool.submit([&stolen, owner]() { stolen += std::this_thread::get_id() != owner; });
+        stealing = eventually([&]() { return stolen == 8; });
+        finished = true;
+    });
+    check(eventually([&]() { return finished.load(); }) && stealing, "ThreadPool: an idle worker steals the tasks of a busy one");
+
+    for (const auto& [type, stats] : typemap.stats())
+        cout << type << ": " << stats.entries.contended << " contended" << endl;
+#ifdef SAFEMAP_LOCK_STATS
+    // lockstats target: a writer that has to wait for a held entry is counted as contended, with its wait time
+    SecureMap<int, int> contended;
+    contended.emplace(1, 0);
+    for (int attempt = 0; attempt < 10 && contended.stats().entries.contended == 0; ++attempt) {
+        auto held = contended.writeLock(1);
+        std::atomic_bool started = false;
+        thread waiter([&]() {
+            started = true;
+            *contended.writeLock(1) += 1;
+        });
+        eventually([&]() { return started.load(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        held.release();
+        waiter.join();
+    }
+    MapStats counted = contended.stats();
+    check(counted.entries.contended > 0 && counted.entries.waitNanos > 0 && counted.entries.maxWaitNanos <= counted.entries.waitNanos, "LockStats: a blocked writer is counted and timed");
+    check(counted.entries.acquisitions >= 2 * counted.entries.contended && counted.map.acquisitions > 0, "LockStats: every acquisition is counted");
+#endif
+
+    SecureMap<int, int, SeqPolicy> counters;
+    counters.emplace(1, 41);
+    ++*counters.writeLock(1);
+    cout << counters.readCopy(1).value_or(0) << ' ' << counters.readCopy(2).has_value() << endl;
+    ReadMostlySecureMap<int, int, SeqPolicy> readCounters;
+    readCounters.emplace(1, 7);
+    cout << readCounters.readCopy(1).value_or(0) << endl;
+    // an optimistic copy never sees a half written value, it is retried while a writer is busy and falls back to the lock
+    struct Versioned {
+        Array<uint64, 32> words = {};
+        // consistent (all words were written by the same writer)
+        bool consistent() const {
+            return std::ranges::all_of(words, [&](uint64 word) { return word == words[0]; });
+        }
+    };
+    SecureMap<int, Versioned, SeqPolicy> versioned;
+    versioned.emplace(1, Versioned{});
+    {
+        auto held = versioned.writeLock(1);
+        held->words.front() = 1;
+        Opt<Versioned> waited;
+        thread reader([&]() { waited = versioned.readCopy(1); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        held->words.fill(1);
+        held.release();
+        reader.join();
+        check(waited && waited->consistent() && waited->words[0] == 1, "SeqMutex: a reader waits for the writer holding the entry");
+    }
+    // a writer that finishes between the copy and its validation forces a retry
+    struct Interleaved {
+        SeqMutex<> mutex;
+        function<void()> writer;
+        // version (the validating load runs the writer once)
+        uint32 version(std::memory_order order = std::memory_order_acquire) {
+            if (order == std::memory_order_relaxed && writer) {
+                std::exchange(writer, nullptr)();
+            }
+            return mutex.version(order);
+        }
+        void lock_shared() {
+            mutex.lock_shared();
+        }
+        void unlock_shared() {
+            mutex.unlock_shared();
+        }
+    };
+    Versioned raced;
+    Interleaved interleaved;
+    interleaved.writer = [&]() {
+        thread([&]() {
+            unique_lock lock(interleaved.mutex);
+            raced.words.fill(1);
+        }).join();
+    };
+    Versioned retried = readOptimistic(raced, interleaved);
+    check(retried.consistent() && retried.words[0] == 1, "SeqMutex: a copy taken across a write is retried");
+    std::atomic_bool written = false;
+    thread writer([&]() {
+        for (uint64 i = 2; i < 20000; ++i)
+            versioned.writeLock(1)->words.fill(i);
+        written = true;
+    });
+    bool consistent = true;
+    uint64 latest = 0;
+    while (!written) {
+        Versioned copy = versioned.readCopy(1).value_or(Versioned{});
+        consistent = consistent && copy.consistent() && copy.words[0] >= latest;
+        latest = copy.words[0];
+    }
+    writer.join();
+    check(consistent && versioned.readCopy(1).value_or(Versioned{}).words[0] == 19999, "SeqMutex: optimistic copies are consistent and never go back");
+
+    SecureMap<int, Entity, CompactPolicy> compact;
+    compact.emplace(1, "Compact");
+    compact.writeLock(1)->components.emplace_back("Small");
+    cout << compact.readLock(1)->name << ' ' << sizeof(CompactMutex) << endl;
+    // threads that gave up spinning sleep on the state word, the unlock of a writer and of the last reader wakes them
+    CompactMutex gate;
+    atomic_address entered = 0;
+    gate.lock();
+    List<thread> sleepers;
+    for (int i = 0; i < 2; ++i) {
+        sleepers.emplace_back([&]() {
+            unique_lock lock(gate);
+            ++entered;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    check(entered == 0, "CompactMutex: a held write lock excludes writers");
+    gate.unlock();
+    check(eventually([&]() { return entered == 2; }), "CompactMutex: unlock wakes the sleeping writers");
+    for (auto& sleeper : sleepers)
+        sleeper.join();
+    gate.lock_shared();
+    thread excluded([&]() {
+        unique_lock lock(gate);
+        ++entered;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    check(entered == 2, "CompactMutex: a held read lock excludes writers");
+    gate.unlock_shared();
+    check(eventually([&]() { return entered == 3; }), "CompactMutex: the last reader wakes the sleeping writer");
+    excluded.join();
+    SecureMap<int, int, CompactPolicy> tallied;
+    tallied.emplace(1, 0);
+    List<thread> tallies;
+    for (int i = 0; i < 4; ++i) {
+        tallies.emplace_back([&]() {
+            for (int j = 0; j < 5000; ++j)
+                ++*tallied.writeLock(1);
+        });
+    }
+    for (auto& tally : tallies)
+        tally.join();
+    check(*tallied.readLock(1) == 20000, "CompactMutex: increments under the write lock are not lost");
+
+    Collection<int, PoolPolicy> pooled;
+    pooled.addType<Entity>();
+    pooled.emplace<Entity>(1, "Pooled");
+    pooled.clear<Entity>();
+    pooled.emplace<Entity>(2, "Repooled");
+    cout << pooled.readLock<Entity>(2)->name << endl;
+
+    Collection<int> batched;
+    batched.addType<Entity>();
+    batched.emplaceMany<Entity>(List<std::pair<int, string>>{ { 1, "Batch1" }, { 2, "Batch2" }, { 3, "Batch3" } });
+    batched.assignMany<Entity>(List<std::pair<int, string>>{ { 2, "Assigned2" }, { 4, "Batch4" } });
+    batched.eraseMany<Entity>(List<int>{ 1, 3, 5 });
+    cout << batched.readLock<Entity>(2)->name << ' ' << batched.readLock<Entity>(4)->name << ' ' << bool(batched.readLock<Entity>(1)) << endl;
+    // a busy entry is deferred until the exclusive section is over, the free ones are constructed without waiting for it
+    SecureMap<int, int> deferred;
+    deferred.emplace(1, 1);
+    std::atomic_bool applied = false;
+    {
+        auto busy = deferred.writeLock(1);
+        thread batcher([&]() {
+            deferred.assignMany(List<std::pair<int, int>>{ { 1, 10 }, { 2, 20 }, { 3, 30 }, { 3, 31 } });
+            applied = true;
+        });
+        check(eventually([&]() {
+            auto constructed = deferred.readLockFor(3, std::chrono::milliseconds(1));
+            return constructed && *constructed.locked == 30;
+        }), "batch: free entries are constructed while a busy one is deferred");
+        check(*busy == 1 && !applied && *deferred.readLock(2) == 20 && *deferred.readLock(3) == 30, "batch: the busy entry and the items after it wait for its holder");
+        busy.release();
+        batcher.join();
+    }
+    check(applied && *deferred.readLock(1) == 10 && *deferred.readLock(3) == 31, "batch: deferred items are applied in item order");
+
+    batched.addType<int>();
+    batched.emplace<int>(4, 7);
+    {
+        auto locks = batched.writeLockMany<int, Entity>(List<int>{ 4, 2, 4, 1 });
+        locks.at<Entity>(4).name += std::to_string(locks.at<int>(4));
+        cout << locks.size() << ' ' << locks.at<Entity>(4).name << ' ' << (locks.find<int>(2) == nullptr) << endl;
+    }
+    auto pair = map.lockMany(2, 1);
+    cout << pair.size() << ' ' << pair.at<Entity>(2).name << endl;
+
+    ReadMostlySecureMap<int, Entity> readMostly;
+    readMostly.emplace(1, "Mostly1");
+    readMostly.emplace(2, "Mostly2");
+    readMostly.erase(1);
+    readMostly.writeLock(2)->name += "!";
+    readMostly.forEach([](const int& key, ReadLocked<Entity>& entity) {
+        cout << key << ": " << entity->name << endl;
+    });
+
+    StaticCollection<int, Entity, int> components;
+    components.emplace<Entity>(1, "Static1");
+    components.emplace<int>(1, 5);
+    cout << components.readLock<Entity>(1)->name << ' ' << *components.readLock<int>(1) << ' ' << components.stats().size() << endl;
+
+    SecureMap<int, Entity> viewed;
+    viewed.emplace(1, "Viewed");
+    WriteView<int, Entity> cached(1, viewed);
+    cached->name += "!";
+    viewed.erase(1);
+    viewed.emplace(1, "Reemplaced");
+    cout << ReadView<int, Entity>(cached)->name << endl;
+    viewed.destroy(1);
+    cout << static_cast<bool>(cached.operator->()) << endl;
+
+    address visitedUntil = 0;
+    bool completed = sharded.forEachRead([&](const int& key, ReadLocked<Entity>&) {
+        ++visitedUntil;
+        return key != 4;
+    });
+    cout << completed << ' ' << (visitedUntil > 0) << endl;
+
+    SecureMap<string, int> ranged;
+    for (const char* key : { "a1", "a2", "b1", "b2", "b3", "c1" })
+        ranged.emplace(key, 1);
+    int rangeSum = 0, prefixSum = 0, chunks = 0;
+    ranged.forEachRange("a2", "b3", [&](const string&, ReadLocked<int>& value) { rangeSum += *value; });
+    ranged.forEachPrefix("b", [&](const string&, WriteLocked<int>& value) { prefixSum += ++*value; });
+    Cursor<string> cursor;
+    while (ranged.advance(cursor, 4, [](const string&, ReadLocked<int>&) {}))
+        ++chunks;
+    cout << rangeSum << ' ' << prefixSum << ' ' << chunks << endl;
+
+    {
+        auto busy = ranged.writeLock("a1");
+        auto contended = ranged.tryReadLock("a1");
+        auto missing = ranged.readLockFor("z9", std::chrono::milliseconds(1));
+        auto acquired = WriteView<string, int>("a2", ranged).lockFor(std::chrono::milliseconds(1));
+        address available = 0;
+        ranged.forEachAvailable([&](const string&, ReadLocked<int>&) { ++available; });
+        cout << (contended.status == LockStatus::Contended) << (missing.status == LockStatus::Missing) << bool(acquired) << ' ' << available << endl;
+    }
+
+    SecureMap<int, int> tombstoned;
+    for (int i = 0; i < 4; ++i)
+        tombstoned.emplace(i, i);
+    for (int i = 0; i < 6; ++i)
+        tombstoned.destroy(i % 3);
+    cout << tombstoned.tombstones() << ' ' << tombstoned.cleanStep(2) << ' ';
+    tombstoned.emplace(4, 4);
+    cout << tombstoned.tombstones() << endl;
+
+    SecureMap<string, string> saved;
+    saved.emplaceMany(List<std::pair<string, string>>{ { "a", "Saved" }, { "b", "Snapshot" }, { "c", "Gone" } });
+    saved.destroy("c");
+    TemporaryFile snapshot("safemap_test_snapshot.bin");
+    saved.save(snapshot.path, pool);
+    SecureMap<string, string, HashPolicy> loaded;
+    loaded.load(snapshot.path);
+    batched.save<int>(snapshot.path);
+    components.load<int>(snapshot.path);
+    cout << *loaded.readLock("a") << ' ' << *loaded.readLock("b") << ' ' << bool(loaded.readLock("c")) << ' ' << *components.readLock<int>(4) << ' ';
+    std::filesystem::resize_file(snapshot.path, std::filesystem::file_size(snapshot.path) - 1);
+    try {
+        components.load<int>(snapshot.path);
+    }
+    catch (const std::runtime_error& error) {
+        cout << error.what() << endl;
+    }
+
+    SecureMap<string, int> logged;
+    ChangeLog<string>& changes = logged.enableChangeLog(8);
+    auto subscriber = changes.subscribe();
+    logged.emplace("a", 1);
+    logged.emplace("b", 2);
+    *logged.writeLock("a") += 1;
+    logged.destroy("b");
+    logged.erase("a");
+    List<Change<string>> polled;
+    changes.poll(subscriber, polled);
+    for (const auto& change : polled)
+        cout << "IEDW"[static_cast<int>(change.kind)] << change.key << ' ';
+    for (int i = 0; i < 10; ++i)
+        logged.emplace("c", i);
+    polled.clear();
+    bool complete = changes.poll(subscriber, polled, 4);
+    cout << complete << polled.size() << ' ' << polled.front().sequence << endl;
+    // two writers overrun a small log while it is polled, every gap in the sequences has to be reported
+    SecureMap<int, int> lapped;
+    ChangeLog<int>& laps = lapped.enableChangeLog(8);
+    auto following = laps.subscribe();
+    auto idle = laps.subscribe();
+    atomic_address recorded = 0;
+    List<thread> recorders;
+    for (int writer = 0; writer < 2; ++writer) {
+        recorders.emplace_back([&, writer]() {
+            for (int i = 0; i < 2000; ++i)
+                lapped.emplace(writer * 2000 + i, i);
+            ++recorded;
+        });
+    }
+    bool sequenced = true;
+    uint64 next = 0;
+    Array<int, 2> lastKeys = { -1, 1999 };
+    auto follow = [&]() {
+        List<Change<int>> changes;
+        bool complete = laps.poll(following, changes);
+        for (const auto& change : changes) {
+            int& lastKey = lastKeys[change.key / 2000];
+            sequenced = sequenced && (change.sequence == next || (!complete && change.sequence > next)) && change.kind == ChangeKind::Insert && change.key > lastKey;
+            lastKey = change.key;
+            next = change.sequence + 1;
+        }
+    };
+    while (recorded < 2)
+        follow();
+    for (auto& recorder : recorders)
+        recorder.join();
+    follow();
+    check(sequenced && next == 4000 && following.sequence() == 4000, "ChangeLog: polled changes keep their order and every gap is reported");
+    List<Change<int>> held;
+    bool lapComplete = laps.poll(idle, held);
+    check(!lapComplete && held.size() == laps.capacity() && held.front().sequence == 4000 - laps.capacity() && held.back().sequence == 3999, "ChangeLog: a subscriber that fell a lap behind resumes at the oldest change still held");
+
+    Collection<int, AsyncPolicy> awaited;
+    awaited.addType<int>();
+    awaited.emplace<int>(1, 0);
+    atomic_address resumed = 0;
+    {
+        auto held = awaited.writeLock<int>(1);
+        for (int i = 0; i < 3; ++i) {
+            [](Collection<int, AsyncPolicy>& map, ThreadPool& pool, atomic_address& resumed) -> Detached {
+                auto locked = co_await map.writeLockAsync<int>(1, pool);
+                *locked += 1;
+                auto missing = co_await map.readLockAsync<int>(2, pool);
+                resumed += !missing;
+            }(awaited, pool, resumed);
+        }
+        *held = 10;
+    }
+    while (resumed < 3)
+        std::this_thread::yield();
+    cout << *awaited.readLock<int>(1) << ' ' << resumed << endl;
+    // a release hands the entry to the waiters in the order they queued, a reader queued last sees every writer before it
+    SecureMap<int, List<int>, AsyncPolicy> queued;
+    queued.emplace(1, List<int>{});
+    atomic_address granted = 0;
+    List<int> observed;
+    {
+        auto held = queued.writeLock(1);
+        for (int i = 0; i < 4; ++i) {
+            [](SecureMap<int, List<int>, AsyncPolicy>& map, ThreadPool& pool, atomic_address& granted, int i) -> Detached {
+                auto locked = co_await map.writeLockAsync(1, pool);
+                locked->push_back(i);
+                ++granted;
+            }(queued, pool, granted, i);
+        }
+        [](const SecureMap<int, List<int>, AsyncPolicy>& map, ThreadPool& pool, atomic_address& granted, List<int>& observed) -> Detached {
+            auto locked = co_await map.readLockAsync(1, pool);
+            observed = *locked;
+            ++granted;
+        }(queued, pool, granted, observed);
+        check(granted == 0, "AsyncMutex: waiters queue behind the holder");
+    }
+    check(eventually([&]() { return granted == 5; }) && observed == List<int>{ 0, 1, 2, 3 } && *queued.readLock(1) == observed, "AsyncMutex: waiters are granted in FIFO order");
+
+    string_view request = "GET hashed B";
+    string_view name = request.substr(request.rfind(' ') + 1);
+    hashed.writeLock(name)->components.emplace_back("Viewed");
+    cout << hashed.readLock(name)->components.back() << ' ' << *loaded.readLock(string_view("ab").substr(0, 1)) << ' ' << bool(hashed.tryReadLock(request)) << endl;
+
+    SecureMap<int, int, UpgradePolicy> upgraded;
+    upgraded.emplace(1, 1);
+    {
+        auto checked = upgraded.upgradeLock(1);
+        thread([&]() {
+            cout << *upgraded.readLock(1) << ' ' << bool(upgraded.tryWriteLock(1)) << ' ';
+        }).join();
+        if (*checked == 1)
+            *checked.upgrade() += 1;
+        cout << bool(checked) << ' ';
+    }
+    auto promoted = compact.upgradeLock(1);
+    if (promoted->name == "Compact")
+        promoted.upgrade()->name = "Promoted";
+    cout << *upgraded.readLock(1) << ' ' << compact.readLock(1)->name << endl;
+
+    SecureMap<string, int, HashPolicy> counts;
+    for (string_view word : { "a", "b", "a", "a" })
+        counts.upsert(word, [](int& count) { ++count; }, 1);
+    bool updated = counts.update("b", [](int& count) { count += 10; }) && !counts.update("z", [](int&) {});
+    *counts.computeIfAbsent("c", []() { return 7; }) += 1;
+    bool erased = !counts.eraseIf("a", [](const int& count) { return count > 5; }) && counts.eraseIf("b", [](const int& count) { return count > 5; });
+    components.upsert<int>(9, [](int& value) { ++value; }, 90);
+    cout << *counts.readLock("a") << ' ' << *counts.readLock("c") << ' ' << updated << erased << counts.update("b", [](int&) {}) << ' ' << *components.readLock<int>(9) << endl;
+
+    SecureMap<int, Entity> derived;
+    derived.emplace(1, "Base");
+    struct Derived {
+        const SecureMap<int, Entity>& map;
+        operator string() const {
+            return map.readLock(1)->name + "Derived";
+        }
+    };
+    derived.emplace(2, Derived{ derived });
+    cout << derived.readLock(2)->name << endl;
+    // a key under construction reads as missing, a throwing constructor leaves no node behind
+    struct Pending {
+        const SecureMap<int, Entity>& map;
+        operator string() const {
+            return map.readLock(3) ? "Visible" : "Pending";
+        }
+    };
+    derived.emplace(3, Pending{ derived });
+    struct Throwing {
+        operator string() const {
+            throw std::runtime_error("Throwing");
+        }
+    };
+    try {
+        derived.emplace(4, Throwing{});
+    }
+    catch (const std::runtime_error& error) {
+        cout << error.what() << ' ';
+    }
+    cout << derived.readLock(3)->name << ' ' << bool(derived.readLock(4)) << ' ' << derived.tombstones() << endl;
+
+    SecureMap<int, int> ordered;
+    ordered.emplace(1, 1);
+    ordered.emplace(2, 2);
+    List<string> reports;
+    LockOrder::onViolation([&](const string& report) { reports.emplace_back(report); });
+    {
+        auto first = ordered.writeLock(1);
+        auto second = ordered.writeLock(2);
+    }
+    {
+        auto second = ordered.writeLock(2);
+        auto first = ordered.writeLock(1);
+    }
+    {
+        auto first = ordered.readLock(1);
+        auto again = ordered.readLock(1);
+    }
+    for (const auto& report : reports)
+        cout << report << endl;
+    cout << reports.size() << endl;
+#ifdef SAFEMAP_LOCK_ORDER
+    // lockorder target: exactly the cycle and the self re-entry above must be reported
+    if (reports.size() != 2 || !reports[0].starts_with("LockOrder: cycle") || !reports[1].starts_with("LockOrder: self re-entry"))
+        return EXIT_FAILURE;
+#endif
     return EXIT_SUCCESS;
 }
\ No newline at end of file